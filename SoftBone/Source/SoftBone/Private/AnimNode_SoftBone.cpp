@@ -3,8 +3,66 @@
 #include "SoftBonePluginPrivatePCH.h"
 #include "../Public/AnimNode_SoftBone.h"
 #include "AnimInstanceProxy.h"
+#include "ThreadSingleton.h"
 
-DEFINE_LOG_CATEGORY_STATIC(LogSoftBone, Log, All);
+// should stay 0 after the first evaluation, evaluation of SoftBone nodes isn't supposed to allocate any memory
+DECLARE_DWORD_COUNTER_STAT(TEXT("Scratch Buffer Reallocations"), STAT_SoftBoneScratchReallocations, STATGROUP_SoftBone);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Active Chains"), STAT_SoftBoneActiveChains, STATGROUP_SoftBone);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Sleeping Chains"), STAT_SoftBoneSleepingChains, STATGROUP_SoftBone);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Evaluated Links"), STAT_SoftBoneEvaluatedLinks, STATGROUP_SoftBone);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Link Memory Kept By Evaluated Nodes"), STAT_SoftBoneLinkMemory, STATGROUP_SoftBone);
+
+DECLARE_CYCLE_STAT(TEXT("Evaluate"), STAT_SoftBoneEvaluate, STATGROUP_SoftBone);
+DECLARE_CYCLE_STAT(TEXT("Compute Targets"), STAT_SoftBoneComputeTargets, STATGROUP_SoftBone);
+DECLARE_CYCLE_STAT(TEXT("Output Conversion"), STAT_SoftBoneOutputConversion, STATGROUP_SoftBone);
+DECLARE_CYCLE_STAT(TEXT("Re-Orientation"), STAT_SoftBoneReOrientation, STATGROUP_SoftBone);
+
+/** Deferred instances move their last simulated state along its velocities for at most this long, then hold it */
+static const float MaxDeferredExtrapolationTime = 0.1f;
+
+/** Per link buffers of the node which are only used while it's evaluated. Only one node at a time is evaluated on each thread, so they share these buffers. */
+class FSoftBoneEvaluationScratch : public TThreadSingleton<FSoftBoneEvaluationScratch>
+{
+public:
+	TArray<FVector> RenderPositions;
+	TArray<FVector> PositionsInCS;
+	FSoftBoneVectorStream RestDirections;
+	FSoftBoneVectorStream SimulatedDirections;
+	FSoftBoneQuatStream DeltaRotations;
+
+	/** Sizes all buffers for NumLinks links. Returns true if any of them had to grow, they only grow until they fit the largest node of the thread. */
+	bool SetNumZeroed(int32 NumLinks)
+	{
+		const SIZE_T AllocatedSize = GetAllocatedSize();
+
+		RestDirections.SetNumZeroed(NumLinks);
+		SimulatedDirections.SetNumZeroed(NumLinks);
+		DeltaRotations.SetNumZeroed(NumLinks);
+
+		RenderPositions.Reset(NumLinks);
+		RenderPositions.AddZeroed(NumLinks);
+		PositionsInCS.Reset(NumLinks);
+		PositionsInCS.AddZeroed(NumLinks);
+
+		return GetAllocatedSize() != AllocatedSize;
+	}
+
+	/** Swaps the evaluation buffers of Node with the ones of this thread */
+	void Exchange(FAnimNode_SoftBone& Node)
+	{
+		::Exchange(RenderPositions, Node.RenderPositions);
+		::Exchange(PositionsInCS, Node.PositionsInCS);
+		::Exchange(RestDirections, Node.RestDirections);
+		::Exchange(SimulatedDirections, Node.SimulatedDirections);
+		::Exchange(DeltaRotations, Node.DeltaRotations);
+	}
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return RenderPositions.GetAllocatedSize() + PositionsInCS.GetAllocatedSize() + RestDirections.GetAllocatedSize() + SimulatedDirections.GetAllocatedSize()
+			+ DeltaRotations.GetAllocatedSize();
+	}
+};
 
 /////////////////////////////////////////////////////
 // FAnimNode_SpringBone
@@ -17,9 +75,43 @@ FAnimNode_SoftBone::FAnimNode_SoftBone()
 	, RemainingTime(0.f)
 	, bBoneLengthConstraint(true)
 	, bGuaranteeSameSimulationResult(true)
+	, SolverType(ESoftBoneSolverType::SST_Explicit)
+	, NumIterations(2)
+	, ConvergenceTolerance(0.1f)
+	, MaxSubStepsPerFrame(8)
+	, bInterpolateFixedSteps(false)
 	, bAllowTipBoneRotation(true)
 	, SimulationHertz(ESimulationHertz::SH_60Hz)
 	, bUseWeightCurve(true)
+	, bSimulateInComponentSpace(false)
+	, bBatchSimulation(false)
+	, bCompactState(false)
+	, bEnableLOD(false)
+	, bEnableSleep(false)
+	, SleepVelocityThreshold(1.f)
+	, SleepTargetThreshold(0.1f)
+	, SleepDelay(0.5f)
+	, ReducedSimulationHertz(ESimulationHertz::SH_30Hz)
+	, ReducedRateThreshold(2000.f, 0.1f)
+	, SingleStepThreshold(4000.f, 0.05f)
+	, FrozenThreshold(8000.f, 0.02f)
+	, NotRenderedLODTier(ESoftBoneLODTier::SLT_Frozen)
+	, LODBlendTime(0.25f)
+	, bEnableExternalForces(false)
+	, WindScale(2000.f)
+	, RadialForceScale(1.f)
+	, LODTier(ESoftBoneLODTier::SLT_Full)
+	, SimulationWeight(1.f)
+	, CachedComponentToWorld(FTransform::Identity)
+	, PrevComponentToWorld(FTransform::Identity)
+	, ComponentToSimulation(FTransform::Identity)
+	, SimulationToComponent(FTransform::Identity)
+	, SimulationSpaceGravity(FVector::ZeroVector)
+	, bSimulationInWorldSpace(false)
+	, bChainsInComponentSpace(false)
+	, BakedWeightType(ERestoringWeight::RW_Quadratic)
+	, bBakedWithWeightCurve(true)
+	, AppliedStiffness(0.f)
 {
 	FRichCurve* Curve = WeightCurve.GetRichCurve();
 
@@ -34,12 +126,26 @@ void FAnimNode_SoftBone::Initialize(const FAnimationInitializeContext& Context)
 	FAnimNode_SkeletalControlBase::Initialize(Context);
 	RemainingTime = 0.0f;
 
-	for (int32 Index = 0; Index < ChainInfos.Num(); Index++)
+	ChainTemplate.Reset();
+	ResetSimulation();
+	ResetPreviousChains();
+	Simulation.RemainingTime = 0.f;
+
+	LODTier = ESoftBoneLODTier::SLT_Full;
+	SimulationWeight = 1.f;
+
+	// properties are loaded by now, later changes of them bake the weight tables again
+	BakedWeightType = RestoringWeightType;
+	bBakedWithWeightCurve = bUseWeightCurve;
+
+	// the manager gathers world and component data on the game thread, so evaluation doesn't need to touch them
+	// initialization may run on a worker thread as well, so the manager of the world is found by the game thread after this frame
+	// copies of the node carry over the instance but not its registration, so they are queued again
+	if (Simulation.Manager == nullptr)
 	{
-		ChainInfos[Index].Empty();
+		Simulation.Component = Context.AnimInstanceProxy->GetSkelMeshComponent();
+		FSoftBoneSimulationManager::QueueRegistration(&Simulation);
 	}
-
-	ChainInfos.Empty();
 }
 
 void FAnimNode_SoftBone::CacheBones(const FAnimationCacheBonesContext& Context)
@@ -51,51 +157,187 @@ void FAnimNode_SoftBone::UpdateInternal(const FAnimationUpdateContext& Context)
 {
 	FAnimNode_SkeletalControlBase::UpdateInternal(Context);
 
-	RemainingTime += Context.GetDeltaTime();
+	// may run on a worker thread, so world data comes from the manager and the transform from the proxy
+	UpdateSimulationTime(Context.GetDeltaTime(), Context.AnimInstanceProxy->GetComponentTransform());
+}
+
+void FAnimNode_SoftBone::UpdateSimulationTime(float DeltaTime, const FTransform& ComponentToWorld)
+{
+	RemainingTime += DeltaTime;
+
+	// the manager gathers the wind for the next frame
+	Simulation.bUseExternalForces = bEnableExternalForces;
 
-	const USkeletalMeshComponent* SkelComp = Context.AnimInstanceProxy->GetSkelMeshComponent();
-	const UWorld* World = SkelComp->GetWorld();
-	check(World->GetWorldSettings());
-	// Fixed step simulation at 60hz or 120hz
-	FixedTimeStep = (1.f / (float)SimulationHertz) * World->GetWorldSettings()->GetEffectiveTimeDilation();
+	const FSoftBoneGameThreadData& GameThreadData = Simulation.GameThreadData;
+	CachedComponentToWorld = ComponentToWorld;
 
-	DeltaTimeStep = Context.GetDeltaTime();
-	GravityZ = World->GetGravityZ();
+	UpdateLOD(DeltaTime);
+
+	// Fixed step simulation at 60hz or 120hz, reduced rate tier can go down to 30hz
+	const ESimulationHertz::Type Hertz = (LODTier == ESoftBoneLODTier::SLT_ReducedRate) ? ReducedSimulationHertz : SimulationHertz;
+	FixedTimeStep = (1.f / (float)Hertz) * GameThreadData.TimeDilation;
+
+	DeltaTimeStep = DeltaTime;
+	GravityZ = GameThreadData.GravityZ;
 }
 
 void FAnimNode_SoftBone::GatherDebugData(FNodeDebugData& DebugData)
 {
 	// @TODO : Add more output info?
 	FString DebugLine = DebugData.GetNodeName(this);
-	DebugLine += FString::Printf(TEXT("(DeltaTimeStep: %.3f%% RemainingTime: %.3f)"), DeltaTimeStep, RemainingTime);
+	DebugLine += FString::Printf(TEXT("(DeltaTimeStep: %.3f%% RemainingTime: %.3f LOD: %d Weight: %.2f Sleeping: %d/%d Deferred: %d Simulation: %.3f ms)"), DeltaTimeStep, RemainingTime + Simulation.RemainingTime, (int32)LODTier, SimulationWeight, Simulation.GetNumSleepingChains(), Simulation.GetNumChains(), Simulation.NumDeferredFrames, Simulation.LastSimulationTime * 1000.f);
 
 	DebugData.AddDebugItem(DebugLine);
 	ComponentPose.GatherDebugData(DebugData);
 }
 
-static void SetSoftBoneIndices(FCSPose<FCompactPose>& MeshBases, FCompactPoseBoneIndex RootIndex, FCompactPoseBoneIndex TipIndex, TArray<FCompactPoseBoneIndex>& BoneIndices)
+void FAnimNode_SoftBone::UpdateLOD(float DeltaTime)
 {
-	FCompactPoseBoneIndex BoneIndex = TipIndex;
+	const bool bUseFrameBudget = (FSoftBoneSimulationManager::GetFrameBudget() > 0.f);
+
+	if (bEnableLOD || bUseFrameBudget)
+	{
+		const FSoftBoneGameThreadData& GameThreadData = Simulation.GameThreadData;
+		const float Distance = GameThreadData.ViewDistance;
+		const float ScreenSize = (Distance > KINDA_SMALL_NUMBER) ? GameThreadData.BoundsRadius / Distance : 1.f;
+
+		LODTier = bEnableLOD ? ComputeLODTier(Distance, ScreenSize, GameThreadData.bRecentlyRendered) : ESoftBoneLODTier::SLT_Full;
+
+		// instances out of sight are the first ones to be deferred when the frame budget runs out
+		Simulation.Significance = GameThreadData.bRecentlyRendered ? ScreenSize : ScreenSize * 0.1f;
+	}
+	else
+	{
+		LODTier = ESoftBoneLODTier::SLT_Full;
+	}
+
+	// blend between the simulated and the animated pose instead of popping when freezing or waking up
+	const float TargetWeight = (LODTier == ESoftBoneLODTier::SLT_Frozen) ? 0.f : 1.f;
+
+	if (LODBlendTime > 0.f)
+	{
+		SimulationWeight = FMath::FInterpConstantTo(SimulationWeight, TargetWeight, DeltaTime, 1.f / LODBlendTime);
+	}
+	else
+	{
+		SimulationWeight = TargetWeight;
+	}
+}
+
+ESoftBoneLODTier::Type FAnimNode_SoftBone::ComputeLODTier(float Distance, float ScreenSize, bool bRecentlyRendered) const
+{
+	ESoftBoneLODTier::Type Tier = ESoftBoneLODTier::SLT_Full;
+
+	if (FrozenThreshold.IsSatisfied(Distance, ScreenSize))
+	{
+		Tier = ESoftBoneLODTier::SLT_Frozen;
+	}
+	else if (SingleStepThreshold.IsSatisfied(Distance, ScreenSize))
+	{
+		Tier = ESoftBoneLODTier::SLT_SingleStep;
+	}
+	else if (ReducedRateThreshold.IsSatisfied(Distance, ScreenSize))
+	{
+		Tier = ESoftBoneLODTier::SLT_ReducedRate;
+	}
+
+	if (!bRecentlyRendered)
+	{
+		Tier = (ESoftBoneLODTier::Type)FMath::Max<int32>(Tier, NotRenderedLODTier);
+	}
+
+	return Tier;
+}
+
+/** Adds bones from the tip up to the root, or all bones under the root if the tip isn't set */
+static void AddSoftBoneIndices(FCSPose<FCompactPose>& MeshBases, FCompactPoseBoneIndex RootIndex, const FBoneReference& TipBone, TArray<bool>& InTree)
+{
+	const FCompactPose& Pose = MeshBases.GetPose();
+
+	InTree[RootIndex.GetInt()] = true;
+
+	if (TipBone.BoneName == NAME_None)
+	{
+		// compact pose bones are sorted parent first, so parents are visited before their children
+		for (int32 Index = RootIndex.GetInt() + 1; Index < Pose.GetNumBones(); Index++)
+		{
+			const FCompactPoseBoneIndex ParentIndex = Pose.GetParentBoneIndex(FCompactPoseBoneIndex(Index));
 
-	do
+			if (ParentIndex.GetInt() >= RootIndex.GetInt() && InTree[ParentIndex.GetInt()])
+			{
+				InTree[Index] = true;
+			}
+		}
+	}
+	else
 	{
-		BoneIndices.Insert(BoneIndex, 0);
-		BoneIndex = MeshBases.GetPose().GetParentBoneIndex(BoneIndex);
-	} while (BoneIndex != RootIndex);
-	BoneIndices.Insert(BoneIndex, 0);
+		for (FCompactPoseBoneIndex BoneIndex = TipBone.GetCompactPoseIndex(Pose.GetBoneContainer()); BoneIndex != RootIndex; BoneIndex = Pose.GetParentBoneIndex(BoneIndex))
+		{
+			InTree[BoneIndex.GetInt()] = true;
+		}
+	}
 }
 
 static bool IsValidBonePair(const FBoneContainer& BoneContainer, const FBoneReference& RootBone, const FBoneReference& TipBone)
 {
+	if (TipBone.BoneName == NAME_None)
+	{
+		return RootBone.IsValid(BoneContainer);
+	}
+
 	return (TipBone.IsValid(BoneContainer)
 		&& RootBone.IsValid(BoneContainer)
 		&& BoneContainer.BoneIsChildOf(TipBone.BoneIndex, RootBone.BoneIndex));
 }
 
 void FAnimNode_SoftBone::InitializeBoneIndices(FCSPose<FCompactPose>& MeshBases)
+{
+	ChainsAsset = MeshBases.GetPose().GetBoneContainer().GetAsset();
+	ChainTemplate = FindOrBuildChainTemplate(MeshBases);
+
+	// links are allocated later in InitializeChains
+	ResetSimulation();
+}
+
+TSharedRef<const FSoftBoneChainTemplate, ESPMode::ThreadSafe> FAnimNode_SoftBone::FindOrBuildChainTemplate(FCSPose<FCompactPose>& MeshBases) const
 {
 	const FBoneContainer& BoneContainer = MeshBases.GetPose().GetBoneContainer();
 
+	FSoftBoneChainTemplateKey Key;
+	Key.Asset = BoneContainer.GetAsset();
+	Key.RequiredBones = BoneContainer.GetBoneIndicesArray();
+	Key.RootBoneNames.Add(RootBone.BoneName);
+	Key.TipBoneNames.Add(TipBone.BoneName);
+
+	for (int32 Index = 0; Index < AdditionalChains.Num(); Index++)
+	{
+		Key.RootBoneNames.Add(AdditionalChains[Index].RootBone.BoneName);
+		Key.TipBoneNames.Add(AdditionalChains[Index].TipBone.BoneName);
+	}
+
+	FRichCurve PresetCurve;
+	const FRichCurve& Curve = GetRestoringWeightCurve(PresetCurve);
+
+	Key.bAllowTipBoneRotation = bAllowTipBoneRotation;
+	Key.bUseWeightCurve = bUseWeightCurve;
+
+	if (bUseWeightCurve)
+	{
+		Key.WeightKeys = Curve.GetCopyOfKeys();
+	}
+
+	Key.UpdateHash();
+
+	TSharedPtr<const FSoftBoneChainTemplate, ESPMode::ThreadSafe> SharedTemplate = FSoftBoneChainTemplate::Find(Key);
+
+	if (SharedTemplate.IsValid())
+	{
+		return SharedTemplate.ToSharedRef();
+	}
+
+	TSharedRef<FSoftBoneChainTemplate, ESPMode::ThreadSafe> Template = MakeShareable(new FSoftBoneChainTemplate(Key));
+	TArray<FChainInfo>& ChainInfos = Template->Chains;
+
 	// sort chains by bone index order
 	TArray<FBonePair> SortedPairArray;
 
@@ -125,390 +367,883 @@ void FAnimNode_SoftBone::InitializeBoneIndices(FCSPose<FCompactPose>& MeshBases)
 	// It could be possible to sort all OutBoneTransforms at the end of Evaluation but selected this way to reduce sorting cost
 	SortedPairArray.Sort(FCompareRootBone());
 
-	ChainInfos.Empty();
-	ChainInfos.AddZeroed(SortedPairArray.Num());
+	const int32 NumPoseBones = MeshBases.GetPose().GetNumBones();
+
+	TArray<bool> InTree;
+	TArray<int32> LocalIndices;
+	int32 TransformOffset = 0;
 
-	for (int32 Index = 0; Index < SortedPairArray.Num(); Index++)
+	for (int32 PairIndex = 0; PairIndex < SortedPairArray.Num(); )
 	{
-		const FCompactPoseBoneIndex RootIndex = SortedPairArray[Index].RootBone.GetCompactPoseIndex(BoneContainer);
-		const FCompactPoseBoneIndex TipIndex = SortedPairArray[Index].TipBone.GetCompactPoseIndex(BoneContainer);
+		const FCompactPoseBoneIndex RootIndex = SortedPairArray[PairIndex].RootBone.GetCompactPoseIndex(BoneContainer);
+
+		// merge all pairs of the same root into one tree
+		InTree.Reset(NumPoseBones);
+		InTree.AddZeroed(NumPoseBones);
+
+		for (; PairIndex < SortedPairArray.Num() && SortedPairArray[PairIndex].RootBone.GetCompactPoseIndex(BoneContainer) == RootIndex; PairIndex++)
+		{
+			AddSoftBoneIndices(MeshBases, RootIndex, SortedPairArray[PairIndex].TipBone, InTree);
+		}
 
-		SetSoftBoneIndices(MeshBases, RootIndex, TipIndex, ChainInfos[Index].BoneIndices);
+		FChainInfo& Chain = ChainInfos[ChainInfos.AddDefaulted()];
+
+		LocalIndices.Init(INDEX_NONE, NumPoseBones);
+
+		// ascending compact pose indices keep parents first
+		for (int32 Index = RootIndex.GetInt(); Index < NumPoseBones; Index++)
+		{
+			if (InTree[Index])
+			{
+				const FCompactPoseBoneIndex BoneIndex(Index);
+				const int32 ParentIndex = (BoneIndex == RootIndex) ? INDEX_NONE : LocalIndices[MeshBases.GetPose().GetParentBoneIndex(BoneIndex).GetInt()];
+
+				LocalIndices[Index] = Chain.BoneIndices.Add(BoneIndex);
+				Chain.ParentIndices.Add(ParentIndex);
+			}
+		}
+
+		const int32 NumBones = Chain.BoneIndices.Num();
+
+		// a root without any child has nothing to simulate
+		if (NumBones < 2)
+		{
+			ChainInfos.Pop();
+			continue;
+		}
+
+		Chain.AimIndices.Init(INDEX_NONE, NumBones);
+
+		for (int32 Index = 1; Index < NumBones; Index++)
+		{
+			int32& ParentAimIndex = Chain.AimIndices[Chain.ParentIndices[Index]];
+
+			if (ParentAimIndex == INDEX_NONE)
+			{
+				ParentAimIndex = Index;
+			}
+		}
+
+		// connect a virtual link to each leaf for natural rotation of tip bones
+		if (bAllowTipBoneRotation)
+		{
+			for (int32 Index = 1; Index < NumBones; Index++)
+			{
+				if (Chain.AimIndices[Index] == INDEX_NONE)
+				{
+					Chain.AimIndices[Index] = Chain.ParentIndices.Add(Index);
+				}
+			}
+		}
+
+		// mesh bone indices don't depend on the LOD, virtual tip links follow the key of their bone
+		Chain.LinkKeys.SetNumUninitialized(Chain.ParentIndices.Num());
+
+		for (int32 Index = 0; Index < Chain.ParentIndices.Num(); Index++)
+		{
+			Chain.LinkKeys[Index] = (Index < NumBones) ? BoneContainer.MakeMeshPoseIndex(Chain.BoneIndices[Index]).GetInt() * 2 : Chain.LinkKeys[Chain.ParentIndices[Index]] + 1;
+		}
+
+		Chain.TransformOffset = TransformOffset;
+		TransformOffset += NumBones;
 	}
+
+	// links of the chains follow each other in the simulation state in the same order
+	for (int32 ChainIndex = 0; ChainIndex < ChainInfos.Num(); ChainIndex++)
+	{
+		FChainInfo& Chain = ChainInfos[ChainIndex];
+		Chain.NumLinks = Chain.ParentIndices.Num();
+		Chain.LinkOffset = Template->NumLinks;
+		Chain.RangeIndex = ChainIndex;
+
+		BakeWeightTable(Chain, Curve);
+
+		Template->NumLinks += Chain.NumLinks;
+	}
+
+	Template->NumTransforms = TransformOffset;
+
+	return FSoftBoneChainTemplate::Register(Template);
 }
 
-#if WITH_EDITOR
-void FAnimNode_SoftBone::InitialzeWeightCurve()
+const TArray<FChainInfo>& FAnimNode_SoftBone::GetChains() const
 {
-	// construct curve templates
-	FRichCurve* Curve = WeightCurve.GetRichCurve();
+	static const TArray<FChainInfo> NoChains;
+	return ChainTemplate.IsValid() ? ChainTemplate->Chains : NoChains;
+}
 
-	switch (RestoringWeightType)
+/** Replaces the keys of Curve with the preset of WeightType. Custom curves are kept. */
+static void BuildWeightPreset(ERestoringWeight::Type WeightType, FRichCurve& Curve)
+{
+	// construct curve templates
+	switch (WeightType)
 	{
 	case ERestoringWeight::RW_Constant:
-		Curve->Reset();
-		Curve->AddKey(0.0f, 1.0f);
-		Curve->AddKey(1.0f, 1.0f);
+		Curve.Reset();
+		Curve.AddKey(0.0f, 1.0f);
+		Curve.AddKey(1.0f, 1.0f);
 		break;
 	case ERestoringWeight::RW_Linear:
-		Curve->Reset();
-		Curve->AddKey(0.0f, 1.1f);
-		Curve->AddKey(1.1f, 0.0f);
+		Curve.Reset();
+		Curve.AddKey(0.0f, 1.1f);
+		Curve.AddKey(1.1f, 0.0f);
 		break;
 	case ERestoringWeight::RW_Quadratic:
-		Curve->Reset();
-		Curve->AddKey(0.0f, 1.1f);
-		Curve->AddKey(0.1f, 1.0f);
-		Curve->AddKey(0.2f, 0.5f);
-		Curve->AddKey(0.3f, 0.33f);
-		Curve->AddKey(0.4f, 0.25f);
-		Curve->AddKey(0.5f, 0.2f);
-		Curve->AddKey(0.6f, 0.16f);
-		Curve->AddKey(1.0f, 0.1f);
+		Curve.Reset();
+		Curve.AddKey(0.0f, 1.1f);
+		Curve.AddKey(0.1f, 1.0f);
+		Curve.AddKey(0.2f, 0.5f);
+		Curve.AddKey(0.3f, 0.33f);
+		Curve.AddKey(0.4f, 0.25f);
+		Curve.AddKey(0.5f, 0.2f);
+		Curve.AddKey(0.6f, 0.16f);
+		Curve.AddKey(1.0f, 0.1f);
 		break;
 	}
 }
+
+#if WITH_EDITOR
+void FAnimNode_SoftBone::InitialzeWeightCurve()
+{
+	BuildWeightPreset(RestoringWeightType, *WeightCurve.GetRichCurve());
+}
 #endif // #if WITH_EDITOR
 
-void FAnimNode_SoftBone::InitializeChains(USkeletalMeshComponent* SkelComp, FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms)
+const FRichCurve& FAnimNode_SoftBone::GetRestoringWeightCurve(FRichCurve& PresetCurve) const
 {
-	int32 NumChains = ChainInfos.Num();
-	int32 TransformStartIndex = 0;
+	if (RestoringWeightType == ERestoringWeight::RW_Custom)
+	{
+		return *WeightCurve.GetRichCurveConst();
+	}
+
+	// the editor keeps WeightCurve in sync with presets, a preset picked at runtime leaves the authored keys alone
+	BuildWeightPreset(RestoringWeightType, PresetCurve);
+	return PresetCurve;
+}
+
+void FAnimNode_SoftBone::InitializeChains(FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms)
+{
+	const TArray<FChainInfo>& ChainInfos = GetChains();
+	const int32 NumChains = ChainInfos.Num();
+
+	// links of all chains live in one state, so they can be simulated together
+	Simulation.State.Reset(ChainTemplate.IsValid() ? ChainTemplate->NumLinks : 0);
+
+	// size scratch buffers once here, so evaluation doesn't need any heap allocation
+	UpdateScratchBuffers();
 
 	for (int32 Index = 0; Index < NumChains; Index++)
 	{
-		if (ChainInfos[Index].BoneIndices.Num() >= 2)
+		const FChainInfo& Chain = ChainInfos[Index];
+
+		// ranges were laid out by the template in the same order
+		verify(Simulation.State.AddChain(Chain.NumLinks) == Chain.LinkOffset);
+
+		if (!RestorePreviousChain(Chain, MeshBases, OutBoneTransforms))
 		{
-			InitializeChain(ChainInfos[Index], SkelComp, MeshBases, OutBoneTransforms, TransformStartIndex);
-			TransformStartIndex += ChainInfos[Index].BoneIndices.Num();
+			InitializeChain(Chain, MeshBases, OutBoneTransforms);
+
+			// interpolated targets start on the animated pose like the links
+			for (int32 LinkIndex = Chain.LinkOffset; LinkIndex < Chain.LinkOffset + Chain.NumLinks; LinkIndex++)
+			{
+				Simulation.TargetPositions.Set(LinkIndex, Simulation.State.Positions.Get(LinkIndex));
+			}
 		}
 	}
+
+	// new and restored links are all scaled by the current stiffness
+	AppliedStiffness = Stiffness;
+
+	// previous links have been continued where possible, keep their allocations for the next change
+	ResetPreviousChains();
 }
 
-void FAnimNode_SoftBone::InitializeChain(FChainInfo& Chain, USkeletalMeshComponent* SkelComp, FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms, int32 OutTransformStartIndex)
+bool FAnimNode_SoftBone::RestorePreviousChain(const FChainInfo& Chain, FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms)
 {
-	TArray<FCompactPoseBoneIndex>& BoneIndices =  Chain.BoneIndices;
-	TArray<FSoftBoneLink>& PrevBoneLinks = Chain.PrevBoneLinks;
-
-	if (BoneIndices.Num() < 2)
+	if (!PreviousChainTemplate.IsValid())
 	{
-		return;
+		return false;
 	}
 
-	// Gather chain links. These are non zero length bones.
-	const FBoneContainer& BoneContainer = MeshBases.GetPose().GetBoneContainer();
+	const TArray<FChainInfo>& PreviousChainInfos = PreviousChainTemplate->Chains;
+	const FChainInfo* PreviousChain = nullptr;
 
-	int32 const NumTransforms = BoneIndices.Num();
-	int32 MaxWeightKeyIndex = NumTransforms - 1;
+	for (int32 Index = 0; Index < PreviousChainInfos.Num(); Index++)
+	{
+		if (PreviousChainInfos[Index].RangeIndex != INDEX_NONE && PreviousChainInfos[Index].LinkKeys[0] == Chain.LinkKeys[0])
+		{
+			PreviousChain = &PreviousChainInfos[Index];
+			break;
+		}
+	}
 
-	if (bAllowTipBoneRotation)
+	if (PreviousChain == nullptr)
 	{
-		PrevBoneLinks.Reserve(NumTransforms + 1);
-		MaxWeightKeyIndex = NumTransforms;
+		return false;
 	}
-	else
+
+	FSoftBoneChainState& State = Simulation.State;
+	const int32 LinkOffset = Chain.LinkOffset;
+	const int32 PreviousLinkOffset = PreviousChain->LinkOffset;
+
+	// chains start awake, their cached bone transforms for sleeping are gone
+	if (Chain.LinkKeys == PreviousChain->LinkKeys && Chain.ParentIndices == PreviousChain->ParentIndices)
 	{
-		PrevBoneLinks.Reserve(NumTransforms);
+		// same bones, so lengths are still valid and the whole chain is copied without reading the pose
+		for (int32 LinkIndex = 0; LinkIndex < Chain.NumLinks; LinkIndex++)
+		{
+			const int32 Index = LinkOffset + LinkIndex;
+			const int32 PreviousIndex = PreviousLinkOffset + LinkIndex;
+			const int32 ParentIndex = Chain.ParentIndices[LinkIndex];
+
+			State.Positions.Set(Index, PreviousState.Positions.Get(PreviousIndex));
+			State.PreviousPositions.Set(Index, PreviousState.PreviousPositions.Get(PreviousIndex));
+			State.Velocities.Set(Index, PreviousState.Velocities.Get(PreviousIndex));
+			State.RestoringWeights[Index] = Stiffness * Chain.WeightTable[LinkIndex];
+			State.Lengths[Index] = PreviousState.Lengths[PreviousIndex];
+			State.ParentIndices[Index] = (ParentIndex == INDEX_NONE) ? INDEX_NONE : LinkOffset + ParentIndex;
+			Simulation.TargetPositions.Set(Index, PreviousTargetPositions.Get(PreviousIndex));
+		}
+
+		return true;
 	}
 
-	FRichCurve* Curve = WeightCurve.GetRichCurve();
+	// bones were added or removed, so the chain is built from the pose and the links which still exist continue where they were
+	InitializeChain(Chain, MeshBases, OutBoneTransforms);
+
+	// virtual tip links follow their bones, so keys aren't sorted and the previous links are looked up by key
+	TMap<int32, int32> PreviousLinkIndices;
+	PreviousLinkIndices.Reserve(PreviousChain->NumLinks);
 
-	// Start with Root Bone
+	for (int32 LinkIndex = 0; LinkIndex < PreviousChain->NumLinks; LinkIndex++)
 	{
-		const FCompactPoseBoneIndex& RootBoneIndex = BoneIndices[0];
-		const FTransform& BoneCSTransform = MeshBases.GetComponentSpaceTransform(RootBoneIndex);
+		PreviousLinkIndices.Add(PreviousChain->LinkKeys[LinkIndex], LinkIndex);
+	}
 
-		OutBoneTransforms[OutTransformStartIndex] = FBoneTransform(RootBoneIndex, BoneCSTransform);
+	for (int32 LinkIndex = 0; LinkIndex < Chain.NumLinks; LinkIndex++)
+	{
+		const int32 Index = LinkOffset + LinkIndex;
+		const int32* PreviousLinkIndex = PreviousLinkIndices.Find(Chain.LinkKeys[LinkIndex]);
+
+		if (PreviousLinkIndex == nullptr)
+		{
+			Simulation.TargetPositions.Set(Index, State.Positions.Get(Index));
+			continue;
+		}
 
-		FTransform BoneTransformInWorldSpace = (SkelComp != NULL) ? BoneCSTransform * SkelComp->GetComponentToWorld() : BoneCSTransform;
+		const int32 PreviousIndex = PreviousLinkOffset + *PreviousLinkIndex;
 
-		Chain.PrevBoneLinks.Add(FSoftBoneLink(BoneTransformInWorldSpace.GetLocation(), 0.f, RootBoneIndex));
+		State.Positions.Set(Index, PreviousState.Positions.Get(PreviousIndex));
+		State.PreviousPositions.Set(Index, PreviousState.PreviousPositions.Get(PreviousIndex));
+		State.Velocities.Set(Index, PreviousState.Velocities.Get(PreviousIndex));
+		Simulation.TargetPositions.Set(Index, PreviousTargetPositions.Get(PreviousIndex));
 	}
 
-	// Go through remaining transforms
-	for (int32 TransformIndex = 1; TransformIndex < NumTransforms; TransformIndex++)
+	return true;
+}
+
+void FAnimNode_SoftBone::KeepPreviousChains()
+{
+	// released compact links are restored into the previous chains directly, they are only read from there
+	if (Simulation.bCompactState && !Simulation.bStateExpanded && Simulation.CompactState.Num() > 0)
 	{
-		const FCompactPoseBoneIndex& BoneIndex = BoneIndices[TransformIndex];
+		FSoftBoneSolver::DecompressState(Simulation.CompactState, PreviousState, PreviousTargetPositions);
+		Simulation.CompactState.Reset();
+		Exchange(PreviousChainTemplate, ChainTemplate);
+		return;
+	}
 
-		const FTransform& BoneCSTransform = MeshBases.GetComponentSpaceTransform(BoneIndex);
-		FVector const BoneCSPosition = BoneCSTransform.GetLocation();
+	// nothing has been simulated since the last change, so the previous links are still the latest ones
+	if (Simulation.State.Num() == 0)
+	{
+		return;
+	}
 
-		int32 OutTransformIndex = OutTransformStartIndex + TransformIndex;
-		OutBoneTransforms[OutTransformIndex] = FBoneTransform(BoneIndex, BoneCSTransform);
+	// swapping keeps the allocations of both sides alive for the next change
+	Exchange(PreviousChainTemplate, ChainTemplate);
+	Exchange(PreviousState, Simulation.State);
+	Exchange(PreviousTargetPositions, Simulation.TargetPositions);
+}
 
-		FTransform BoneTransformInWorldSpace = (SkelComp != NULL) ? BoneCSTransform * SkelComp->GetComponentToWorld() : BoneCSTransform;
-		// Calculate the combined length of this segment of skeleton
-		float const BoneLength = FVector::Dist(BoneCSPosition, OutBoneTransforms[OutTransformIndex - 1].Transform.GetLocation());
+void FAnimNode_SoftBone::ResetPreviousChains()
+{
+	PreviousChainTemplate.Reset();
 
-		PrevBoneLinks.Add(FSoftBoneLink(BoneTransformInWorldSpace.GetLocation(), BoneLength, BoneIndex));
+	// compact nodes don't keep full precision links in between LOD changes
+	if (bCompactState)
+	{
+		PreviousState = FSoftBoneChainState();
+		PreviousTargetPositions = FSoftBoneVectorStream();
+		return;
+	}
 
-		if (bUseWeightCurve)
-		{
-			PrevBoneLinks[TransformIndex].RestoringWeight = Stiffness * Curve->Eval((float)TransformIndex / (float)MaxWeightKeyIndex);
-		}
-		else
-		{
-			PrevBoneLinks[TransformIndex].RestoringWeight = Stiffness / TransformIndex;
-		}
+	PreviousState.Reset();
+	PreviousTargetPositions.SetNumZeroed(0);
+}
 
+void FAnimNode_SoftBone::InitializeChain(const FChainInfo& Chain, FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms)
+{
+	const TArray<FCompactPoseBoneIndex>& BoneIndices =  Chain.BoneIndices;
+	FSoftBoneChainState& State = Simulation.State;
+
+	if (BoneIndices.Num() < 2)
+	{
+		return;
 	}
 
-	// create a virtual link to the tip bone for natural rotation of tip bone
-	if (bAllowTipBoneRotation)
+	int32 const NumTransforms = BoneIndices.Num();
+	const int32 OutTransformStartIndex = Chain.TransformOffset;
+	const int32 LinkOffset = Chain.LinkOffset;
+
+	check(Chain.NumLinks == Chain.ParentIndices.Num());
+
+	for (int32 TransformIndex = 0; TransformIndex < NumTransforms; TransformIndex++)
 	{
-		const FTransform& ParentBoneCSTransform = MeshBases.GetComponentSpaceTransform(BoneIndices[BoneIndices.Num() - 2]);
-		FVector const ParentBoneCSPosition = ParentBoneCSTransform.GetLocation();
+		const FCompactPoseBoneIndex& BoneIndex = BoneIndices[TransformIndex];
+		const FTransform& BoneCSTransform = MeshBases.GetComponentSpaceTransform(BoneIndex);
 
-		const FTransform& TipBoneCSTransform = MeshBases.GetComponentSpaceTransform(BoneIndices[BoneIndices.Num() - 1]);
-		FVector const TipBoneCSPosition = TipBoneCSTransform.GetLocation();
+		OutBoneTransforms[OutTransformStartIndex + TransformIndex] = FBoneTransform(BoneIndex, BoneCSTransform);
+	}
 
-		FTransform ParentBoneTransformInWS = (SkelComp != NULL) ? ParentBoneCSTransform * SkelComp->GetComponentToWorld() : ParentBoneCSTransform;
-		FTransform TipBoneTransformInWS = (SkelComp != NULL) ? TipBoneCSTransform * SkelComp->GetComponentToWorld() : TipBoneCSTransform;
-		// Calculate the combined length of this segment of skeleton
-		float const BoneLength = FVector::Dist(TipBoneCSPosition, ParentBoneCSPosition);
+	for (int32 LinkIndex = 0; LinkIndex < Chain.NumLinks; LinkIndex++)
+	{
+		const int32 ParentIndex = Chain.ParentIndices[LinkIndex];
 
-		FVector VirtualBonePositionInWS = TipBoneTransformInWS.GetLocation() + (TipBoneTransformInWS.GetLocation() - ParentBoneTransformInWS.GetLocation());
-		// connect a virtual link from the tip bone copying information from the parent bone
-		FCompactPoseBoneIndex BoneIndex(INDEX_NONE);
-		PrevBoneLinks.Add(FSoftBoneLink(VirtualBonePositionInWS, BoneLength, BoneIndex));
+		// Start with Root Bone
+		if (ParentIndex == INDEX_NONE)
+		{
+			State.SetLink(LinkOffset + LinkIndex, ToSimulationSpace(OutBoneTransforms[OutTransformStartIndex].Transform.GetLocation()), INDEX_NONE, 0.f, 0.f);
+			continue;
+		}
+
+		FVector const ParentBoneCSPosition = OutBoneTransforms[OutTransformStartIndex + ParentIndex].Transform.GetLocation();
+		FVector BoneCSPosition;
 
-		if (bUseWeightCurve)
+		if (LinkIndex < NumTransforms)
 		{
-			PrevBoneLinks[PrevBoneLinks.Num() - 1].RestoringWeight = Stiffness * Curve->Eval(1.0f);
+			BoneCSPosition = OutBoneTransforms[OutTransformStartIndex + LinkIndex].Transform.GetLocation();
 		}
 		else
 		{
-			PrevBoneLinks[PrevBoneLinks.Num() - 1].RestoringWeight = Stiffness / (float)MaxWeightKeyIndex;
+			// a virtual link continues the tip bone copying information from its parent bone
+			FVector const GrandParentBoneCSPosition = OutBoneTransforms[OutTransformStartIndex + Chain.ParentIndices[ParentIndex]].Transform.GetLocation();
+			BoneCSPosition = ParentBoneCSPosition + (ParentBoneCSPosition - GrandParentBoneCSPosition);
 		}
+
+		// Calculate the combined length of this segment of skeleton
+		float const BoneLength = FVector::Dist(BoneCSPosition, ParentBoneCSPosition);
+
+		State.SetLink(LinkOffset + LinkIndex, ToSimulationSpace(BoneCSPosition), LinkOffset + ParentIndex, BoneLength, Stiffness * Chain.WeightTable[LinkIndex]);
 	}
 }
 
-void FAnimNode_SoftBone::ComputeTargetPositions(FChainInfo& Chain, USkeletalMeshComponent* SkelComp, FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms, int32 OutTransformStartIndex, TArray<FVector>& TargetPositions)
+void FAnimNode_SoftBone::BakeWeightTable(FChainInfo& Chain, const FRichCurve& Curve) const
 {
-	TArray<FCompactPoseBoneIndex>& BoneIndices = Chain.BoneIndices;
+	const int32 NumLinks = Chain.ParentIndices.Num();
 
-	int32 const NumTransforms = BoneIndices.Num();
+	// restoring weights fall off with the depth in the tree, the deepest link gets the end of the curve
+	TArray<int32> Depths;
+	Depths.AddZeroed(NumLinks);
+	int32 MaxWeightKeyIndex = 1;
 
-	if (bAllowTipBoneRotation)
+	for (int32 Index = 1; Index < NumLinks; Index++)
 	{
-		TargetPositions.Reserve(NumTransforms + 1);
+		Depths[Index] = Depths[Chain.ParentIndices[Index]] + 1;
+		MaxWeightKeyIndex = FMath::Max(MaxWeightKeyIndex, Depths[Index]);
 	}
-	else
+
+	// roots are pinned and don't need any weight
+	Chain.WeightTable.Reset(NumLinks);
+	Chain.WeightTable.Add(0.f);
+
+	for (int32 Index = 1; Index < NumLinks; Index++)
 	{
-		TargetPositions.Reserve(NumTransforms);
+		Chain.WeightTable.Add(bUseWeightCurve ? Curve.Eval((float)Depths[Index] / (float)MaxWeightKeyIndex) : 1.f / Depths[Index]);
 	}
+}
 
-	// Start with Root Bone
+void FAnimNode_SoftBone::UpdateRestoringWeights(FCSPose<FCompactPose>& MeshBases)
+{
+	if (RestoringWeightType != BakedWeightType || bUseWeightCurve != bBakedWithWeightCurve)
 	{
-		const FCompactPoseBoneIndex& RootBoneIndex = BoneIndices[0];
-		const FTransform BoneCSTransform = MeshBases.GetComponentSpaceTransform(RootBoneIndex);
+		// shared templates never change, so the node moves to the one of the new settings. Its bones and link ranges are the same.
+		// links kept over a LOD switch are restored with the tables of the new template
+		if (ChainTemplate.IsValid())
+		{
+			ChainTemplate = FindOrBuildChainTemplate(MeshBases);
+		}
 
-		OutBoneTransforms[OutTransformStartIndex] = FBoneTransform(RootBoneIndex, BoneCSTransform);
+		BakedWeightType = RestoringWeightType;
+		bBakedWithWeightCurve = bUseWeightCurve;
 
-		FTransform BoneTransformInWorldSpace = (SkelComp != NULL) ? BoneCSTransform * SkelComp->GetComponentToWorld() : BoneCSTransform;
-		FVector BoneWSPosition = BoneTransformInWorldSpace.GetLocation();
-		TargetPositions.Add(BoneWSPosition);
+		// scale the new tables into the links below
+		AppliedStiffness = -1.f;
 	}
 
-	// Go through remaining transforms
-	for (int32 TransformIndex = 1; TransformIndex < NumTransforms; TransformIndex++)
+	if (Stiffness == AppliedStiffness)
 	{
-		const FCompactPoseBoneIndex& BoneIndex = BoneIndices[TransformIndex];
+		return;
+	}
 
-		const FTransform& BoneCSTransform = MeshBases.GetComponentSpaceTransform(BoneIndex);
+	const TArray<FChainInfo>& ChainInfos = GetChains();
 
-		FTransform BoneTransformInWorldSpace = (SkelComp != NULL) ? BoneCSTransform * SkelComp->GetComponentToWorld() : BoneCSTransform;
+	for (int32 ChainIndex = 0; ChainIndex < ChainInfos.Num(); ChainIndex++)
+	{
+		const FChainInfo& Chain = ChainInfos[ChainIndex];
+
+		for (int32 LinkIndex = 0; LinkIndex < Chain.NumLinks; LinkIndex++)
+		{
+			Simulation.State.SetRestoringWeight(Chain.LinkOffset + LinkIndex, Stiffness * Chain.WeightTable[LinkIndex]);
+		}
+	}
+
+	AppliedStiffness = Stiffness;
+}
+
+template <bool bWorldSpace>
+void FAnimNode_SoftBone::ComputeTargetPositions(const FChainInfo& Chain, FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms, FSoftBoneVectorStream& OutTargetPositions)
+{
+	const TArray<FCompactPoseBoneIndex>& BoneIndices = Chain.BoneIndices;
+
+	int32 const NumTransforms = BoneIndices.Num();
+	const int32 OutTransformStartIndex = Chain.TransformOffset;
+	const int32 LinkOffset = Chain.LinkOffset;
+
+	check(LinkOffset + Chain.NumLinks <= OutTargetPositions.Num());
+
+	for (int32 TransformIndex = 0; TransformIndex < NumTransforms; TransformIndex++)
+	{
+		const FCompactPoseBoneIndex& BoneIndex = BoneIndices[TransformIndex];
 
-		FVector const BoneWSPosition = BoneTransformInWorldSpace.GetLocation();
+		const FTransform& BoneCSTransform = MeshBases.GetComponentSpaceTransform(BoneIndex);
 
 		OutBoneTransforms[OutTransformStartIndex + TransformIndex] = FBoneTransform(BoneIndex, BoneCSTransform);
 
-		TargetPositions.Add(BoneWSPosition);
+		OutTargetPositions.Set(LinkOffset + TransformIndex, ToSimulationSpace<bWorldSpace>(BoneCSTransform.GetLocation()));
 	}
 
-	if (bAllowTipBoneRotation)
+	// keep the rest direction of each bone for re-orientation, so the pose isn't read again
+	for (int32 TransformIndex = 0; TransformIndex < NumTransforms; TransformIndex++)
 	{
-		const FTransform& ParentBoneCSTransform = MeshBases.GetComponentSpaceTransform(BoneIndices[BoneIndices.Num() - 2]);
-		FVector const ParentBoneCSPosition = ParentBoneCSTransform.GetLocation();
+		const int32 AimIndex = Chain.AimIndices[TransformIndex];
+
+		if (AimIndex == INDEX_NONE)
+		{
+			continue;
+		}
 
-		const FTransform& TipBoneCSTransform = MeshBases.GetComponentSpaceTransform(BoneIndices[BoneIndices.Num() - 1]);
-		FVector const TipBoneCSPosition = TipBoneCSTransform.GetLocation();
+		FVector const BoneCSPosition = OutBoneTransforms[OutTransformStartIndex + TransformIndex].Transform.GetLocation();
 
-		FTransform ParentBoneTransformInWS = (SkelComp != NULL) ? ParentBoneCSTransform * SkelComp->GetComponentToWorld() : ParentBoneCSTransform;
-		FTransform TipBoneTransformInWS = (SkelComp != NULL) ? TipBoneCSTransform * SkelComp->GetComponentToWorld() : TipBoneCSTransform;
+		if (AimIndex < NumTransforms)
+		{
+			RestDirections.Set(LinkOffset + TransformIndex, OutBoneTransforms[OutTransformStartIndex + AimIndex].Transform.GetLocation() - BoneCSPosition);
+		}
+		else
+		{
+			// connect a virtual link from the tip bone copying information from the parent bone
+			FVector const TipBoneDirection = BoneCSPosition - OutBoneTransforms[OutTransformStartIndex + Chain.ParentIndices[TransformIndex]].Transform.GetLocation();
 
-		FVector VirtualBonePositionInWS = TipBoneTransformInWS.GetLocation() + (TipBoneTransformInWS.GetLocation() - ParentBoneTransformInWS.GetLocation());
-		// connect a virtual link from the tip bone copying information from the parent bone
-		TargetPositions.Add(VirtualBonePositionInWS);
+			OutTargetPositions.Set(LinkOffset + AimIndex, ToSimulationSpace<bWorldSpace>(BoneCSPosition + TipBoneDirection));
+			RestDirections.Set(LinkOffset + TransformIndex, TipBoneDirection);
+		}
 	}
 }
 
-void FAnimNode_SoftBone::TimeIntegration(FChainInfo& Chain, float TimeDelta, TArray<FVector>& TargetPositions)
+bool FAnimNode_SoftBone::UpdateScratchBuffers()
 {
-	TArray<FSoftBoneLink>& PrevBoneLinks = Chain.PrevBoneLinks;
+	const int32 NumLinks = Simulation.State.Num();
 
-	float DampingCoefficient = 1.0f - DampingRatio;
+	// compact instances only keep final targets while the manager is about to simulate them, they are gathered again below anyway
+	if (Simulation.FinalTargetPositions.Num() != NumLinks)
+	{
+		Simulation.FinalTargetPositions.SetNumZeroed(NumLinks);
+	}
 
-	check(TargetPositions.Num() == PrevBoneLinks.Num());
+	// zeroed references keep chains awake for one frame, so they can be sized whenever sleeping is switched
+	const int32 NumReferenceTargets = bEnableSleep ? NumLinks : 0;
 
-	float PropagateMass = 1.0f;
+	if (Simulation.ReferenceTargetPositions.Num() != NumReferenceTargets)
+	{
+		Simulation.ReferenceTargetPositions.SetNumZeroed(NumReferenceTargets);
+	}
 
-	// pre-calculate inverse time step
-	float InvTimeDelta = 1.0f / TimeDelta;
+	const int32 NumCachedTransforms = (bEnableSleep && !bCompactState && ChainTemplate.IsValid()) ? ChainTemplate->NumTransforms : 0;
 
-	// root bone should be fixed
-	PrevBoneLinks[0].Position = TargetPositions[0];
+	if (CachedDeltaRotations.Num() != NumCachedTransforms)
+	{
+		CachedPositionsInCS.Init(FVector::ZeroVector, NumCachedTransforms);
+		CachedDeltaRotations.Init(FQuat::Identity, NumCachedTransforms);
 
-	// @TODO : External force like wind or explosion
-	// ExtForce -> f = ma, a = f/m
-	FVector ExtForce(0, 0, 0);
+		// sleeping chains had no bones cached, so they have to be awake for a frame to cache them
+		Simulation.State.WakeAllChains();
+	}
 
-	// apply a force of restitution to go back to the kinematic position except for root bone 
-	// because it should be fixed
-	for (int32 Index = 1; Index < TargetPositions.Num(); Index++)
+	if (Simulation.TargetPositions.Num() != NumLinks)
 	{
+		Simulation.TargetPositions.SetNumZeroed(NumLinks);
+		return true;
+	}
 
-		FVector GravityVector(0, 0, GravityScale * GravityZ);
-		FVector ExtAccel = GravityVector; 
+	return false;
+}
 
-		FVector RestoreImpulse = PrevBoneLinks[Index].RestoringWeight * (TargetPositions[Index] - PrevBoneLinks[Index].Position);
+void FAnimNode_SoftBone::AcquireEvaluationBuffers()
+{
+	FSoftBoneEvaluationScratch& Scratch = FSoftBoneEvaluationScratch::Get();
 
-		FVector MoveDelta;
+	if (Scratch.SetNumZeroed(ChainTemplate->NumLinks))
+	{
+		INC_DWORD_STAT(STAT_SoftBoneScratchReallocations);
+	}
 
-		{
-			// velocity integration
-			PrevBoneLinks[Index].Velocity += ((RestoreImpulse * InvTimeDelta) + (ExtAccel * TimeDelta));
-			MoveDelta = PrevBoneLinks[Index].Velocity * TimeDelta;
-			// damping
-			PrevBoneLinks[Index].Velocity *= DampingCoefficient;
-		}
+	Scratch.Exchange(*this);
+}
 
-		// position integration
-		PrevBoneLinks[Index].Position += MoveDelta;
-	}
+void FAnimNode_SoftBone::ReleaseEvaluationBuffers()
+{
+#if WITH_EDITOR
+	EditorRenderPositions = RenderPositions;
+#endif // #if WITH_EDITOR
 
+	FSoftBoneEvaluationScratch::Get().Exchange(*this);
+}
+
+void FAnimNode_SoftBone::ResetSimulation()
+{
+	Simulation.State.Reset();
+	Simulation.CompactState.Reset();
 
-	// if bBoneLengthConstraint is false, each bone stretches like a soft body
-	if (bBoneLengthConstraint)
+	// links have to be initialized again before the manager can simulate them
+	Simulation.bPendingSimulation = false;
+}
+
+bool FAnimNode_SoftBone::UpdateExternalForces()
+{
+	const FSoftBoneGameThreadData& GameThreadData = Simulation.GameThreadData;
+
+	if (bEnableExternalForces && GameThreadData.ForceField.IsValid())
 	{
-		// solve distance constraint
-		for (int32 LinkIndex = 1; LinkIndex < PrevBoneLinks.Num(); LinkIndex++)
-		{
-			FSoftBoneLink const & ParentLink = PrevBoneLinks[LinkIndex - 1];
-			FSoftBoneLink & CurrentLink = PrevBoneLinks[LinkIndex];
+		FSoftBoneForceScales Scales;
+		Scales.Wind = WindScale;
+		Scales.Radial = RadialForceScale;
+
+		// links are in component space when simulating in component space
+		const FTransform SimulationToWorld = bSimulationInWorldSpace ? FTransform::Identity : CachedComponentToWorld;
 
-			CurrentLink.Position = ParentLink.Position + (CurrentLink.Position - ParentLink.Position).GetUnsafeNormal() * CurrentLink.Length;
+		if (GameThreadData.ForceField->SampleChains(Simulation.State, Simulation.FinalTargetPositions, SimulationToWorld, GameThreadData.Wind, Scales, Simulation.ExternalAccelerations))
+		{
+			return true;
 		}
 	}
+
+	// nothing pushes the chains, so the solver doesn't need to read the accelerations
+	Simulation.ExternalAccelerations.SetNumZeroed(0);
+	return false;
 }
 
-void FAnimNode_SoftBone::PullBonesToFinalPosition(TArray<FSoftBoneLink>& PrevBoneLinks, FVector& DiffVector)
+FSoftBoneSleepParams FAnimNode_SoftBone::GetSleepParams() const
 {
-	int32 NumLinks = PrevBoneLinks.Num();
+	FSoftBoneSleepParams SleepParams;
+
+	SleepParams.VelocityThreshold = SleepVelocityThreshold;
+	SleepParams.TargetThreshold = SleepTargetThreshold;
+	SleepParams.Delay = SleepDelay;
+
+	return SleepParams;
+}
+
+FSoftBoneSolverParams FAnimNode_SoftBone::GetSolverParams() const
+{
+	FSoftBoneSolverParams Params;
+
+	// external forces like wind or explosions are sampled per chain into Simulation.ExternalAccelerations
+	Params.ExternalAcceleration = SimulationSpaceGravity * GravityScale;
+	Params.DampingRatio = DampingRatio;
+	Params.bBoneLengthConstraint = bBoneLengthConstraint;
+	Params.MaxSubSteps = MaxSubStepsPerFrame;
 
-	for (int32 Index = 0; Index < NumLinks; Index++)
+	switch (SolverType)
 	{
-		PrevBoneLinks[Index].RenderPosition = PrevBoneLinks[Index].Position + DiffVector;
+	case ESoftBoneSolverType::SST_XPBD:
+		Params.Integration = ESoftBoneIntegration::XPBD;
+		break;
+	case ESoftBoneSolverType::SST_Analytic:
+		Params.Integration = ESoftBoneIntegration::Analytic;
+		break;
+	default:
+		Params.Integration = ESoftBoneIntegration::Explicit;
+		break;
 	}
+
+	Params.NumIterations = NumIterations;
+	Params.ConvergenceTolerance = ConvergenceTolerance;
+
+	// without fixed steps, time an instance has accumulated while deferred is caught up in steps of one frame
+	Params.MaxStepTime = FMath::Max(DeltaTimeStep, FixedTimeStep);
+
+	return Params;
 }
 
-float FAnimNode_SoftBone::SimulateSoftBoneChain(FChainInfo& Chain, USkeletalMeshComponent* SkelComp, FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms, int32 OutTransformStartIndex, float InRemainingTime)
+template <bool bWorldSpace>
+void FAnimNode_SoftBone::UpdateBonePositions(const FChainInfo& Chain, TArray<FBoneTransform>& OutBoneTransforms)
 {
-	TArray<FCompactPoseBoneIndex>& BoneIndices = Chain.BoneIndices;
-	TArray<FSoftBoneLink>& PrevBoneLinks = Chain.PrevBoneLinks;
+	const int32 LinkOffset = Chain.LinkOffset;
+	const int32 OutTransformStartIndex = Chain.TransformOffset;
 
-	const FTransform& SpaceBase = MeshBases.GetComponentSpaceTransform(Chain.BoneIndices[0]);
-	// Location of the start bone in world space
-	FTransform BoneTransformInWorldSpace = (SkelComp != NULL) ? SpaceBase * SkelComp->GetComponentToWorld() : SpaceBase;
+	PositionsInCS[LinkOffset] = OutBoneTransforms[OutTransformStartIndex].Transform.GetTranslation();
 
-	if (PrevBoneLinks.Num() == 0)
+	int32 NumTransforms = Chain.BoneIndices.Num();
+
+	// First step: update bone transform positions from chain links.
+	for (int32 LinkIndex = 1; LinkIndex < NumTransforms; LinkIndex++)
 	{
-		InitializeChain(Chain, SkelComp, MeshBases, OutBoneTransforms, OutTransformStartIndex);
+		// convert from simulation space to component space
+		FVector BoneCSPosition = ToComponentSpace<bWorldSpace>(RenderPositions[LinkOffset + LinkIndex]);
+		PositionsInCS[LinkOffset + LinkIndex] = BoneCSPosition;
+		OutBoneTransforms[OutTransformStartIndex + LinkIndex].Transform.SetTranslation(BoneCSPosition);
 	}
 
-	// Calculate target positions
-	TArray<FVector> FinalTargetPositions;
-	ComputeTargetPositions(Chain, SkelComp, MeshBases, OutBoneTransforms, OutTransformStartIndex, FinalTargetPositions);
-
-	TArray<FVector> TargetPositions;
-	TargetPositions.AddUninitialized(FinalTargetPositions.Num());
+	// kept for the frames the chain will be sleeping
+	if (CachedPositionsInCS.Num() > 0)
+	{
+		FMemory::Memcpy(&CachedPositionsInCS[OutTransformStartIndex], &PositionsInCS[LinkOffset], sizeof(FVector) * NumTransforms);
+	}
 
-	// copy only the root bone's position
-	TargetPositions[0] = PrevBoneLinks[0].Position;
+	// virtual tip links don't need to update OutBoneTransforms
+	for (int32 LinkIndex = NumTransforms; LinkIndex < Chain.NumLinks; LinkIndex++)
+	{
+		// convert from simulation space to component space
+		PositionsInCS[LinkOffset + LinkIndex] = ToComponentSpace<bWorldSpace>(RenderPositions[LinkOffset + LinkIndex]);
+	}
 
-	if (bGuaranteeSameSimulationResult)
+	for (int32 LinkIndex = 0; LinkIndex < NumTransforms; LinkIndex++)
 	{
-		while (InRemainingTime >= FixedTimeStep)
+		const int32 AimIndex = Chain.AimIndices[LinkIndex];
+
+		if (AimIndex != INDEX_NONE)
 		{
-			float FixedTimeRatio = FixedTimeStep / InRemainingTime;
-			float RemainedRatio = 1.0f - FixedTimeRatio;
+			SimulatedDirections.Set(LinkOffset + LinkIndex, PositionsInCS[LinkOffset + AimIndex] - PositionsInCS[LinkOffset + LinkIndex]);
+		}
+	}
+}
+
+void FAnimNode_SoftBone::SimulateSoftBoneChains(FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms)
+{
+	// interpolated targets are lost if scratch buffers are reallocated, so they start over on the targets
+	bool bResetTargetPositions = false;
+
+	// Stiffness and weight settings may be driven by gameplay, the other parameters are read by GetSolverParams every frame
+	UpdateRestoringWeights(MeshBases);
+
+	// after the weight settings, which may switch to another template
+	const TArray<FChainInfo>& ChainInfos = GetChains();
+	const int32 NumChains = ChainInfos.Num();
+
+	if (Simulation.State.Num() == 0)
+	{
+		InitializeChains(MeshBases, OutBoneTransforms);
+	}
+
+	// scratch buffers are sized when the chains are initialized, so this should never happen in the steady state
+	if (UpdateScratchBuffers())
+	{
+		INC_DWORD_STAT(STAT_SoftBoneScratchReallocations);
+		bResetTargetPositions = true;
+	}
+
+	// Calculate target positions
+	{
+		SCOPE_CYCLE_COUNTER(STAT_SoftBoneComputeTargets);
 
-			// interpolate target positions
-			for (int32 Index = 0; Index < TargetPositions.Num(); Index++)
+		for (int32 ChainIndex = 0; ChainIndex < NumChains; ChainIndex++)
+		{
+			if (ChainInfos[ChainIndex].NumLinks > 0)
 			{
-				TargetPositions[Index] = FixedTimeRatio * FinalTargetPositions[Index] + RemainedRatio * PrevBoneLinks[Index].Position;
+				if (bSimulationInWorldSpace)
+				{
+					ComputeTargetPositions<true>(ChainInfos[ChainIndex], MeshBases, OutBoneTransforms, Simulation.FinalTargetPositions);
+				}
+				else
+				{
+					ComputeTargetPositions<false>(ChainInfos[ChainIndex], MeshBases, OutBoneTransforms, Simulation.FinalTargetPositions);
+				}
 			}
+		}
+	}
 
-			TimeIntegration(Chain, FixedTimeStep, TargetPositions);
+	if (bResetTargetPositions)
+	{
+		Simulation.TargetPositions.CopyFrom(Simulation.FinalTargetPositions);
+	}
 
+	// frozen chains just follow the animated pose which is already in OutBoneTransforms
+	if (LODTier == ESoftBoneLODTier::SLT_Frozen && SimulationWeight <= 0.f)
+	{
+		// keep links on the animated pose, so the simulation resumes from it without a pop
+		Simulation.State.Positions.CopyFrom(Simulation.FinalTargetPositions);
+		Simulation.State.PreviousPositions.CopyFrom(Simulation.FinalTargetPositions);
+		Simulation.TargetPositions.CopyFrom(Simulation.FinalTargetPositions);
+		Simulation.State.Velocities.SetZero();
+		Simulation.RemainingTime = 0.f;
+		Simulation.bPendingSimulation = false;
+		RemainingTime = 0.f;
+		return;
+	}
 
-			InRemainingTime -= FixedTimeStep;
-		}
+	// chains keep awake while blending with the animated pose or pushed by external forces
+	const bool bExternalForces = UpdateExternalForces();
+
+	if (bEnableSleep && SimulationWeight >= 1.f && !bExternalForces)
+	{
+		FSoftBoneSolver::UpdateSleepStates(Simulation.State, Simulation.FinalTargetPositions, Simulation.ReferenceTargetPositions, GetSleepParams(), DeltaTimeStep);
 	}
-	else
+	else if (Simulation.State.NumSleepingChains > 0)
 	{
-		TimeIntegration(Chain, FixedTimeStep, TargetPositions);
-		InRemainingTime = 0;
+		Simulation.State.WakeAllChains();
 	}
 
-	FVector RootBoneDiff = FinalTargetPositions[0] - TargetPositions[0];
+	INC_DWORD_STAT_BY(STAT_SoftBoneActiveChains, Simulation.State.Chains.Num() - Simulation.State.NumSleepingChains);
+	INC_DWORD_STAT_BY(STAT_SoftBoneSleepingChains, Simulation.State.NumSleepingChains);
 
-	// pull bones to final positions and calculate positions for rendering
-	PullBonesToFinalPosition(Chain.PrevBoneLinks, RootBoneDiff);
+	Simulation.Params = GetSolverParams();
 
-	FTransform InverseWorld = (SkelComp != NULL) ? SkelComp->GetComponentToWorld().Inverse() : FTransform::Identity;
+	if (Simulation.CaptureWriter.IsValid() || FSoftBoneCaptureWriter::IsCaptureEnabled())
+	{
+		Simulation.CaptureContext.ComponentToWorld = CachedComponentToWorld;
+		Simulation.CaptureContext.DeltaTime = DeltaTimeStep;
+		Simulation.CaptureContext.GravityZ = GravityZ;
+	}
 
-	PrevBoneLinks[0].PositionInCS = OutBoneTransforms[OutTransformStartIndex].Transform.GetTranslation();
+	UpdateColliders(MeshBases);
+	Simulation.FixedTimeStep = FixedTimeStep;
+	// single step tier and chains blending out to frozen don't need sub steps
+	Simulation.bFixedTimeStep = bGuaranteeSameSimulationResult && (LODTier < ESoftBoneLODTier::SLT_SingleStep);
 
-	int32 NumTransforms = BoneIndices.Num();
+	// time left over by the last simulation, which is where rendering sits in between the last two fixed steps
+	float LeftOverTime = Simulation.RemainingTime;
 
-	// First step: update bone transform positions from chain links.
-	for (int32 LinkIndex = 1; LinkIndex < NumTransforms; LinkIndex++)
+	// hand over the time accumulated since the last evaluation
+	Simulation.RemainingTime += RemainingTime;
+	RemainingTime = 0.f;
+
+	// the manager batches the simulation and shares the frame budget between instances of the world
+	const bool bUseFrameBudget = (FSoftBoneSimulationManager::GetFrameBudget() > 0.f);
+	FSoftBoneSimulationManager* Manager = (bBatchSimulation || bUseFrameBudget) ? Simulation.Manager : nullptr;
+
+	// deferred instances keep accumulating time until the budget allocation gets to them
+	const bool bDeferred = Manager && Simulation.bBudgetDeferred;
+	const bool bBatched = Manager && bBatchSimulation;
+	Simulation.bActive = (Manager != nullptr);
+
+	if (bDeferred)
 	{
-		// convert from world space to component space
-		FSoftBoneLink& ChainLink = PrevBoneLinks[LinkIndex];
-		FVector BoneCSPosition = InverseWorld.TransformPosition(ChainLink.RenderPosition);
-		ChainLink.PositionInCS = BoneCSPosition;
-		OutBoneTransforms[OutTransformStartIndex + LinkIndex].Transform.SetTranslation(BoneCSPosition);
+		Simulation.bPendingSimulation = false;
+	}
+	else if (bBatched)
+	{
+		// the manager simulates with these targets at the end of the frame
+		Simulation.bPendingSimulation = true;
+	}
+	else
+	{
+		// all chains share one sub step clock, so they consume exactly the same amount of time
+		Simulation.Simulate();
+		LeftOverTime = Simulation.RemainingTime;
 	}
 
-	// doesn't need to update OutBoneTransforms
-	if (bAllowTipBoneRotation)
 	{
-		int32 LastIndex = PrevBoneLinks.Num() - 1;
-		// convert from world space to component space
-		FSoftBoneLink& ChainLink = PrevBoneLinks[LastIndex];
-		FVector BoneCSPosition = InverseWorld.TransformPosition(ChainLink.RenderPosition);
-		PrevBoneLinks[LastIndex].PositionInCS = BoneCSPosition;
+		SCOPE_CYCLE_COUNTER(STAT_SoftBoneOutputConversion);
+
+		if (bDeferred && FSoftBoneSimulationManager::ShouldExtrapolateDeferred())
+		{
+			const float ExtrapolationTime = FMath::Min(Simulation.RemainingTime, MaxDeferredExtrapolationTime);
+			FSoftBoneSolver::ExtrapolateBonesToFinalPosition(Simulation.State, Simulation.FinalTargetPositions, ExtrapolationTime, RenderPositions.GetData());
+		}
+		else if (bInterpolateFixedSteps && Simulation.bFixedTimeStep)
+		{
+			const float Alpha = FMath::Clamp(LeftOverTime / FixedTimeStep, 0.f, 1.f);
+			FSoftBoneSolver::InterpolateBonesToFinalPosition(Simulation.State, Simulation.FinalTargetPositions, Alpha, RenderPositions.GetData());
+		}
+		else if (bDeferred || bBatched)
+		{
+			// hold the last simulated shape, or pick up the result of the last batch
+			// roots are pinned to the targets they were simulated with, so pulling by the root positions follows the current pose
+			FSoftBoneSolver::PullBonesToFinalPosition(Simulation.State, Simulation.FinalTargetPositions, Simulation.State.Positions, RenderPositions.GetData());
+		}
+		else
+		{
+			// pull bones to final positions and calculate positions for rendering
+			FSoftBoneSolver::PullBonesToFinalPosition(Simulation.State, Simulation.FinalTargetPositions, Simulation.TargetPositions, RenderPositions.GetData());
+		}
+
+		// blend with the animated pose while freezing or waking up
+		if (SimulationWeight < 1.f)
+		{
+			for (int32 LinkIndex = 0; LinkIndex < RenderPositions.Num(); LinkIndex++)
+			{
+				RenderPositions[LinkIndex] = FMath::Lerp(Simulation.FinalTargetPositions.Get(LinkIndex), RenderPositions[LinkIndex], SimulationWeight);
+			}
+		}
+
+		for (int32 ChainIndex = 0; ChainIndex < NumChains; ChainIndex++)
+		{
+			const FChainInfo& Chain = ChainInfos[ChainIndex];
+
+			if (Chain.NumLinks == 0)
+			{
+				continue;
+			}
+
+			// sleeping chains skip conversion and re-orientation, and keep the result of their last awake frame
+			// compact nodes don't cache bones, their sleeping chains are converted from the resting links
+			if (IsUsingCachedBones(Chain))
+			{
+				ApplyCachedBoneTransforms(Chain, OutBoneTransforms);
+				continue;
+			}
+
+			if (bSimulationInWorldSpace)
+			{
+				UpdateBonePositions<true>(Chain, OutBoneTransforms);
+			}
+			else
+			{
+				UpdateBonePositions<false>(Chain, OutBoneTransforms);
+			}
+		}
 	}
 
 	// re-orientation of bone local axes after translation calculation
-	ReOrientBoneRotations(Chain, MeshBases, OutBoneTransforms, OutTransformStartIndex);
+	// rotations of all links are computed in one batch, sleeping chains with cached bones just don't use theirs
+	if (Simulation.State.NumSleepingChains < Simulation.State.Chains.Num() || CachedDeltaRotations.Num() == 0)
+	{
+		SCOPE_CYCLE_COUNTER(STAT_SoftBoneReOrientation);
+
+		FSoftBoneSolver::ComputeShortestArcRotations(RestDirections, SimulatedDirections, DeltaRotations);
+
+		for (int32 ChainIndex = 0; ChainIndex < NumChains; ChainIndex++)
+		{
+			const FChainInfo& Chain = ChainInfos[ChainIndex];
+
+			if (Chain.NumLinks > 0 && !IsUsingCachedBones(Chain))
+			{
+				ReOrientBoneRotations(Chain, OutBoneTransforms);
+			}
+		}
+	}
 
 #if WITH_EDITOR
-	if (bShowDebugBones && SkelComp)
+	if (bShowDebugBones && Simulation.Manager)
 	{
-		DrawDebugData(SkelComp->GetWorld(), PrevBoneLinks, FinalTargetPositions);
+		DrawDebugData(CachedComponentToWorld);
 	}
 #endif // #if WITH_EDITOR
-
-	return InRemainingTime;
 }
 
 void FAnimNode_SoftBone::EvaluateBoneTransforms(USkeletalMeshComponent* SkelComp, FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms)
 {
-	// Create Chain infos and Gather all bone indices between root and tip for all chains.
-	if (ChainInfos.Num() == 0)
+	// Create Chain infos and Gather all bone indices between root and tip for all chains, or share them with other nodes.
+	if (!ChainTemplate.IsValid())
 	{
 		InitializeBoneIndices(MeshBases);
 	}
@@ -518,142 +1253,239 @@ void FAnimNode_SoftBone::EvaluateBoneTransforms(USkeletalMeshComponent* SkelComp
 		return;
 	}
 
-	int32 NumChains = ChainInfos.Num();
+	SCOPE_CYCLE_COUNTER(STAT_SoftBoneEvaluate);
+
+#if STATS
+	// shows the time of each component under Evaluate in the stats hierarchy and in external profilers
+	FScopeCycleCounterUObject ComponentScope(SkelComp);
+#endif // #if STATS
+
+	// compact links are expanded into buffers of this thread until the end of the evaluation
+	Simulation.bCompactState = bCompactState;
+	Simulation.ExpandState();
+	AcquireEvaluationBuffers();
+
+	UpdateSimulationSpace(CachedComponentToWorld);
 
 	// Gather all transforms
-	int32 NumAllTransforms = 0;
-	for (int32 ChainIndex = 0; ChainIndex < NumChains; ChainIndex++)
-	{
-		NumAllTransforms += ChainInfos[ChainIndex].BoneIndices.Num();
-	}
+	OutBoneTransforms.AddUninitialized(ChainTemplate->NumTransforms);
 
-	OutBoneTransforms.AddUninitialized(NumAllTransforms);
+	SimulateSoftBoneChains(MeshBases, OutBoneTransforms);
 
-	int32 OutTransformStartIndex = 0;
+	// batched instances are expanded again by the manager when it gets to them
+	ReleaseEvaluationBuffers();
+	Simulation.ReleaseState();
 
-	float RemainedSimTime = RemainingTime;
-	for (int32 ChainIndex = 0; ChainIndex < NumChains; ChainIndex++)
-	{
-		RemainedSimTime = SimulateSoftBoneChain(ChainInfos[ChainIndex], SkelComp, MeshBases, OutBoneTransforms, OutTransformStartIndex, RemainingTime);
-		OutTransformStartIndex += ChainInfos[ChainIndex].BoneIndices.Num();
-	}
+	INC_DWORD_STAT_BY(STAT_SoftBoneEvaluatedLinks, ChainTemplate->NumLinks);
+	INC_DWORD_STAT_BY(STAT_SoftBoneLinkMemory, GetAllocatedSize());
+}
 
-	RemainingTime = RemainedSimTime;
+SIZE_T FAnimNode_SoftBone::GetAllocatedSize() const
+{
+	return Simulation.GetAllocatedSize() + PreviousState.GetAllocatedSize() + PreviousTargetPositions.GetAllocatedSize()
+		+ RenderPositions.GetAllocatedSize() + PositionsInCS.GetAllocatedSize() + RestDirections.GetAllocatedSize() + SimulatedDirections.GetAllocatedSize()
+		+ DeltaRotations.GetAllocatedSize() + CachedPositionsInCS.GetAllocatedSize() + CachedDeltaRotations.GetAllocatedSize();
 }
 
-void FAnimNode_SoftBone::ReOrientBoneRotations(FChainInfo& Chain, FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms, int32 OutTransformStartIndex)
+SIZE_T FAnimNode_SoftBone::GetThreadScratchSize()
 {
-	TArray<FCompactPoseBoneIndex>& BoneIndices = Chain.BoneIndices;
-	TArray<FSoftBoneLink>& PrevBoneLinks = Chain.PrevBoneLinks;
+	return FSoftBoneEvaluationScratch::Get().GetAllocatedSize() + FSoftBoneSimulationInstance::GetThreadScratchSize();
+}
+
+void FAnimNode_SoftBone::UpdateSimulationSpace(const FTransform& ComponentToWorld)
+{
+	if (bSimulateInComponentSpace != bChainsInComponentSpace)
+	{
+		// simulation space has been switched, so move already simulated links to the new space
+		const FTransform SpaceChange = bSimulateInComponentSpace ? ComponentToWorld.Inverse() : PrevComponentToWorld;
 
-	int32 NumTransforms = BoneIndices.Num();
+		TransformSimulatedLinks(SpaceChange);
+		Simulation.State.WakeAllChains();
 
-	for (int32 LinkIndex = 0; LinkIndex < NumTransforms - 1; LinkIndex++)
+		bChainsInComponentSpace = bSimulateInComponentSpace;
+	}
+	else if (bSimulateInComponentSpace && !ComponentToWorld.Equals(PrevComponentToWorld, 0.f))
 	{
-		FSoftBoneLink const & CurrentLink = PrevBoneLinks[LinkIndex];
-		FSoftBoneLink const & ChildLink = PrevBoneLinks[LinkIndex + 1];
+		// Inertial frame correction
+		// Links should keep their world positions and velocities while the component is moving.
+		// Instead of converting every bone from and to world space, re-express links once in the new component space.
+		const FTransform FrameDelta = PrevComponentToWorld.GetRelativeTransform(ComponentToWorld);
 
-		FVector ChildPosInCS = MeshBases.GetComponentSpaceTransform(ChildLink.BoneIndex).GetLocation();
-		FVector CurrentPosInCS = MeshBases.GetComponentSpaceTransform(CurrentLink.BoneIndex).GetLocation();
+		TransformSimulatedLinks(FrameDelta);
 
-		// Calculate pre-translation vector between this bone and child
-		FVector const OldDir = (ChildPosInCS - CurrentPosInCS).GetUnsafeNormal();
+		// links are carried along with the component, so chains have to react to it even if the pose doesn't change
+		Simulation.State.WakeAllChains();
+	}
 
-		// Get vector from the post-translation bone to it's child
-		FVector const NewDir = (ChildLink.PositionInCS - CurrentLink.PositionInCS).GetUnsafeNormal();
+	PrevComponentToWorld = ComponentToWorld;
 
-		// Calculate axis of rotation from pre-translation vector to post-translation vector
-		FVector const RotationAxis = FVector::CrossProduct(OldDir, NewDir).GetSafeNormal();
-		float const RotationAngle = FMath::Acos(FVector::DotProduct(OldDir, NewDir));
-		FQuat const DeltaRotation = FQuat(RotationAxis, RotationAngle);
-		// We're going to multiply it, in order to not have to re-normalize the final quaternion, it has to be a unit quaternion.
-		checkSlow(DeltaRotation.IsNormalized());
+	bSimulationInWorldSpace = !bSimulateInComponentSpace;
+	ComponentToSimulation = bSimulationInWorldSpace ? ComponentToWorld : FTransform::Identity;
+	SimulationToComponent = ComponentToSimulation.Inverse();
 
-		// Calculate absolute rotation and set it
-		FTransform& CurrentBoneTransform = OutBoneTransforms[OutTransformStartIndex + LinkIndex].Transform;
-		CurrentBoneTransform.SetRotation(DeltaRotation * CurrentBoneTransform.GetRotation());
+	// gravity is defined in world space
+	const FVector WorldGravity(0.f, 0.f, GravityZ);
+	SimulationSpaceGravity = bSimulationInWorldSpace ? WorldGravity : ComponentToWorld.InverseTransformVector(WorldGravity);
+}
+
+void FAnimNode_SoftBone::TransformSimulatedLinks(const FTransform& Transform)
+{
+	FSoftBoneSolver::TransformLinks(Simulation.State, Transform);
+	FSoftBoneSolver::TransformPositions(Simulation.TargetPositions, Transform);
+
+	// links kept over a change of required bones are waiting in the same space
+	if (PreviousState.Num() > 0)
+	{
+		FSoftBoneSolver::TransformLinks(PreviousState, Transform);
+		FSoftBoneSolver::TransformPositions(PreviousTargetPositions, Transform);
 	}
+}
+
+void FAnimNode_SoftBone::UpdateColliders(FCSPose<FCompactPose>& MeshBases)
+{
+	const FBoneContainer& BoneContainer = MeshBases.GetPose().GetBoneContainer();
+
+	// keeps its allocation, colliders of bones which are not required at this LOD are left out
+	Simulation.Colliders.Reset();
 
-	// re-orient the last tip bone
-	if (bAllowTipBoneRotation)
+	for (int32 Index = 0; Index < Colliders.Num(); Index++)
 	{
-		check(PrevBoneLinks.Num() - 3 >= 0);
+		const FSoftBoneColliderBone& Collider = Colliders[Index];
 
-		FSoftBoneLink const & ParentLink = PrevBoneLinks[PrevBoneLinks.Num() - 3];
-		FSoftBoneLink const & CurrentLink = PrevBoneLinks[PrevBoneLinks.Num() - 2];
-		FSoftBoneLink const & VirtualLink = PrevBoneLinks[PrevBoneLinks.Num() - 1];
+		if (!Collider.Bone.IsValid(BoneContainer))
+		{
+			continue;
+		}
 
-		FVector ParentPosInCS = MeshBases.GetComponentSpaceTransform(ParentLink.BoneIndex).GetLocation();
-		FVector CurrentPosInCS = MeshBases.GetComponentSpaceTransform(CurrentLink.BoneIndex).GetLocation();
+		const FTransform BoneToSimulation = MeshBases.GetComponentSpaceTransform(Collider.Bone.GetCompactPoseIndex(BoneContainer)) * ComponentToSimulation;
 
-		FVector VirtualBonePosInCS = CurrentPosInCS + (CurrentPosInCS - ParentPosInCS);
+		Simulation.Colliders.Add(FSoftBoneCollider(
+			BoneToSimulation.TransformPosition(Collider.StartOffset),
+			BoneToSimulation.TransformPosition(Collider.EndOffset),
+			Collider.Radius * BoneToSimulation.GetMaximumAxisScale()));
+	}
+}
 
-		FQuat CurrentRot = MeshBases.GetComponentSpaceTransform(CurrentLink.BoneIndex).GetRotation();
+void FAnimNode_SoftBone::ReOrientBoneRotations(const FChainInfo& Chain, TArray<FBoneTransform>& OutBoneTransforms)
+{
+	const int32 OutTransformStartIndex = Chain.TransformOffset;
 
-		// Calculate pre-translation vector between this bone and child
-		FVector const OldDir = (VirtualBonePosInCS - CurrentPosInCS).GetUnsafeNormal();
+	const int32 NumTransforms = Chain.BoneIndices.Num();
 
-		// Get vector from the post-translation bone to it's child
-		FVector const NewDir = (VirtualLink.PositionInCS - CurrentLink.PositionInCS).GetUnsafeNormal();
+	for (int32 LinkIndex = 0; LinkIndex < NumTransforms; LinkIndex++)
+	{
+		// tip bones without a virtual link keep their animated rotation
+		if (Chain.AimIndices[LinkIndex] == INDEX_NONE)
+		{
+			continue;
+		}
+
+		FQuat const DeltaRotation = DeltaRotations.Get(Chain.LinkOffset + LinkIndex);
 
-		// Calculate axis of rotation from pre-translation vector to post-translation vector
-		FVector const RotationAxis = FVector::CrossProduct(OldDir, NewDir).GetSafeNormal();
-		float const RotationAngle = FMath::Acos(FVector::DotProduct(OldDir, NewDir));
-		FQuat const DeltaRotation = FQuat(RotationAxis, RotationAngle);
-		// We're going to multiply it, in order to not have to re-normalize the final quaternion, it has to be a unit quaternion.
-		checkSlow(DeltaRotation.IsNormalized());
+		if (CachedDeltaRotations.Num() > 0)
+		{
+			CachedDeltaRotations[OutTransformStartIndex + LinkIndex] = DeltaRotation;
+		}
 
 		// Calculate absolute rotation and set it
-		FTransform& CurrentBoneTransform = OutBoneTransforms[OutTransformStartIndex + NumTransforms - 1].Transform;
+		FTransform& CurrentBoneTransform = OutBoneTransforms[OutTransformStartIndex + LinkIndex].Transform;
 		CurrentBoneTransform.SetRotation(DeltaRotation * CurrentBoneTransform.GetRotation());
 	}
-
 }
 
-#if WITH_EDITOR
-void FAnimNode_SoftBone::DrawDebugData(UWorld* World, TArray<FSoftBoneLink>& PrevBoneLinks, TArray<FVector>& TargetPositions)
+void FAnimNode_SoftBone::ApplyCachedBoneTransforms(const FChainInfo& Chain, TArray<FBoneTransform>& OutBoneTransforms) const
 {
-	int32 NumChainLinks = TargetPositions.Num();
+	const int32 NumTransforms = Chain.BoneIndices.Num();
 
-	if (World)
+	for (int32 TransformIndex = 0; TransformIndex < NumTransforms; TransformIndex++)
 	{
-		// Draw Original bones
-		for (int32 LinkIndex = 1; LinkIndex < NumChainLinks; LinkIndex++)
+		FTransform& BoneTransform = OutBoneTransforms[Chain.TransformOffset + TransformIndex].Transform;
+
+		// root stays on the animated pose
+		if (TransformIndex > 0)
 		{
-			DrawDebugLine(World, TargetPositions[LinkIndex - 1], TargetPositions[LinkIndex], FColor::White, false, -1.f, SDPG_Foreground, 2.0f);
+			BoneTransform.SetTranslation(CachedPositionsInCS[Chain.TransformOffset + TransformIndex]);
 		}
 
-		FVector Extent(5.0f);
+		// rotations are applied on top of the current pose, so animated twist is kept
+		BoneTransform.SetRotation(CachedDeltaRotations[Chain.TransformOffset + TransformIndex] * BoneTransform.GetRotation());
+	}
+}
 
-		for (int32 LinkIndex = 0; LinkIndex < NumChainLinks; LinkIndex++)
-		{
-			DrawDebugBox(World, TargetPositions[LinkIndex], Extent, FColor::Yellow, false, -1.f, SDPG_Foreground);
-		}
+#if WITH_EDITOR
+void FAnimNode_SoftBone::DrawDebugData(const FTransform& ComponentToWorld)
+{
+	// links are in component space when simulating in component space
+	const FTransform SimulationToWorld = bSimulationInWorldSpace ? FTransform::Identity : ComponentToWorld;
 
-		FVector AddVec(30.0f, 0, 0);
-		// Draw soft bones
-		for (int32 LinkIndex = 1; LinkIndex < NumChainLinks; LinkIndex++)
+	const FSoftBoneChainState& State = Simulation.State;
+	int32 NumLinks = State.Num();
+
+	// shapes are drawn by the manager on the game thread, evaluation may run on a worker thread
+	TArray<FSoftBoneDebugShape> Shapes;
+	Shapes.Reserve(NumLinks * 4 + Simulation.Colliders.Num());
+
+	// Draw Original bones
+	for (int32 LinkIndex = 0; LinkIndex < NumLinks; LinkIndex++)
+	{
+		const int32 ParentIndex = State.ParentIndices[LinkIndex];
+
+		if (ParentIndex != INDEX_NONE)
 		{
-			DrawDebugLine(World, PrevBoneLinks[LinkIndex - 1].Position + AddVec, PrevBoneLinks[LinkIndex].Position + AddVec, FColor::Red, false, -1.f, SDPG_Foreground, 2.0f);
+			Shapes.Add(FSoftBoneDebugShape(FSoftBoneDebugShape::Line, SimulationToWorld.TransformPosition(Simulation.FinalTargetPositions.Get(ParentIndex)), SimulationToWorld.TransformPosition(Simulation.FinalTargetPositions.Get(LinkIndex)), 2.0f, FColor::White));
 		}
+	}
+
+	const float Extent = 5.0f;
 
-		for (int32 LinkIndex = 0; LinkIndex < NumChainLinks; LinkIndex++)
+	for (int32 LinkIndex = 0; LinkIndex < NumLinks; LinkIndex++)
+	{
+		const FVector Center = SimulationToWorld.TransformPosition(Simulation.FinalTargetPositions.Get(LinkIndex));
+		Shapes.Add(FSoftBoneDebugShape(FSoftBoneDebugShape::Box, Center, Center, Extent, FColor::Yellow));
+	}
+
+	FVector AddVec(30.0f, 0, 0);
+	// Draw soft bones
+	for (int32 LinkIndex = 0; LinkIndex < NumLinks; LinkIndex++)
+	{
+		const int32 ParentIndex = State.ParentIndices[LinkIndex];
+
+		if (ParentIndex != INDEX_NONE)
 		{
-			DrawDebugBox(World, PrevBoneLinks[LinkIndex].Position + AddVec, Extent, FColor::Blue, false, -1.f, SDPG_Foreground);
+			Shapes.Add(FSoftBoneDebugShape(FSoftBoneDebugShape::Line, SimulationToWorld.TransformPosition(State.Positions.Get(ParentIndex)) + AddVec, SimulationToWorld.TransformPosition(State.Positions.Get(LinkIndex)) + AddVec, 2.0f, FColor::Red));
 		}
 	}
+
+	for (int32 LinkIndex = 0; LinkIndex < NumLinks; LinkIndex++)
+	{
+		const FVector Center = SimulationToWorld.TransformPosition(State.Positions.Get(LinkIndex)) + AddVec;
+		Shapes.Add(FSoftBoneDebugShape(FSoftBoneDebugShape::Box, Center, Center, Extent, FColor::Blue));
+	}
+
+	// Draw colliders on the original bones
+	for (int32 Index = 0; Index < Simulation.Colliders.Num(); Index++)
+	{
+		const FSoftBoneCollider& Collider = Simulation.Colliders[Index];
+		const FVector Start = SimulationToWorld.TransformPosition(Collider.Start);
+		const FVector End = SimulationToWorld.TransformPosition(Collider.End);
+		const FSoftBoneDebugShape::EType Type = (End - Start).IsNearlyZero() ? FSoftBoneDebugShape::Sphere : FSoftBoneDebugShape::Capsule;
+
+		Shapes.Add(FSoftBoneDebugShape(Type, Start, End, Collider.Radius, FColor::Green));
+	}
+
+	Simulation.Manager->QueueDebugShapes(Shapes);
 }
 #endif // #if WITH_EDITOR
 
 bool FAnimNode_SoftBone::IsValidToEvaluate(const USkeleton* Skeleton, const FBoneContainer& RequiredBones)
 {
-	// Allow evaluation if TipBone and RootBone are initialized
+	// Allow evaluation if TipBone and RootBone are initialized, or only RootBone for a whole subtree
 	// Basically we should check whether TipBone is child of RootBone or not but checking this in initialization code, InitializeBoneIndices(),
 	// to reduce cost because this function will be called every time to check validation
 
 	return
 		(
-		TipBone.IsValid(RequiredBones)
+		(TipBone.BoneName == NAME_None || TipBone.IsValid(RequiredBones))
 		&& RootBone.IsValid(RequiredBones)
 		);
 }
@@ -671,5 +1503,24 @@ void FAnimNode_SoftBone::InitializeBoneReferences(const FBoneContainer& Required
 		AdditionalChains[Index].RootBone.Initialize(RequiredBones);
 	}
 
-	ChainInfos.Empty();
+	for (int32 Index = 0; Index < Colliders.Num(); Index++)
+	{
+		Colliders[Index].Bone.Initialize(RequiredBones);
+	}
+
+	// simulation colliders are rebuilt every evaluation without allocating
+	Simulation.Colliders.Empty(Colliders.Num());
+
+	// bones of the same mesh keep simulating after a LOD switch, so only the bone indices are gathered again
+	if (ChainsAsset.Get() == RequiredBones.GetAsset())
+	{
+		KeepPreviousChains();
+	}
+	else
+	{
+		ResetPreviousChains();
+	}
+
+	ChainTemplate.Reset();
+	ResetSimulation();
 }
@@ -0,0 +1,433 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "SoftBonePluginPrivatePCH.h"
+#include "../Public/SoftBoneCapture.h"
+#include "../Public/SoftBoneSimulationManager.h"
+
+static TAutoConsoleVariable<int32> CVarSoftBoneCapture(
+	TEXT("SoftBone.Capture"),
+	0,
+	TEXT("1: every SoftBone instance streams its solver inputs to Saved/SoftBone/Captures until this is set back to 0.\n")
+	TEXT("Captures are played back with SoftBone.Replay."));
+
+namespace SoftBoneCapture
+{
+	/** 'SBCP' */
+	static const uint32 Magic = 0x53424350;
+
+	/** Increase when the layout of records changes */
+	static const int32 Version = 2;
+
+	namespace ERecord
+	{
+		enum Type
+		{
+			End,
+			Keyframe,
+			Frame,
+		};
+	}
+
+	/** Serializes all elements of Stream including padding. Loading resizes the stream. */
+	static void SerializeStream(FArchive& Ar, FSoftBoneVectorStream& Stream)
+	{
+		int32 Num = Stream.Num();
+		Ar << Num;
+
+		if (Ar.IsLoading())
+		{
+			Stream.SetNumZeroed(Num);
+		}
+
+		Ar.Serialize(Stream.X.GetData(), sizeof(float) * Stream.NumPadded());
+		Ar.Serialize(Stream.Y.GetData(), sizeof(float) * Stream.NumPadded());
+		Ar.Serialize(Stream.Z.GetData(), sizeof(float) * Stream.NumPadded());
+	}
+
+	/** Links, chains and interpolated targets. Analytic coefficients and XPBD multipliers are computed again by the solver. */
+	static void SerializeState(FArchive& Ar, FSoftBoneChainState& State, FSoftBoneVectorStream& TargetPositions)
+	{
+		int32 NumLinks = State.Num();
+		int32 NumChains = State.Chains.Num();
+		Ar << NumLinks << NumChains;
+
+		if (Ar.IsLoading())
+		{
+			State.Reset(NumLinks);
+		}
+
+		for (int32 ChainIndex = 0; ChainIndex < NumChains; ChainIndex++)
+		{
+			int32 ChainLinks = Ar.IsLoading() ? 0 : State.Chains[ChainIndex].NumLinks;
+			Ar << ChainLinks;
+
+			if (Ar.IsLoading())
+			{
+				State.AddChain(ChainLinks);
+			}
+
+			FSoftBoneChainRange& Chain = State.Chains[ChainIndex];
+			uint8 bSleeping = Chain.bSleeping ? 1 : 0;
+			Ar << bSleeping << Chain.SleepTime;
+			Chain.bSleeping = (bSleeping != 0);
+		}
+
+		Ar << State.NumSleepingChains;
+
+		SerializeStream(Ar, State.Positions);
+		SerializeStream(Ar, State.PreviousPositions);
+		SerializeStream(Ar, State.Velocities);
+
+		Ar.Serialize(State.RestoringWeights.GetData(), sizeof(float) * State.RestoringWeights.Num());
+		Ar.Serialize(State.Lengths.GetData(), sizeof(float) * NumLinks);
+		Ar.Serialize(State.ParentIndices.GetData(), sizeof(int32) * NumLinks);
+
+		// restoring weights have been overwritten
+		State.AnalyticCoefficients.Invalidate();
+
+		SerializeStream(Ar, TargetPositions);
+	}
+
+	/** Everything FSoftBoneSolver::Simulate reads in a frame besides the links */
+	static void SerializeFrameInputs(FArchive& Ar, FSoftBoneSimulationInstance& Instance, float& TimeToSimulate)
+	{
+		FSoftBoneSolverParams& Params = Instance.Params;
+
+		Ar << Instance.CaptureContext.ComponentToWorld << Instance.CaptureContext.DeltaTime << Instance.CaptureContext.GravityZ;
+		Ar << TimeToSimulate << Instance.FixedTimeStep;
+
+		uint8 bFixedTimeStep = Instance.bFixedTimeStep ? 1 : 0;
+		uint8 bBoneLengthConstraint = Params.bBoneLengthConstraint ? 1 : 0;
+		int32 Integration = (int32)Params.Integration;
+
+		Ar << bFixedTimeStep << Params.ExternalAcceleration << Params.DampingRatio << bBoneLengthConstraint << Params.MaxSubSteps << Params.MaxStepTime;
+		Ar << Integration << Params.NumIterations << Params.ConvergenceTolerance << Params.ReferenceTimeStep;
+
+		Instance.bFixedTimeStep = (bFixedTimeStep != 0);
+		Params.bBoneLengthConstraint = (bBoneLengthConstraint != 0);
+		Params.Integration = (ESoftBoneIntegration::Type)Integration;
+
+		int32 NumColliders = Instance.Colliders.Num();
+		Ar << NumColliders;
+
+		if (Ar.IsLoading())
+		{
+			Instance.Colliders.Reset(NumColliders);
+			Instance.Colliders.AddDefaulted(NumColliders);
+		}
+
+		for (int32 Index = 0; Index < NumColliders; Index++)
+		{
+			FSoftBoneCollider& Collider = Instance.Colliders[Index];
+			Ar << Collider.Start << Collider.End << Collider.Radius;
+		}
+
+		SerializeStream(Ar, Instance.FinalTargetPositions);
+
+		// empty without external forces
+		SerializeStream(Ar, Instance.ExternalAccelerations);
+	}
+
+	static uint32 CrcStream(const FSoftBoneVectorStream& Stream, uint32 Crc)
+	{
+		Crc = FCrc::MemCrc32(Stream.X.GetData(), sizeof(float) * Stream.NumPadded(), Crc);
+		Crc = FCrc::MemCrc32(Stream.Y.GetData(), sizeof(float) * Stream.NumPadded(), Crc);
+		return FCrc::MemCrc32(Stream.Z.GetData(), sizeof(float) * Stream.NumPadded(), Crc);
+	}
+
+	/** Checksum of everything SerializeState stores */
+	static uint32 CrcState(const FSoftBoneChainState& State, const FSoftBoneVectorStream& TargetPositions)
+	{
+		uint32 Crc = 0;
+
+		for (int32 ChainIndex = 0; ChainIndex < State.Chains.Num(); ChainIndex++)
+		{
+			const FSoftBoneChainRange& Chain = State.Chains[ChainIndex];
+			const int32 Fields[3] = { Chain.LinkOffset, Chain.NumLinks, Chain.bSleeping ? 1 : 0 };
+
+			Crc = FCrc::MemCrc32(Fields, sizeof(Fields), Crc);
+			Crc = FCrc::MemCrc32(&Chain.SleepTime, sizeof(float), Crc);
+		}
+
+		Crc = CrcStream(State.Positions, Crc);
+		Crc = CrcStream(State.PreviousPositions, Crc);
+		Crc = CrcStream(State.Velocities, Crc);
+		Crc = FCrc::MemCrc32(State.RestoringWeights.GetData(), sizeof(float) * State.RestoringWeights.Num(), Crc);
+		Crc = FCrc::MemCrc32(State.Lengths.GetData(), sizeof(float) * State.Lengths.Num(), Crc);
+		Crc = FCrc::MemCrc32(State.ParentIndices.GetData(), sizeof(int32) * State.ParentIndices.Num(), Crc);
+
+		return CrcStream(TargetPositions, Crc);
+	}
+}
+
+/////////////////////////////////////////////////////
+// FSoftBoneCaptureWriter
+
+FSoftBoneCaptureWriter::FSoftBoneCaptureWriter(const FName& OwnerName)
+	: Archive(nullptr)
+	, LastStateCrc(0)
+	, bHasKeyframe(false)
+	, TimeToSimulate(0.f)
+{
+	static FThreadSafeCounter NumCaptures;
+
+	const FString Name = OwnerName.IsNone() ? FString(TEXT("SoftBone")) : OwnerName.ToString();
+	const FString FileName = FString::Printf(TEXT("%s_%s_%d.sbcap"), *Name, *FDateTime::Now().ToString(), NumCaptures.Increment());
+	const FString Path = FPaths::GameSavedDir() / TEXT("SoftBone") / TEXT("Captures") / FileName;
+
+	Archive = IFileManager::Get().CreateFileWriter(*Path);
+
+	if (Archive == nullptr)
+	{
+		UE_LOG(LogSoftBone, Warning, TEXT("Failed to open SoftBone capture %s"), *Path);
+		return;
+	}
+
+	uint32 Magic = SoftBoneCapture::Magic;
+	int32 Version = SoftBoneCapture::Version;
+	FString OwnerString = OwnerName.ToString();
+	*Archive << Magic << Version << OwnerString;
+}
+
+FSoftBoneCaptureWriter::~FSoftBoneCaptureWriter()
+{
+	if (Archive)
+	{
+		uint8 Record = SoftBoneCapture::ERecord::End;
+		*Archive << Record;
+
+		Archive->Close();
+		delete Archive;
+	}
+}
+
+void FSoftBoneCaptureWriter::BeginFrame(FSoftBoneSimulationInstance& Instance)
+{
+	TimeToSimulate = Instance.RemainingTime;
+
+	if (Archive == nullptr)
+	{
+		return;
+	}
+
+	// the node moves, resets and wakes links outside of the solver, so they are stored whenever they aren't the result of the last frame anymore
+	if (!bHasKeyframe || SoftBoneCapture::CrcState(Instance.State, Instance.TargetPositions) != LastStateCrc)
+	{
+		uint8 Record = SoftBoneCapture::ERecord::Keyframe;
+		*Archive << Record;
+
+		SoftBoneCapture::SerializeState(*Archive, Instance.State, Instance.TargetPositions);
+		bHasKeyframe = true;
+	}
+}
+
+void FSoftBoneCaptureWriter::EndFrame(FSoftBoneSimulationInstance& Instance)
+{
+	if (Archive == nullptr)
+	{
+		return;
+	}
+
+	uint8 Record = SoftBoneCapture::ERecord::Frame;
+	*Archive << Record;
+
+	SoftBoneCapture::SerializeFrameInputs(*Archive, Instance, TimeToSimulate);
+
+	// the replay compares its results with these, so differences between solver versions show up in the frame they start
+	LastStateCrc = SoftBoneCapture::CrcState(Instance.State, Instance.TargetPositions);
+	*Archive << Instance.RemainingTime << LastStateCrc;
+}
+
+bool FSoftBoneCaptureWriter::IsCaptureEnabled()
+{
+	return CVarSoftBoneCapture.GetValueOnAnyThread() != 0;
+}
+
+#if !UE_BUILD_SHIPPING
+
+/////////////////////////////////////////////////////
+// SoftBone capture replay
+//
+// Plays a capture back through the solver and prints the cost of each frame, the worst frames and the frames
+// whose results differ from the ones recorded in the game, i.e. where the solver doesn't behave like the captured build anymore.
+// (e.g. UE4Editor-Cmd <Project> -nullrhi -ExecCmds="SoftBone.Replay <Capture>.sbcap 10, Quit")
+//
+// usage : SoftBone.Replay [CaptureFile] [NumRepeats]
+
+namespace SoftBoneCapture
+{
+	/** Frame of a replay */
+	struct FReplayFrame
+	{
+		/** Best time of all repeats */
+		double Seconds;
+
+		float DeltaTime;
+		int32 NumLinks;
+		bool bKeyframe;
+	};
+
+	/** Plays Path back once. Frame times are kept at their minimum over repeats. Returns false if the file can't be read. */
+	static bool ReplayCapture(const FString& Path, bool bFirstRepeat, TArray<FReplayFrame>& Frames, int32& OutNumMismatches, int32& OutFirstMismatch)
+	{
+		FArchive* Reader = IFileManager::Get().CreateFileReader(*Path);
+
+		if (Reader == nullptr)
+		{
+			UE_LOG(LogSoftBone, Error, TEXT("Failed to open SoftBone capture %s"), *Path);
+			return false;
+		}
+
+		uint32 FileMagic = 0;
+		int32 FileVersion = 0;
+		FString Name;
+		*Reader << FileMagic << FileVersion;
+
+		if (FileMagic != Magic || FileVersion != Version)
+		{
+			UE_LOG(LogSoftBone, Error, TEXT("%s is not a SoftBone capture of version %d"), *Path, Version);
+			delete Reader;
+			return false;
+		}
+
+		*Reader << Name;
+
+		FSoftBoneSimulationInstance Instance;
+		bool bKeyframe = false;
+		int32 FrameIndex = 0;
+
+		while (!Reader->AtEnd() && !Reader->IsError())
+		{
+			uint8 Record = ERecord::End;
+			*Reader << Record;
+
+			if (Record == ERecord::Keyframe)
+			{
+				SerializeState(*Reader, Instance.State, Instance.TargetPositions);
+				bKeyframe = true;
+				continue;
+			}
+
+			if (Record != ERecord::Frame)
+			{
+				break;
+			}
+
+			float TimeToSimulate = 0.f;
+			SerializeFrameInputs(*Reader, Instance, TimeToSimulate);
+
+			float RecordedRemainingTime = 0.f;
+			uint32 RecordedCrc = 0;
+			*Reader << RecordedRemainingTime << RecordedCrc;
+
+			if (Reader->IsError())
+			{
+				break;
+			}
+
+			FSoftBoneSolverParams SolverParams = Instance.Params;
+			SolverParams.Colliders = Instance.Colliders.GetData();
+			SolverParams.NumColliders = Instance.Colliders.Num();
+			SolverParams.LinkAccelerations = (Instance.ExternalAccelerations.Num() > 0) ? &Instance.ExternalAccelerations : nullptr;
+
+			const double StartTime = FPlatformTime::Seconds();
+
+			Instance.RemainingTime = FSoftBoneSolver::Simulate(Instance.State, Instance.FinalTargetPositions, Instance.TargetPositions, TimeToSimulate, Instance.FixedTimeStep, Instance.bFixedTimeStep, SolverParams);
+
+			const double Seconds = FPlatformTime::Seconds() - StartTime;
+
+			if (bFirstRepeat)
+			{
+				FReplayFrame& Frame = Frames[Frames.AddUninitialized()];
+				Frame.Seconds = Seconds;
+				Frame.DeltaTime = Instance.CaptureContext.DeltaTime;
+				Frame.NumLinks = Instance.State.Num();
+				Frame.bKeyframe = bKeyframe;
+
+				if (Instance.RemainingTime != RecordedRemainingTime || CrcState(Instance.State, Instance.TargetPositions) != RecordedCrc)
+				{
+					OutFirstMismatch = (OutNumMismatches == 0) ? FrameIndex : OutFirstMismatch;
+					OutNumMismatches++;
+				}
+			}
+			else if (Frames.IsValidIndex(FrameIndex))
+			{
+				Frames[FrameIndex].Seconds = FMath::Min(Frames[FrameIndex].Seconds, Seconds);
+			}
+
+			bKeyframe = false;
+			FrameIndex++;
+		}
+
+		delete Reader;
+		return true;
+	}
+
+	static void RunReplay(const TArray<FString>& Args)
+	{
+		if (Args.Num() == 0)
+		{
+			UE_LOG(LogSoftBone, Display, TEXT("usage : SoftBone.Replay [CaptureFile] [NumRepeats]"));
+			return;
+		}
+
+		const FString& Path = Args[0];
+		const int32 NumRepeats = (Args.Num() > 1) ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 1;
+
+		TArray<FReplayFrame> Frames;
+		int32 NumMismatches = 0;
+		int32 FirstMismatch = INDEX_NONE;
+
+		for (int32 Repeat = 0; Repeat < NumRepeats; Repeat++)
+		{
+			if (!ReplayCapture(Path, Repeat == 0, Frames, NumMismatches, FirstMismatch))
+			{
+				return;
+			}
+		}
+
+		double TotalSeconds = 0.0;
+		int32 NumKeyframes = 0;
+		int32 MaxFrame = INDEX_NONE;
+
+		for (int32 FrameIndex = 0; FrameIndex < Frames.Num(); FrameIndex++)
+		{
+			TotalSeconds += Frames[FrameIndex].Seconds;
+			NumKeyframes += Frames[FrameIndex].bKeyframe ? 1 : 0;
+
+			if (MaxFrame == INDEX_NONE || Frames[FrameIndex].Seconds > Frames[MaxFrame].Seconds)
+			{
+				MaxFrame = FrameIndex;
+			}
+		}
+
+		UE_LOG(LogSoftBone, Display, TEXT("SoftBone replay : %s, %d frames, %d keyframes, best of %d repeats"), *Path, Frames.Num(), NumKeyframes, NumRepeats);
+
+		if (Frames.Num() == 0)
+		{
+			return;
+		}
+
+		UE_LOG(LogSoftBone, Display, TEXT("    %.3f ms total, %.2f us per frame"), TotalSeconds * 1000.0, TotalSeconds * 1.0e6 / Frames.Num());
+
+		const FReplayFrame& Max = Frames[MaxFrame];
+		UE_LOG(LogSoftBone, Display, TEXT("    Worst frame %d : %.2f us, %d links, delta time %.2f ms%s"), MaxFrame, Max.Seconds * 1.0e6, Max.NumLinks, Max.DeltaTime * 1000.f, Max.bKeyframe ? TEXT(", after a keyframe") : TEXT(""));
+
+		if (NumMismatches > 0)
+		{
+			UE_LOG(LogSoftBone, Warning, TEXT("    %d frames differ from the capture, starting at frame %d"), NumMismatches, FirstMismatch);
+		}
+		else
+		{
+			UE_LOG(LogSoftBone, Display, TEXT("    All frames match the capture"));
+		}
+	}
+}
+
+static FAutoConsoleCommand SoftBoneReplayCommand(
+	TEXT("SoftBone.Replay"),
+	TEXT("Plays a SoftBone capture back through the solver and prints the cost of its frames. Args : [CaptureFile] [NumRepeats]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&SoftBoneCapture::RunReplay)
+	);
+
+#endif // #if !UE_BUILD_SHIPPING
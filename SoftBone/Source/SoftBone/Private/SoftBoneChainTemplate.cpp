@@ -0,0 +1,141 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "SoftBonePluginPrivatePCH.h"
+#include "../Public/SoftBoneChainTemplate.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Chain Templates"), STAT_SoftBoneChainTemplates, STATGROUP_SoftBone);
+DECLARE_MEMORY_STAT(TEXT("Chain Template Memory"), STAT_SoftBoneChainTemplateMemory, STATGROUP_SoftBone);
+
+typedef TWeakPtr<const FSoftBoneChainTemplate, ESPMode::ThreadSafe> FSoftBoneChainTemplateWeakPtr;
+
+/** Guards Templates, nodes initialize their chains while animation is evaluated on worker threads */
+static FCriticalSection TemplatesLock;
+
+/** All registered templates. Only nodes own them, so entries expire with the last node using them. */
+static TArray<FSoftBoneChainTemplateWeakPtr> Templates;
+
+/////////////////////////////////////////////////////
+// FSoftBoneChainTemplateKey
+
+void FSoftBoneChainTemplateKey::UpdateHash()
+{
+	uint32 Crc = FCrc::MemCrc32(RequiredBones.GetData(), sizeof(FBoneIndexType) * RequiredBones.Num());
+
+	for (int32 Index = 0; Index < RootBoneNames.Num(); Index++)
+	{
+		Crc = HashCombine(Crc, GetTypeHash(RootBoneNames[Index]));
+		Crc = HashCombine(Crc, GetTypeHash(TipBoneNames[Index]));
+	}
+
+	for (int32 Index = 0; Index < WeightKeys.Num(); Index++)
+	{
+		Crc = HashCombine(Crc, GetTypeHash(WeightKeys[Index].Time));
+		Crc = HashCombine(Crc, GetTypeHash(WeightKeys[Index].Value));
+	}
+
+	Hash = HashCombine(Crc, (bAllowTipBoneRotation ? 1 : 0) | (bUseWeightCurve ? 2 : 0));
+}
+
+bool FSoftBoneChainTemplateKey::operator==(const FSoftBoneChainTemplateKey& Other) const
+{
+	return Hash == Other.Hash
+		&& Asset == Other.Asset
+		&& bAllowTipBoneRotation == Other.bAllowTipBoneRotation
+		&& bUseWeightCurve == Other.bUseWeightCurve
+		&& RootBoneNames == Other.RootBoneNames
+		&& TipBoneNames == Other.TipBoneNames
+		&& WeightKeys == Other.WeightKeys
+		&& RequiredBones == Other.RequiredBones;
+}
+
+/////////////////////////////////////////////////////
+// FSoftBoneChainTemplate
+
+FSoftBoneChainTemplate::FSoftBoneChainTemplate(const FSoftBoneChainTemplateKey& InKey)
+	: Key(InKey)
+	, NumLinks(0)
+	, NumTransforms(0)
+	, RegisteredSize(0)
+{
+}
+
+FSoftBoneChainTemplate::~FSoftBoneChainTemplate()
+{
+	if (RegisteredSize > 0)
+	{
+		DEC_DWORD_STAT(STAT_SoftBoneChainTemplates);
+		DEC_MEMORY_STAT_BY(STAT_SoftBoneChainTemplateMemory, RegisteredSize);
+	}
+}
+
+SIZE_T FSoftBoneChainTemplate::GetAllocatedSize() const
+{
+	SIZE_T Size = Chains.GetAllocatedSize() + Key.RequiredBones.GetAllocatedSize() + Key.RootBoneNames.GetAllocatedSize()
+		+ Key.TipBoneNames.GetAllocatedSize() + Key.WeightKeys.GetAllocatedSize();
+
+	for (int32 ChainIndex = 0; ChainIndex < Chains.Num(); ChainIndex++)
+	{
+		const FChainInfo& Chain = Chains[ChainIndex];
+		Size += Chain.BoneIndices.GetAllocatedSize() + Chain.ParentIndices.GetAllocatedSize() + Chain.AimIndices.GetAllocatedSize()
+			+ Chain.LinkKeys.GetAllocatedSize() + Chain.WeightTable.GetAllocatedSize();
+	}
+
+	return Size;
+}
+
+TSharedPtr<const FSoftBoneChainTemplate, ESPMode::ThreadSafe> FSoftBoneChainTemplate::Find(const FSoftBoneChainTemplateKey& Key)
+{
+	FScopeLock Lock(&TemplatesLock);
+
+	for (int32 Index = 0; Index < Templates.Num(); Index++)
+	{
+		TSharedPtr<const FSoftBoneChainTemplate, ESPMode::ThreadSafe> Template = Templates[Index].Pin();
+
+		if (Template.IsValid() && Template->Key == Key)
+		{
+			return Template;
+		}
+	}
+
+	return nullptr;
+}
+
+TSharedRef<const FSoftBoneChainTemplate, ESPMode::ThreadSafe> FSoftBoneChainTemplate::Register(const TSharedRef<FSoftBoneChainTemplate, ESPMode::ThreadSafe>& Template)
+{
+	FScopeLock Lock(&TemplatesLock);
+
+	for (int32 Index = Templates.Num() - 1; Index >= 0; Index--)
+	{
+		TSharedPtr<const FSoftBoneChainTemplate, ESPMode::ThreadSafe> Registered = Templates[Index].Pin();
+
+		if (!Registered.IsValid())
+		{
+			Templates.RemoveAtSwap(Index);
+		}
+		else if (Registered->Key == Template->Key)
+		{
+			return Registered.ToSharedRef();
+		}
+	}
+
+	Template->RegisteredSize = FMath::Max<SIZE_T>(Template->GetAllocatedSize(), 1);
+	INC_DWORD_STAT(STAT_SoftBoneChainTemplates);
+	INC_MEMORY_STAT_BY(STAT_SoftBoneChainTemplateMemory, Template->RegisteredSize);
+
+	Templates.Add(Template);
+	return Template;
+}
+
+int32 FSoftBoneChainTemplate::GetNumTemplates()
+{
+	FScopeLock Lock(&TemplatesLock);
+
+	int32 NumTemplates = 0;
+
+	for (int32 Index = 0; Index < Templates.Num(); Index++)
+	{
+		NumTemplates += Templates[Index].IsValid() ? 1 : 0;
+	}
+
+	return NumTemplates;
+}
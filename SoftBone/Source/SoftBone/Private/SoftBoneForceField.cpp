@@ -0,0 +1,150 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "SoftBonePluginPrivatePCH.h"
+#include "../Public/SoftBoneForceField.h"
+
+DECLARE_CYCLE_STAT(TEXT("Sample Forces"), STAT_SoftBoneSampleForces, STATGROUP_SoftBone);
+
+/** Seconds from one gust to the next at any point */
+static const float GustPeriod = 4.f;
+
+/** Distance in cm from one gust front to the next along the wind */
+static const float GustWaveLength = 1500.f;
+
+/////////////////////////////////////////////////////
+// FSoftBoneForceField
+
+void FSoftBoneForceField::Advance(float DeltaTime)
+{
+	// gusts repeat, so the phase stays precise however long the world runs
+	Time = FMath::Fmod(Time + DeltaTime, GustPeriod);
+
+	for (int32 Index = RadialForces.Num() - 1; Index >= 0; Index--)
+	{
+		FSoftBoneRadialForce& Force = RadialForces[Index];
+		Force.Age += DeltaTime;
+
+		if (Force.Age > Force.Duration)
+		{
+			RadialForces.RemoveAtSwap(Index);
+		}
+	}
+}
+
+FSoftBoneWind FSoftBoneForceField::ComputeWind(const FVector& Position) const
+{
+	FSoftBoneWind Wind;
+	Wind.GustTime = Time;
+	float TotalWeight = 0.f;
+
+	for (int32 Index = 0; Index < WindSources.Num(); Index++)
+	{
+		const FSoftBoneWindSource& Source = WindSources[Index];
+		FVector Direction = Source.Direction;
+		float Falloff = 1.f;
+		float Weight = Source.Strength;
+
+		if (Source.bPointSource)
+		{
+			const FVector Offset = Position - Source.Position;
+			const float Distance = Offset.Size();
+
+			if (Distance > Source.Radius || Source.Radius <= 0.f)
+			{
+				continue;
+			}
+
+			// like a point light with a falloff exponent of 1
+			Direction = Offset.GetSafeNormal();
+			Falloff = FMath::Max(1.f - FMath::Square(Distance / Source.Radius), 0.f);
+			Weight *= Distance / Source.Radius;
+		}
+
+		Wind.Direction += Direction * Weight;
+		Wind.Speed += Source.Speed * Falloff * Weight;
+		Wind.MinGust += Source.MinGust * Falloff * Weight;
+		Wind.MaxGust += Source.MaxGust * Falloff * Weight;
+		TotalWeight += Weight;
+	}
+
+	if (TotalWeight > 0.f)
+	{
+		Wind.Direction = Wind.Direction.GetSafeNormal();
+		Wind.Speed /= TotalWeight;
+		Wind.MinGust /= TotalWeight;
+		Wind.MaxGust /= TotalWeight;
+	}
+
+	return Wind;
+}
+
+FVector FSoftBoneForceField::Sample(const FVector& Position, const FSoftBoneWind& Wind, const FSoftBoneForceScales& Scales) const
+{
+	FVector Acceleration = FVector::ZeroVector;
+
+	if (Scales.Wind != 0.f && !Wind.IsZero())
+	{
+		const float Distance = FVector::DotProduct(Position, Wind.Direction);
+		const float GustPhase = 2.f * PI * (Wind.GustTime / GustPeriod - Distance / GustWaveLength);
+		const float GustAlpha = 0.5f + 0.5f * FMath::Sin(GustPhase);
+
+		Acceleration += Wind.Direction * ((Wind.Speed + FMath::Lerp(Wind.MinGust, Wind.MaxGust, GustAlpha)) * Scales.Wind);
+	}
+
+	if (Scales.Radial != 0.f)
+	{
+		for (int32 Index = 0; Index < RadialForces.Num(); Index++)
+		{
+			const FSoftBoneRadialForce& Force = RadialForces[Index];
+			const FVector Offset = Position - Force.Origin;
+			const float DistanceSquared = Offset.SizeSquared();
+
+			if (DistanceSquared >= FMath::Square(Force.Radius))
+			{
+				continue;
+			}
+
+			const float Distance = FMath::Sqrt(DistanceSquared);
+			const float Falloff = 1.f - Distance / Force.Radius;
+			const float Fade = (Force.Duration > 0.f) ? FMath::Max(1.f - Force.Age / Force.Duration, 0.f) : 1.f;
+
+			// links right at the origin are blown up
+			const FVector Direction = (Distance > KINDA_SMALL_NUMBER) ? Offset / Distance : FVector::UpVector;
+
+			Acceleration += Direction * (Force.Strength * Falloff * Fade * Scales.Radial);
+		}
+	}
+
+	return Acceleration;
+}
+
+bool FSoftBoneForceField::SampleChains(const FSoftBoneChainState& State, const FSoftBoneVectorStream& TargetPositions, const FTransform& SimulationToWorld, const FSoftBoneWind& Wind, const FSoftBoneForceScales& Scales, FSoftBoneVectorStream& OutAccelerations) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_SoftBoneSampleForces);
+
+	if (OutAccelerations.Num() != State.Num())
+	{
+		// padding stays zero, so the vectorized integration can read whole blocks
+		OutAccelerations.SetNumZeroed(State.Num());
+	}
+
+	bool bAnyAcceleration = false;
+
+	for (int32 ChainIndex = 0; ChainIndex < State.Chains.Num(); ChainIndex++)
+	{
+		const FSoftBoneChainRange& Chain = State.Chains[ChainIndex];
+		const FVector RootPosition = SimulationToWorld.TransformPosition(TargetPositions.Get(Chain.LinkOffset));
+
+		// only rotated into simulation space, the field pushes in cm/s^2 whatever the scale of the component
+		const FVector Acceleration = SimulationToWorld.InverseTransformVectorNoScale(Sample(RootPosition, Wind, Scales));
+
+		for (int32 LinkIndex = Chain.LinkOffset; LinkIndex < Chain.LinkOffset + Chain.NumLinks; LinkIndex++)
+		{
+			OutAccelerations.Set(LinkIndex, Acceleration);
+		}
+
+		bAnyAcceleration |= !Acceleration.IsNearlyZero();
+	}
+
+	return bAnyAcceleration;
+}
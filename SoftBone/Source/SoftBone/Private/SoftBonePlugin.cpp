@@ -1,6 +1,9 @@
 // Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
 
 #include "SoftBonePluginPrivatePCH.h"
+#include "../Public/SoftBoneSimulationManager.h"
+
+DEFINE_LOG_CATEGORY(LogSoftBone);
 
 
 
@@ -10,6 +13,9 @@ class FSoftBonePlugin : public IModuleInterface
 	/** IModuleInterface implementation */
 	virtual void StartupModule() override;
 	virtual void ShutdownModule() override;
+
+	FDelegateHandle OnWorldCleanupHandle;
+	FDelegateHandle OnWorldPostActorTickHandle;
 };
 
 IMPLEMENT_MODULE(FSoftBonePlugin, SoftBone)
@@ -18,13 +24,19 @@ IMPLEMENT_MODULE(FSoftBonePlugin, SoftBone)
 
 void FSoftBonePlugin::StartupModule()
 {
-	
+	// simulation managers live as long as their worlds
+	OnWorldCleanupHandle = FWorldDelegates::OnWorldCleanup.AddStatic(&FSoftBoneSimulationManager::OnWorldCleanup);
+
+	// tickable objects are ticked before TG_PostUpdateWork, so the managers wait for the end of the world tick instead
+	OnWorldPostActorTickHandle = FWorldDelegates::OnWorldPostActorTick.AddStatic(&FSoftBoneSimulationManager::OnWorldPostActorTick);
 }
 
 
 void FSoftBonePlugin::ShutdownModule()
 {
-	
+	FWorldDelegates::OnWorldCleanup.Remove(OnWorldCleanupHandle);
+	FWorldDelegates::OnWorldPostActorTick.Remove(OnWorldPostActorTickHandle);
+	FSoftBoneSimulationManager::DestroyAll();
 }
 
 
@@ -5,3 +5,8 @@
 // You should place include statements to your module's private header files here.  You only need to
 // add includes for headers that are used in most of your module's source files though.
 #include "ModuleManager.h"
+
+// declares STATGROUP_SoftBone for the whole plugin
+#include "SoftBoneSolver.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogSoftBone, Log, All);
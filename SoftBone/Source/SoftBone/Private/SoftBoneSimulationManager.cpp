@@ -0,0 +1,846 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "SoftBonePluginPrivatePCH.h"
+#include "../Public/SoftBoneSimulationManager.h"
+#include "ParallelFor.h"
+#include "ThreadSingleton.h"
+#include "PhysicsEngine/PhysicsSettings.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Deferred Instances"), STAT_SoftBoneDeferredInstances, STATGROUP_SoftBone);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Batched Instances"), STAT_SoftBoneBatchedInstances, STATGROUP_SoftBone);
+
+// sum of all instances, also on worker threads, so it's comparable with the frame budget in stat captures
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Simulation Time (ms)"), STAT_SoftBoneSimulationTime, STATGROUP_SoftBone);
+
+DECLARE_CYCLE_STAT(TEXT("Manager Tick"), STAT_SoftBoneManagerTick, STATGROUP_SoftBone);
+DECLARE_CYCLE_STAT(TEXT("Batch Simulation"), STAT_SoftBoneBatchSimulation, STATGROUP_SoftBone);
+DECLARE_CYCLE_STAT(TEXT("Compact State Round Trip"), STAT_SoftBoneCompactState, STATGROUP_SoftBone);
+
+/** Seconds between two searches for the wind components of a world, sources added in between blow a little later */
+static const float WindComponentsRefreshInterval = 2.f;
+
+static TAutoConsoleVariable<float> CVarSoftBoneFrameBudget(
+	TEXT("SoftBone.FrameBudget"),
+	0.f,
+	TEXT("Milliseconds of SoftBone simulation allowed per frame in each world. 0 means no limit.\n")
+	TEXT("Less significant instances beyond the budget are deferred to later frames and simulate the accumulated time when it's their turn."));
+
+static TAutoConsoleVariable<int32> CVarSoftBoneExtrapolateDeferred(
+	TEXT("SoftBone.ExtrapolateDeferred"),
+	0,
+	TEXT("0: deferred instances hold their last simulated shape. 1: they extrapolate it by its velocities."));
+
+/** Expanded state of compact instances. Only one instance at a time is expanded on each thread, so they share these buffers. */
+class FSoftBoneThreadScratch : public TThreadSingleton<FSoftBoneThreadScratch>
+{
+public:
+	FSoftBoneChainState State;
+	FSoftBoneVectorStream FinalTargetPositions;
+	FSoftBoneVectorStream TargetPositions;
+	FSoftBoneVectorStream ReferenceTargetPositions;
+	FSoftBoneVectorStream ExternalAccelerations;
+
+	/** Swaps the per link streams of Instance with the buffers of this thread */
+	void Exchange(FSoftBoneSimulationInstance& Instance)
+	{
+		::Exchange(State, Instance.State);
+		::Exchange(FinalTargetPositions, Instance.FinalTargetPositions);
+		::Exchange(TargetPositions, Instance.TargetPositions);
+		::Exchange(ReferenceTargetPositions, Instance.ReferenceTargetPositions);
+		::Exchange(ExternalAccelerations, Instance.ExternalAccelerations);
+	}
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return State.GetAllocatedSize() + FinalTargetPositions.GetAllocatedSize() + TargetPositions.GetAllocatedSize() + ReferenceTargetPositions.GetAllocatedSize()
+			+ ExternalAccelerations.GetAllocatedSize();
+	}
+};
+
+/** Guards AllManagers, WorldManagers and QueuedInstances */
+static FCriticalSection ManagersLock;
+
+/** All existing managers including the ones without a world */
+static TArray<FSoftBoneSimulationManager*> AllManagers;
+
+/** Managers created by FSoftBoneSimulationManager::Get(), owned until their world is cleaned up */
+static TArray<FSoftBoneSimulationManager*> WorldManagers;
+
+/** Instances waiting for the game thread to find the manager of their world */
+static TArray<FSoftBoneSimulationInstance*> QueuedInstances;
+
+/////////////////////////////////////////////////////
+// FSoftBoneGameThreadData
+
+FSoftBoneGameThreadData::FSoftBoneGameThreadData()
+	: GravityZ(UPhysicsSettings::Get()->DefaultGravityZ)
+	, TimeDilation(1.f)
+	, ViewDistance(0.f)
+	, BoundsRadius(0.f)
+	, bRecentlyRendered(true)
+{
+}
+
+/////////////////////////////////////////////////////
+// FSoftBoneSimulationInstance
+
+FSoftBoneSimulationInstance::FSoftBoneSimulationInstance()
+	: RemainingTime(0.f)
+	, FixedTimeStep(1.f / 60.f)
+	, bFixedTimeStep(true)
+	, bPendingSimulation(false)
+	, bRegistered(false)
+	, bUseExternalForces(false)
+	, Manager(nullptr)
+	, Significance(1.f)
+	, LastSimulationTime(0.f)
+	, NumDeferredFrames(0)
+	, bActive(false)
+	, bBudgetDeferred(false)
+	, bCompactState(false)
+	, bStateExpanded(false)
+{
+}
+
+FSoftBoneSimulationInstance::~FSoftBoneSimulationInstance()
+{
+	if (bRegistered)
+	{
+		FSoftBoneSimulationManager::UnregisterFromAll(this);
+	}
+}
+
+FSoftBoneSimulationInstance::FSoftBoneSimulationInstance(const FSoftBoneSimulationInstance& Other)
+	: FSoftBoneSimulationInstance()
+{
+	*this = Other;
+}
+
+FSoftBoneSimulationInstance& FSoftBoneSimulationInstance::operator=(const FSoftBoneSimulationInstance& Other)
+{
+	if (this == &Other)
+	{
+		return *this;
+	}
+
+	State = Other.State;
+	FinalTargetPositions = Other.FinalTargetPositions;
+	TargetPositions = Other.TargetPositions;
+	ReferenceTargetPositions = Other.ReferenceTargetPositions;
+	Params = Other.Params;
+	Colliders = Other.Colliders;
+	ExternalAccelerations = Other.ExternalAccelerations;
+	RemainingTime = Other.RemainingTime;
+	FixedTimeStep = Other.FixedTimeStep;
+	bFixedTimeStep = Other.bFixedTimeStep;
+	bUseExternalForces = Other.bUseExternalForces;
+	Component = Other.Component;
+	GameThreadData = Other.GameThreadData;
+	Significance = Other.Significance;
+	LastSimulationTime = Other.LastSimulationTime;
+	NumDeferredFrames = Other.NumDeferredFrames;
+	bActive = Other.bActive;
+	bBudgetDeferred = Other.bBudgetDeferred;
+	bCompactState = Other.bCompactState;
+	CompactState = Other.CompactState;
+	bStateExpanded = Other.bStateExpanded;
+	OwnerName = Other.OwnerName;
+	CaptureContext = Other.CaptureContext;
+
+	// registration stays with the address, the manager only knows the original
+	if (bRegistered)
+	{
+		FSoftBoneSimulationManager::UnregisterFromAll(this);
+	}
+
+	bRegistered = false;
+	Manager = nullptr;
+	bPendingSimulation = false;
+	CaptureWriter.Reset();
+
+	return *this;
+}
+
+void FSoftBoneSimulationInstance::Simulate()
+{
+	const uint32 StartCycles = FPlatformTime::Cycles();
+
+	// batched instances are released by the node after gathering their targets
+	const bool bExpandState = bCompactState && !bStateExpanded;
+
+	if (bExpandState)
+	{
+		ExpandState();
+	}
+
+	// time spent writing the capture isn't part of the cost of the instance
+	uint32 CaptureCycles = 0;
+
+	if (FSoftBoneCaptureWriter::IsCaptureEnabled() != CaptureWriter.IsValid())
+	{
+		const uint32 CaptureStartCycles = FPlatformTime::Cycles();
+
+		if (CaptureWriter.IsValid())
+		{
+			CaptureWriter.Reset();
+		}
+		else
+		{
+			CaptureWriter = MakeShareable(new FSoftBoneCaptureWriter(OwnerName));
+		}
+
+		CaptureCycles += FPlatformTime::Cycles() - CaptureStartCycles;
+	}
+
+	if (CaptureWriter.IsValid())
+	{
+		const uint32 CaptureStartCycles = FPlatformTime::Cycles();
+		CaptureWriter->BeginFrame(*this);
+		CaptureCycles += FPlatformTime::Cycles() - CaptureStartCycles;
+	}
+
+	FSoftBoneSolverParams SolverParams = Params;
+	SolverParams.Colliders = Colliders.GetData();
+	SolverParams.NumColliders = Colliders.Num();
+	SolverParams.LinkAccelerations = (ExternalAccelerations.Num() > 0) ? &ExternalAccelerations : nullptr;
+
+	RemainingTime = FSoftBoneSolver::Simulate(State, FinalTargetPositions, TargetPositions, RemainingTime, FixedTimeStep, bFixedTimeStep, SolverParams);
+	bPendingSimulation = false;
+
+	if (CaptureWriter.IsValid())
+	{
+		const uint32 CaptureStartCycles = FPlatformTime::Cycles();
+		CaptureWriter->EndFrame(*this);
+		CaptureCycles += FPlatformTime::Cycles() - CaptureStartCycles;
+	}
+
+	if (bExpandState)
+	{
+		ReleaseState();
+	}
+
+	LastSimulationTime = FPlatformTime::ToSeconds(FPlatformTime::Cycles() - StartCycles - CaptureCycles);
+	INC_FLOAT_STAT_BY(STAT_SoftBoneSimulationTime, LastSimulationTime * 1000.f);
+}
+
+void FSoftBoneSimulationInstance::ExpandState()
+{
+	if (bStateExpanded)
+	{
+		return;
+	}
+
+	if (!bCompactState)
+	{
+		// switched back to full precision, links stay in State from now on
+		if (CompactState.Num() > 0)
+		{
+			FSoftBoneSolver::DecompressState(CompactState, State, TargetPositions, &FinalTargetPositions, &ReferenceTargetPositions, &ExternalAccelerations);
+			CompactState.Reset();
+		}
+
+		return;
+	}
+
+	bStateExpanded = true;
+
+	SCOPE_CYCLE_COUNTER(STAT_SoftBoneCompactState);
+
+	// links which have been simulated before switching to the compact state are still in State
+	if (CompactState.Num() == 0 && State.Num() > 0)
+	{
+		return;
+	}
+
+	FSoftBoneThreadScratch::Get().Exchange(*this);
+
+	FSoftBoneSolver::DecompressState(CompactState, State, TargetPositions, &FinalTargetPositions, &ReferenceTargetPositions, &ExternalAccelerations);
+}
+
+void FSoftBoneSimulationInstance::ReleaseState()
+{
+	if (!bStateExpanded)
+	{
+		return;
+	}
+
+	bStateExpanded = false;
+
+	SCOPE_CYCLE_COUNTER(STAT_SoftBoneCompactState);
+
+	// final targets are gathered again by the next evaluation, only the manager reads them before that
+	FSoftBoneSolver::CompressState(State, TargetPositions, CompactState, bPendingSimulation ? &FinalTargetPositions : nullptr, &ReferenceTargetPositions, &ExternalAccelerations);
+
+	FSoftBoneThreadScratch::Get().Exchange(*this);
+
+	// whatever the thread held before goes away, so the instance keeps no buffers of its own
+	State = FSoftBoneChainState();
+	FinalTargetPositions = FSoftBoneVectorStream();
+	TargetPositions = FSoftBoneVectorStream();
+	ReferenceTargetPositions = FSoftBoneVectorStream();
+	ExternalAccelerations = FSoftBoneVectorStream();
+}
+
+SIZE_T FSoftBoneSimulationInstance::GetThreadScratchSize()
+{
+	return FSoftBoneThreadScratch::Get().GetAllocatedSize();
+}
+
+/////////////////////////////////////////////////////
+// FSoftBoneSimulationManager
+
+FSoftBoneSimulationManager::FSoftBoneSimulationManager(UWorld* InWorld)
+	: World(InWorld)
+	, NumDeferredInstances(0)
+	, WindComponentsRefreshTime(0.f)
+{
+	FScopeLock Lock(&ManagersLock);
+	AllManagers.Add(this);
+}
+
+FSoftBoneSimulationManager::~FSoftBoneSimulationManager()
+{
+	{
+		FScopeLock Lock(&InstancesLock);
+
+		// instances outliving their world simulate on their own from now on
+		for (int32 Index = 0; Index < Instances.Num(); Index++)
+		{
+			Instances[Index]->Manager = nullptr;
+		}
+	}
+
+	FScopeLock Lock(&ManagersLock);
+	AllManagers.RemoveSingleSwap(this);
+}
+
+FSoftBoneSimulationManager* FSoftBoneSimulationManager::Get(UWorld* World)
+{
+	if (World == nullptr)
+	{
+		return nullptr;
+	}
+
+	FScopeLock Lock(&ManagersLock);
+
+	for (int32 Index = 0; Index < WorldManagers.Num(); Index++)
+	{
+		if (WorldManagers[Index]->World == World)
+		{
+			return WorldManagers[Index];
+		}
+	}
+
+	FSoftBoneSimulationManager* Manager = new FSoftBoneSimulationManager(World);
+	WorldManagers.Add(Manager);
+
+	return Manager;
+}
+
+void FSoftBoneSimulationManager::OnWorldCleanup(UWorld* World, bool bSessionEnded, bool bCleanupResources)
+{
+	FSoftBoneSimulationManager* ManagerToDestroy = nullptr;
+
+	{
+		FScopeLock Lock(&ManagersLock);
+
+		for (int32 Index = 0; Index < WorldManagers.Num(); Index++)
+		{
+			if (WorldManagers[Index]->World == World)
+			{
+				ManagerToDestroy = WorldManagers[Index];
+				WorldManagers.RemoveAtSwap(Index);
+				break;
+			}
+		}
+	}
+
+	// destructor takes the lock again
+	delete ManagerToDestroy;
+}
+
+void FSoftBoneSimulationManager::OnWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds)
+{
+	// instances initialized in this frame get their manager before they are updated again
+	RegisterQueuedInstances();
+
+	// animation isn't evaluated in paused worlds, so neither is the simulation
+	if (World->IsPaused())
+	{
+		return;
+	}
+
+	FSoftBoneSimulationManager* Manager = nullptr;
+
+	{
+		FScopeLock Lock(&ManagersLock);
+
+		for (int32 Index = 0; Index < WorldManagers.Num(); Index++)
+		{
+			if (WorldManagers[Index]->World == World)
+			{
+				Manager = WorldManagers[Index];
+				break;
+			}
+		}
+	}
+
+	// managers are only destroyed on the game thread when their world is cleaned up
+	if (Manager)
+	{
+		Manager->Tick(DeltaSeconds);
+	}
+}
+
+void FSoftBoneSimulationManager::DestroyAll()
+{
+	TArray<FSoftBoneSimulationManager*> ManagersToDestroy;
+
+	{
+		FScopeLock Lock(&ManagersLock);
+		ManagersToDestroy = WorldManagers;
+		WorldManagers.Empty();
+	}
+
+	for (int32 Index = 0; Index < ManagersToDestroy.Num(); Index++)
+	{
+		delete ManagersToDestroy[Index];
+	}
+}
+
+void FSoftBoneSimulationManager::QueueRegistration(FSoftBoneSimulationInstance* Instance)
+{
+	FScopeLock Lock(&ManagersLock);
+
+	QueuedInstances.AddUnique(Instance);
+	Instance->bRegistered = true;
+}
+
+void FSoftBoneSimulationManager::RegisterQueuedInstances()
+{
+	check(IsInGameThread());
+
+	// held throughout, so queued instances can't be destroyed in between. Get takes the lock again.
+	FScopeLock Lock(&ManagersLock);
+
+	for (int32 Index = 0; Index < QueuedInstances.Num(); Index++)
+	{
+		FSoftBoneSimulationInstance* Instance = QueuedInstances[Index];
+		const USkeletalMeshComponent* Component = Instance->Component.Get();
+		FSoftBoneSimulationManager* Manager = Component ? Get(Component->GetWorld()) : nullptr;
+
+		if (Instance->Manager && Instance->Manager != Manager)
+		{
+			Instance->Manager->Unregister(Instance);
+		}
+
+		if (Manager)
+		{
+			Instance->OwnerName = Component->GetFName();
+			Manager->Register(Instance);
+		}
+		else
+		{
+			UE_LOG(LogSoftBone, Log, TEXT("SoftBone instance of %s has no world, it simulates on its own with default gravity"), Component ? *Component->GetName() : TEXT("a missing component"));
+		}
+	}
+
+	QueuedInstances.Reset();
+}
+
+void FSoftBoneSimulationManager::Register(FSoftBoneSimulationInstance* Instance)
+{
+	FScopeLock Lock(&InstancesLock);
+
+	Instances.AddUnique(Instance);
+	Instance->bRegistered = true;
+	Instance->Manager = this;
+
+	// nodes register when they are initialized, so their first evaluation has the data already
+	if (IsInGameThread())
+	{
+		UpdateGameThreadData(Instance);
+	}
+}
+
+void FSoftBoneSimulationManager::Unregister(FSoftBoneSimulationInstance* Instance)
+{
+	FScopeLock Lock(&InstancesLock);
+
+	Instances.RemoveSingleSwap(Instance);
+
+	if (Instance->Manager == this)
+	{
+		Instance->Manager = nullptr;
+	}
+}
+
+bool FSoftBoneSimulationManager::IsRegistered(const FSoftBoneSimulationInstance* Instance) const
+{
+	FScopeLock Lock(&InstancesLock);
+
+	return Instances.Contains(const_cast<FSoftBoneSimulationInstance*>(Instance));
+}
+
+void FSoftBoneSimulationManager::UnregisterFromAll(FSoftBoneSimulationInstance* Instance)
+{
+	FScopeLock Lock(&ManagersLock);
+
+	QueuedInstances.RemoveSingleSwap(Instance);
+
+	for (int32 Index = 0; Index < AllManagers.Num(); Index++)
+	{
+		AllManagers[Index]->Unregister(Instance);
+	}
+}
+
+void FSoftBoneSimulationManager::SimulatePendingInstances()
+{
+	SCOPE_CYCLE_COUNTER(STAT_SoftBoneBatchSimulation);
+
+	FScopeLock Lock(&InstancesLock);
+
+	// PendingInstances keeps its allocation between frames
+	PendingInstances.Reset();
+
+	for (int32 Index = 0; Index < Instances.Num(); Index++)
+	{
+		if (Instances[Index]->bPendingSimulation)
+		{
+			PendingInstances.Add(Instances[Index]);
+		}
+	}
+
+	INC_DWORD_STAT_BY(STAT_SoftBoneBatchedInstances, PendingInstances.Num());
+
+	SimulateInstances(PendingInstances.GetData(), PendingInstances.Num());
+}
+
+void FSoftBoneSimulationManager::AllocateBudget(float BudgetMs)
+{
+	FScopeLock Lock(&InstancesLock);
+
+	ActiveInstances.Reset();
+
+	for (int32 Index = 0; Index < Instances.Num(); Index++)
+	{
+		FSoftBoneSimulationInstance* Instance = Instances[Index];
+
+		// instances which haven't been evaluated don't take part, e.g. frozen ones or the ones of hidden components
+		if (Instance->bActive)
+		{
+			Instance->bActive = false;
+			ActiveInstances.Add(Instance);
+		}
+		else
+		{
+			Instance->bBudgetDeferred = false;
+			Instance->NumDeferredFrames = 0;
+		}
+	}
+
+	NumDeferredInstances = 0;
+
+	if (BudgetMs <= 0.f)
+	{
+		for (int32 Index = 0; Index < ActiveInstances.Num(); Index++)
+		{
+			ActiveInstances[Index]->bBudgetDeferred = false;
+			ActiveInstances[Index]->NumDeferredFrames = 0;
+		}
+
+		return;
+	}
+
+	// waiting instances get more important every frame, so less significant ones are updated round-robin instead of starving
+	ActiveInstances.Sort([](const FSoftBoneSimulationInstance& A, const FSoftBoneSimulationInstance& B)
+	{
+		return A.Significance * (A.NumDeferredFrames + 1) > B.Significance * (B.NumDeferredFrames + 1);
+	});
+
+	const float BudgetSeconds = BudgetMs * 0.001f;
+	float UsedSeconds = 0.f;
+
+	for (int32 Index = 0; Index < ActiveInstances.Num(); Index++)
+	{
+		FSoftBoneSimulationInstance* Instance = ActiveInstances[Index];
+
+		// the last cost is the best guess for the next one, smaller instances further down may still fit
+		if (Index == 0 || UsedSeconds + Instance->LastSimulationTime <= BudgetSeconds)
+		{
+			UsedSeconds += Instance->LastSimulationTime;
+			Instance->bBudgetDeferred = false;
+			Instance->NumDeferredFrames = 0;
+		}
+		else
+		{
+			Instance->bBudgetDeferred = true;
+			Instance->NumDeferredFrames++;
+			NumDeferredInstances++;
+		}
+	}
+
+	INC_DWORD_STAT_BY(STAT_SoftBoneDeferredInstances, NumDeferredInstances);
+}
+
+/** Distance to the closest view, 0 if nothing has been rendered like in a dedicated server */
+static float ComputeViewDistance(const UWorld* World, const FVector& Origin)
+{
+	const TArray<FVector>& ViewLocations = World->ViewLocationsRenderedLastFrame;
+
+	if (ViewLocations.Num() == 0)
+	{
+		return 0.f;
+	}
+
+	float MinDistanceSquared = FVector::DistSquared(ViewLocations[0], Origin);
+
+	for (int32 ViewIndex = 1; ViewIndex < ViewLocations.Num(); ViewIndex++)
+	{
+		MinDistanceSquared = FMath::Min(MinDistanceSquared, FVector::DistSquared(ViewLocations[ViewIndex], Origin));
+	}
+
+	return FMath::Sqrt(MinDistanceSquared);
+}
+
+void FSoftBoneSimulationManager::UpdateGameThreadData()
+{
+	check(IsInGameThread());
+
+	FScopeLock Lock(&InstancesLock);
+
+	for (int32 Index = 0; Index < Instances.Num(); Index++)
+	{
+		UpdateGameThreadData(Instances[Index]);
+	}
+}
+
+void FSoftBoneSimulationManager::UpdateGameThreadData(FSoftBoneSimulationInstance* Instance) const
+{
+	if (World == nullptr)
+	{
+		return;
+	}
+
+	FSoftBoneGameThreadData& Data = Instance->GameThreadData;
+	Data.GravityZ = World->GetGravityZ();
+	Data.TimeDilation = World->GetWorldSettings() ? World->GetWorldSettings()->GetEffectiveTimeDilation() : 1.f;
+
+	Data.ForceField = SharedForceField;
+
+	const USkeletalMeshComponent* Component = Instance->Component.Get();
+
+	if (Component)
+	{
+		Data.ViewDistance = ComputeViewDistance(World, Component->Bounds.Origin);
+		Data.BoundsRadius = Component->Bounds.SphereRadius;
+		Data.bRecentlyRendered = Component->bRecentlyRendered;
+
+		// one blend of the wind sources per component, chains vary it by their own gust phase
+		// the wind carries the time of the field, so the shared copy doesn't need to be renewed for the gusts to move
+		if (Instance->bUseExternalForces && SharedForceField.IsValid())
+		{
+			Data.Wind = ForceField.ComputeWind(Component->Bounds.Origin);
+		}
+	}
+}
+
+void FSoftBoneSimulationManager::AddRadialForce(const FVector& Origin, float Radius, float Strength, float Duration)
+{
+	check(IsInGameThread());
+
+	if (Radius > 0.f && Strength != 0.f)
+	{
+		ForceField.RadialForces.Add(FSoftBoneRadialForce(Origin, Radius, Strength, FMath::Max(Duration, 0.f)));
+	}
+}
+
+bool FSoftBoneSimulationManager::AnyInstanceUsesExternalForces() const
+{
+	FScopeLock Lock(&InstancesLock);
+
+	for (int32 Index = 0; Index < Instances.Num(); Index++)
+	{
+		if (Instances[Index]->bUseExternalForces)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void FSoftBoneSimulationManager::GatherWindSources(float DeltaTime)
+{
+	check(IsInGameThread());
+
+	WindComponentsRefreshTime -= DeltaTime;
+
+	if (WindComponentsRefreshTime <= 0.f)
+	{
+		WindComponentsRefreshTime = WindComponentsRefreshInterval;
+		WindComponents.Reset();
+
+		for (TObjectIterator<UWindDirectionalSourceComponent> It; It; ++It)
+		{
+			if (It->GetWorld() == World)
+			{
+				WindComponents.Add(*It);
+			}
+		}
+	}
+
+	ForceField.WindSources.Reset();
+
+	// the wind proxies of the scene belong to the render thread, so the sources are read from their components
+	for (int32 Index = 0; Index < WindComponents.Num(); Index++)
+	{
+		const UWindDirectionalSourceComponent* Component = WindComponents[Index].Get();
+
+		if (Component == nullptr || !Component->IsRegistered())
+		{
+			continue;
+		}
+
+		FSoftBoneWindSource Source;
+		Source.Position = Component->GetComponentLocation();
+		Source.Direction = Component->GetComponentToWorld().GetUnitAxis(EAxis::X);
+		Source.Strength = Component->Strength;
+		Source.Speed = Component->Speed;
+		Source.MinGust = Component->MinGustAmount;
+		Source.MaxGust = Component->MaxGustAmount;
+		Source.Radius = Component->Radius;
+		Source.bPointSource = Component->bPointWind;
+
+		ForceField.WindSources.Add(Source);
+	}
+}
+
+void FSoftBoneSimulationManager::UpdateForceField(float DeltaTime)
+{
+	check(IsInGameThread());
+
+	if (!AnyInstanceUsesExternalForces())
+	{
+		// wind components are searched again as soon as an instance needs them
+		WindComponents.Reset();
+		WindComponentsRefreshTime = 0.f;
+		ForceField.WindSources.Reset();
+		SharedForceField.Reset();
+		return;
+	}
+
+	GatherWindSources(DeltaTime);
+
+	if (ForceField.IsEmpty())
+	{
+		// nodes skip sampling without a field
+		SharedForceField.Reset();
+	}
+	else if (!SharedForceField.IsValid() || ForceField.RadialForces.Num() > 0 || SharedForceField->RadialForces.Num() > 0 || !(ForceField.WindSources == SharedForceField->WindSources))
+	{
+		// radial forces fade every frame, steady wind only needs a new copy when its sources change
+		// instances keep the last copy while they are evaluated, so the field can move on
+		SharedForceField = MakeShareable(new FSoftBoneForceField(ForceField));
+	}
+}
+
+#if WITH_EDITOR
+void FSoftBoneSimulationManager::QueueDebugShapes(const TArray<FSoftBoneDebugShape>& Shapes)
+{
+	FScopeLock Lock(&DebugShapesLock);
+	DebugShapes.Append(Shapes);
+}
+
+void FSoftBoneSimulationManager::DrawDebugShapes()
+{
+	FScopeLock Lock(&DebugShapesLock);
+
+	for (int32 Index = 0; Index < DebugShapes.Num(); Index++)
+	{
+		const FSoftBoneDebugShape& Shape = DebugShapes[Index];
+
+		switch (Shape.Type)
+		{
+		case FSoftBoneDebugShape::Line:
+			DrawDebugLine(World, Shape.Start, Shape.End, Shape.Color, false, -1.f, SDPG_Foreground, Shape.Size);
+			break;
+		case FSoftBoneDebugShape::Box:
+			DrawDebugBox(World, Shape.Start, FVector(Shape.Size), Shape.Color, false, -1.f, SDPG_Foreground);
+			break;
+		case FSoftBoneDebugShape::Sphere:
+			DrawDebugSphere(World, Shape.Start, Shape.Size, 12, Shape.Color, false, -1.f, SDPG_Foreground);
+			break;
+		case FSoftBoneDebugShape::Capsule:
+		{
+			const FVector Segment = Shape.End - Shape.Start;
+
+			// half height of a debug capsule includes its caps
+			DrawDebugCapsule(World, (Shape.Start + Shape.End) * 0.5f, Segment.Size() * 0.5f + Shape.Size, Shape.Size, FRotationMatrix::MakeFromZ(Segment).ToQuat(), Shape.Color, false, -1.f, SDPG_Foreground);
+			break;
+		}
+		}
+	}
+
+	// shapes last one frame, nodes queue them again in the next evaluation
+	DebugShapes.Reset();
+}
+#endif // #if WITH_EDITOR
+
+float FSoftBoneSimulationManager::GetFrameBudget()
+{
+	return CVarSoftBoneFrameBudget.GetValueOnAnyThread();
+}
+
+bool FSoftBoneSimulationManager::ShouldExtrapolateDeferred()
+{
+	return CVarSoftBoneExtrapolateDeferred.GetValueOnAnyThread() != 0;
+}
+
+void FSoftBoneSimulationManager::SimulateInstances(FSoftBoneSimulationInstance* const* Instances, int32 NumInstances, int32 NumTasks)
+{
+	if (NumTasks <= 0)
+	{
+		ParallelFor(NumInstances, [Instances](int32 Index)
+		{
+			Instances[Index]->Simulate();
+		});
+	}
+	else
+	{
+		const int32 NumInstancesPerTask = FMath::DivideAndRoundUp(NumInstances, NumTasks);
+
+		ParallelFor(NumTasks, [Instances, NumInstances, NumInstancesPerTask](int32 TaskIndex)
+		{
+			const int32 EndIndex = FMath::Min((TaskIndex + 1) * NumInstancesPerTask, NumInstances);
+
+			for (int32 Index = TaskIndex * NumInstancesPerTask; Index < EndIndex; Index++)
+			{
+				Instances[Index]->Simulate();
+			}
+		}, NumTasks == 1);
+	}
+}
+
+void FSoftBoneSimulationManager::Tick(float DeltaTime)
+{
+	check(IsInGameThread());
+	SCOPE_CYCLE_COUNTER(STAT_SoftBoneManagerTick);
+
+	// all tick groups have run, so animation of this frame has been evaluated and all targets are gathered
+	SimulatePendingInstances();
+
+	// costs of this frame are known now, so decide which instances simulate in the next one
+	AllocateBudget(GetFrameBudget());
+
+	// nodes read these during the next evaluation, possibly on worker threads
+	UpdateForceField(DeltaTime);
+	UpdateGameThreadData();
+
+	// the wind of the instances has taken the time of this frame
+	ForceField.Advance(DeltaTime);
+
+#if WITH_EDITOR
+	DrawDebugShapes();
+#endif // #if WITH_EDITOR
+}
@@ -3,6 +3,8 @@
 #pragma once
 
 #include "AnimNode_SkeletalControlBase.h"
+#include "SoftBoneSimulationManager.h"
+#include "SoftBoneChainTemplate.h"
 #include "AnimNode_SoftBone.generated.h"
 
 /**
@@ -36,51 +38,97 @@ namespace ERestoringWeight
 	};
 }
 
-/** Transient structure for SoftBone node evaluation */
-struct FSoftBoneLink
+UENUM(BlueprintType)
+namespace ESoftBoneSolverType
 {
-public:
-	FVector Velocity;
-
-	/** Current Simulated Position of bone in world space. */
-	FVector Position;
+	enum Type
+	{
+		// Restoring impulse and one length constraint pass per step. Stiffness and damping depend on SimulationHertz.
+		SST_Explicit UMETA(DisplayName = "Explicit"),
+		// Iterated XPBD constraints. Stiffness and damping look the same at any SimulationHertz.
+		SST_XPBD UMETA(DisplayName = "XPBD"),
+		// Closed form spring of each bone and one length constraint pass. Stable at any time step,
+		// so it looks the same without bGuaranteeSameSimulationResult or at any SimulationHertz.
+		SST_Analytic UMETA(DisplayName = "Analytic"),
+	};
+}
 
-	/** Position of bone in world space for rendering. */
-	FVector RenderPosition;
+UENUM(BlueprintType)
+namespace ESoftBoneLODTier
+{
+	enum Type
+	{
+		// Fixed time step at SimulationHertz
+		SLT_Full UMETA(DisplayName = "Full"),
+		// Fixed time step at ReducedSimulationHertz
+		SLT_ReducedRate UMETA(DisplayName = "Reduced Rate"),
+		// One step for the whole frame without sub steps
+		SLT_SingleStep UMETA(DisplayName = "Single Step"),
+		// Not simulated, bones follow the animated pose
+		SLT_Frozen UMETA(DisplayName = "Frozen"),
+	};
+}
 
-	/** Current Position of bone in component space. */
-	FVector PositionInCS;
+/** A LOD tier is used when the component is farther than MinDistance or smaller than MaxScreenSize. 0 disables the check. */
+USTRUCT()
+struct FSoftBoneLODThreshold
+{
+	GENERATED_USTRUCT_BODY()
 
-	/** Distance to its parent link. */
-	float Length;
+	/** Distance from the closest view */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = LOD)
+	float MinDistance;
 
-	/** Bone Index in SkeletalMesh */
-	FCompactPoseBoneIndex BoneIndex;
+	/** Bounds radius divided by the distance from the closest view, about the ratio of the screen covered with 90 degrees FOV */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = LOD)
+	float MaxScreenSize;
 
-	/** Transform Index that this control will output */
-	int32 TransformIndex;
+	FSoftBoneLODThreshold()
+		: MinDistance(0.f)
+		, MaxScreenSize(0.f)
+	{
+	}
 
-	/** Pre-calculated weight for restoring  */
-	float RestoringWeight;
+	FSoftBoneLODThreshold(float InMinDistance, float InMaxScreenSize)
+		: MinDistance(InMinDistance)
+		, MaxScreenSize(InMaxScreenSize)
+	{
+	}
 
-	FSoftBoneLink()
-		: Position(FVector::ZeroVector)
-		, Velocity(FVector::ZeroVector)
-		, Length(0.f)
-		, BoneIndex(INDEX_NONE)
+	bool IsSatisfied(float Distance, float ScreenSize) const
 	{
+		return (MinDistance > 0.f && Distance > MinDistance) || (MaxScreenSize > 0.f && ScreenSize < MaxScreenSize);
 	}
+};
+
+/** Sphere or capsule attached to a bone which simulated bones are pushed out of */
+USTRUCT()
+struct FSoftBoneColliderBone
+{
+	GENERATED_USTRUCT_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Collision)
+	FBoneReference Bone;
+
+	/** Ends of the capsule in the space of the bone. Same offsets make a sphere. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Collision)
+	FVector StartOffset;
 
-	FSoftBoneLink(const FVector& InPosition, const float& InLength, const FCompactPoseBoneIndex& InBoneIndex)
-		: Position(InPosition)
-		, Length(InLength)
-		, BoneIndex(InBoneIndex)
-		, Velocity(FVector::ZeroVector)
-		, PositionInCS(FVector::ZeroVector)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Collision)
+	FVector EndOffset;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Collision, meta = (ClampMin = "0.0"))
+	float Radius;
+
+	FSoftBoneColliderBone()
+		: StartOffset(FVector::ZeroVector)
+		, EndOffset(FVector::ZeroVector)
+		, Radius(10.f)
 	{
 	}
 };
 
+/** Pairs sharing the same root bone are merged into one tree of bones */
 USTRUCT()
 struct FBonePair
 {
@@ -89,6 +137,7 @@ struct FBonePair
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = BoneChain)
 	FBoneReference RootBone;
 
+	/** Leave empty to simulate the whole subtree of the root bone */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = BoneChain)
 	FBoneReference TipBone;
 
@@ -96,29 +145,13 @@ struct FBonePair
 	{
 	}
 
-	FBonePair(FBoneReference& InRootBone, FBoneReference& InTipBone)
+	FBonePair(const FBoneReference& InRootBone, const FBoneReference& InTipBone)
 		: RootBone(InRootBone)
 		, TipBone(InTipBone)
 	{
 	}
 };
 
-struct FChainInfo
-{
-	/** stored bone indices when initializing */
-	TArray<FCompactPoseBoneIndex> BoneIndices;
-
-	/** Previous bone locations for this chain. Num of this array should be same as Num of Bone indices. */
-	/** in world space */
-	TArray<FSoftBoneLink> PrevBoneLinks;
-
-	void Empty()
-	{
-		BoneIndices.Empty();
-		PrevBoneLinks.Empty();
-	}
-};
-
 USTRUCT()
 struct SOFTBONE_API FAnimNode_SoftBone : public FAnimNode_SkeletalControlBase
 {
@@ -128,11 +161,12 @@ struct SOFTBONE_API FAnimNode_SoftBone : public FAnimNode_SkeletalControlBase
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = BoneChain)
 	FBoneReference RootBone;
 
-	/** Name of tip bone which is the last bone of the chain. **/
+	/** Name of tip bone which is the last bone of the chain. Leave empty to simulate the whole subtree of the root bone. **/
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = BoneChain)
 	FBoneReference TipBone;
 
-	/** Never duplicate same bones already included in other chains **/
+	/** Chains with the same root bone are simulated as one tree, so forks like tails, hair strands or skirts can share their ancestors.
+	    Never duplicate same bones already included in chains of other root bones **/
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = BoneChain)
 	TArray<FBonePair> AdditionalChains;
 
@@ -173,7 +207,8 @@ struct SOFTBONE_API FAnimNode_SoftBone : public FAnimNode_SkeletalControlBase
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Solver)
 	bool bBoneLengthConstraint;
 
-	/** 60 hertz by default. Recommend higher than 60Hz for smooth simulation but You can also choose 30Hz for performance and adjust stiffness and damping */
+	/** 60 hertz by default. Recommend higher than 60Hz for smooth simulation but You can also choose 30Hz for performance and adjust stiffness and damping.
+	    With the XPBD solver, 30Hz keeps the stiffness and damping of 120Hz. */
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Solver)
 	TEnumAsByte<ESimulationHertz::Type> SimulationHertz;
 
@@ -182,6 +217,106 @@ struct SOFTBONE_API FAnimNode_SoftBone : public FAnimNode_SkeletalControlBase
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Solver)
 	bool bGuaranteeSameSimulationResult;
 
+	/** XPBD and Analytic keep stiffness and damping tuned at 120Hz at any SimulationHertz, so lower rates can be used without retuning */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Solver)
+	TEnumAsByte<ESoftBoneSolverType::Type> SolverType;
+
+	/** Maximum number of constraint iterations per step with the XPBD solver */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Solver, meta = (ClampMin = "1"))
+	int32 NumIterations;
+
+	/** The XPBD solver stops iterating a chain once no bone length is off by more than this */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Solver, meta = (ClampMin = "0.0"))
+	float ConvergenceTolerance;
+
+	/** Maximum number of fixed sub steps simulated in a frame. Time beyond it is dropped, so the simulation slows down during a hitch instead of making it worse. 0 means no limit. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Solver, meta = (ClampMin = "0"))
+	int32 MaxSubStepsPerFrame;
+
+	/** If true, bones are rendered in between the last two fixed steps. It lags one step behind but moves smoothly even if SimulationHertz is lower than the frame rate. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Solver)
+	bool bInterpolateFixedSteps;
+
+	/** If true, chains are simulated in component space and the movement of the component is applied once per chain instead of converting every bone from and to world space.
+	    Cheaper than world space simulation and the result should look the same. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Solver)
+	bool bSimulateInComponentSpace;
+
+	/** If true, chains are simulated at the end of the frame together with all other SoftBone instances of the world in one parallel batch.
+	    Scales much better with many characters but the simulated shape is one frame behind the animated pose. Roots still follow the current pose. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Solver)
+	bool bBatchSimulation;
+
+	/** If true, simulated links and their targets are kept quantized to 16 bits relative to the root of their chain in between frames, which takes less than a third of the memory.
+	    Sleeping chains don't keep their bones either, they are converted from their resting links again like awake chains.
+	    Meant for large crowds. Positions are off by up to 1/65536 of the size of the chain after each frame. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Solver)
+	bool bCompactState;
+
+	/** If true, simulation gets cheaper with distance, screen size and visibility of the component. Tiers blend smoothly. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = LOD)
+	bool bEnableLOD;
+
+	/** Simulation rate of Reduced Rate tier. Stiffness and damping are applied per step, so the motion gets a bit softer. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = LOD)
+	TEnumAsByte<ESimulationHertz::Type> ReducedSimulationHertz;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = LOD)
+	FSoftBoneLODThreshold ReducedRateThreshold;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = LOD)
+	FSoftBoneLODThreshold SingleStepThreshold;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = LOD)
+	FSoftBoneLODThreshold FrozenThreshold;
+
+	/** If true, chains which stay still stop being simulated until their targets move again */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Sleep)
+	bool bEnableSleep;
+
+	/** Chains fall asleep when all links are slower than this (cm/s) */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Sleep, meta = (ClampMin = "0.0"))
+	float SleepVelocityThreshold;
+
+	/** Chains fall asleep when no bone of the animated pose moves farther than this (cm) per frame, and wake up when any bone moves farther than this */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Sleep, meta = (ClampMin = "0.0"))
+	float SleepTargetThreshold;
+
+	/** Time in seconds for a chain to stay still before falling asleep */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Sleep, meta = (ClampMin = "0.0"))
+	float SleepDelay;
+
+	/** Lowest tier used when the component was not rendered recently */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = LOD)
+	TEnumAsByte<ESoftBoneLODTier::Type> NotRenderedLODTier;
+
+	/** Time in seconds to blend between the simulated and the animated pose when freezing or waking up */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = LOD)
+	float LODBlendTime;
+
+	/** Spheres and capsules on the animated pose which simulated bones can't enter, e.g. the body under a tail or a skirt */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Collision)
+	TArray<FSoftBoneColliderBone> Colliders;
+
+	/**
+	 * If true, chains are pushed by the wind directional sources of the world and by radial forces added to the world's FSoftBoneSimulationManager.
+	 * Forces are sampled once per chain at the target of its root, and the same acceleration is applied to every link of the chain,
+	 * so links along a long chain don't feel the falloff of a radial force or the gust front separately. Chains keep awake while they are pushed.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Forces)
+	bool bEnableExternalForces;
+
+	/**
+	 * Acceleration in cm/s^2 per unit of wind speed. Wind directional sources blow at a speed of 0.1 by default.
+	 * The sources are blended once per component at the center of its bounds, and each chain samples the gusts once at its root.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Forces, meta = (ClampMin = "0.0"))
+	float WindScale;
+
+	/** Scales accelerations of radial forces like explosions */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = Forces, meta = (ClampMin = "0.0"))
+	float RadialForceScale;
+
 private:
 
 	/** Internal use - Fixed timestep divided by SimulationFPS */
@@ -194,8 +329,90 @@ private:
 	/** Internal use - Amount of time we need to simulate. */
 	float RemainingTime;
 
-	/**  info array of all chains including bone indices and previous bone positions */
-	TArray<FChainInfo> ChainInfos;
+	/** Internal use - Current LOD tier */
+	TEnumAsByte<ESoftBoneLODTier::Type> LODTier;
+
+	/** Internal use - Weight of the simulated pose against the animated pose. Blends to 0 when frozen. */
+	float SimulationWeight;
+
+	/** Internal use - Component to world transform from the anim instance proxy, cached on update so evaluation never reads the component */
+	FTransform CachedComponentToWorld;
+
+	/** Internal use - Component to world transform of the last evaluation */
+	FTransform PrevComponentToWorld;
+
+	/** Internal use - Transforms between component space and the space chains are simulated in for the current evaluation */
+	FTransform ComponentToSimulation;
+	FTransform SimulationToComponent;
+
+	/** Internal use - Gravity in simulation space */
+	FVector SimulationSpaceGravity;
+
+	/** Internal use - true if ComponentToSimulation is not identity */
+	bool bSimulationInWorldSpace;
+
+	/** Internal use - Space of simulated links */
+	bool bChainsInComponentSpace;
+
+	/** Internal use - Weight settings the weight tables of ChainTemplate were baked with. Another template is picked when they change. */
+	TEnumAsByte<ERestoringWeight::Type> BakedWeightType;
+	bool bBakedWithWeightCurve;
+
+	/** Internal use - Stiffness the restoring weights of the simulated links have been scaled with */
+	float AppliedStiffness;
+
+	/** Bone indices, link ranges and weight tables of all chains, shared with all nodes of the same mesh LOD and settings */
+	TSharedPtr<const FSoftBoneChainTemplate, ESPMode::ThreadSafe> ChainTemplate;
+
+	/** Mesh the bone indices of ChainTemplate were gathered from. LinkKeys are only comparable on the same mesh. */
+	TWeakObjectPtr<UObject> ChainsAsset;
+
+	/**
+	 * Chains and links from before required bones changed, e.g. by a LOD switch. Kept until the chains are initialized again
+	 * and the links which still exist continue from their simulated state.
+	 */
+	TSharedPtr<const FSoftBoneChainTemplate, ESPMode::ThreadSafe> PreviousChainTemplate;
+	FSoftBoneChainState PreviousState;
+	FSoftBoneVectorStream PreviousTargetPositions;
+
+	/** Simulated links and targets of all chains in simulation space. All chains are advanced together with one sub step clock. */
+	FSoftBoneSimulationInstance Simulation;
+
+	/**
+	 * Per link buffers below are only needed while the node is evaluated. They are empty in between evaluations,
+	 * and exchanged with buffers of the evaluating thread by AcquireEvaluationBuffers and ReleaseEvaluationBuffers.
+	 */
+	friend class FSoftBoneEvaluationScratch;
+
+	/** Drives the node on a transient skeleton without an anim instance in the automation tests */
+	friend class FSoftBoneNodeTestDriver;
+
+	/** Position of links in simulation space for rendering. */
+	TArray<FVector> RenderPositions;
+
+	/** Current Position of links in component space */
+	TArray<FVector> PositionsInCS;
+
+	/** Direction from each link to its child on the animated pose in component space, gathered with the targets */
+	FSoftBoneVectorStream RestDirections;
+
+	/** Direction from each link to its child on the simulated pose in component space */
+	FSoftBoneVectorStream SimulatedDirections;
+
+	/** Rotations from RestDirections to SimulatedDirections of all links, computed in one batch */
+	FSoftBoneQuatStream DeltaRotations;
+
+	/**
+	 * Bones of the last awake frame per bone transform, reused while chains are sleeping.
+	 * Only kept while sleeping is enabled and the state isn't compact, empty otherwise.
+	 */
+	TArray<FVector> CachedPositionsInCS;
+	TArray<FQuat> CachedDeltaRotations;
+
+#if WITH_EDITOR
+	/** RenderPositions of the last evaluation for the preview of the anim graph node */
+	TArray<FVector> EditorRenderPositions;
+#endif // #if WITH_EDITOR
 
 protected:
 	virtual void UpdateInternal(const FAnimationUpdateContext& Context) override;
@@ -213,11 +430,25 @@ public:
 	virtual bool IsValidToEvaluate(const USkeleton* Skeleton, const FBoneContainer& RequiredBones) override;
 	// End of FAnimNode_SkeletalControlBase interface
 
+	/** Heap memory of links and per link buffers kept in between evaluations. Buffers shared by the evaluating thread aren't included. */
+	SIZE_T GetAllocatedSize() const;
+
+	/** Heap memory of the evaluation buffers shared by nodes evaluated on the calling thread, including the expanded links of compact nodes */
+	static SIZE_T GetThreadScratchSize();
+
 #if WITH_EDITOR
+	/** Fills WeightCurve with the preset of RestoringWeightType when it's picked in the editor. Custom curves are kept. */
 	void InitialzeWeightCurve();
+
 	const TArray<FChainInfo>& GetChainInfos() const
 	{
-		return ChainInfos;
+		return GetChains();
+	}
+
+	/** Rendered link positions of all chains, use LinkOffset and NumLinks of FChainInfo to find links of a chain */
+	const TArray<FVector>& GetRenderPositions() const
+	{
+		return EditorRenderPositions;
 	}
 #endif // #if WITH_EDITOR
 
@@ -226,22 +457,130 @@ private:
 	virtual void InitializeBoneReferences(const FBoneContainer& RequiredBones) override;
 	// End of FAnimNode_SkeletalControlBase interface
 
+	/** Picks the chain template of the current mesh LOD and resets the simulation */
 	void InitializeBoneIndices(FCSPose<FCompactPose>& MeshBases);
-	void InitializeChain(FChainInfo& Chain, USkeletalMeshComponent* SkelComp, FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms, int32 OutTransformStartIndex);
-	void InitializeChains(USkeletalMeshComponent* SkelComp, FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms);
+	void InitializeChain(const FChainInfo& Chain, FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms);
+	void InitializeChains(FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms);
+
+	/** Returns the shared template of the current bones and settings. Only the first node of a configuration walks the hierarchy and bakes weights. */
+	TSharedRef<const FSoftBoneChainTemplate, ESPMode::ThreadSafe> FindOrBuildChainTemplate(FCSPose<FCompactPose>& MeshBases) const;
+
+	/**
+	 * Curve the weight tables are baked with. Presets are built into PresetCurve, so they never touch WeightCurve
+	 * while animation is evaluated, and WeightCurve is only used by RW_Custom.
+	 */
+	const FRichCurve& GetRestoringWeightCurve(FRichCurve& PresetCurve) const;
+
+	/** Bakes Chain.WeightTable from Curve, or from the depth of each link if bUseWeightCurve is false */
+	void BakeWeightTable(FChainInfo& Chain, const FRichCurve& Curve) const;
 
-	float SimulateSoftBoneChain(FChainInfo& Chain, USkeletalMeshComponent* SkelComp, FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms, int32 OutTransformStartIndex, float InRemainingTime);
+	/** Chains of ChainTemplate, empty until the bone indices are initialized */
+	const TArray<FChainInfo>& GetChains() const;
 
-	void ComputeTargetPositions(FChainInfo& Chain, USkeletalMeshComponent* SkelComp, FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms, int32 OutTransformStartIndex, TArray<FVector>& TargetPositions);
-	void TimeIntegration(FChainInfo& Chain, float TimeDelta, TArray<FVector>& TargetPositions);
+	/**
+	 * Applies parameters which may be driven every frame to the simulated links without touching their state.
+	 * Weight tables are baked again only when the weight settings change, otherwise Stiffness just scales them.
+	 */
+	void UpdateRestoringWeights(FCSPose<FCompactPose>& MeshBases);
 
-	// make the final positions by pulling simulated positions to destinations
-	void PullBonesToFinalPosition(TArray<FSoftBoneLink>& PrevBoneLinks, FVector& DiffVec);
+	/**
+	 * Continues Chain from the previous chain of the same root. An unchanged chain is copied as a whole,
+	 * otherwise the dynamic state of links which still exist is copied over the freshly initialized chain.
+	 * Returns false if there was no previous chain, so Chain has to be initialized from the pose.
+	 */
+	bool RestorePreviousChain(const FChainInfo& Chain, FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms);
+
+	/** Moves the current simulated links from Simulation to the previous ones to be remapped by InitializeChains */
+	void KeepPreviousChains();
+
+	/** Drops the previous links, e.g. when the mesh has changed */
+	void ResetPreviousChains();
+
+	/** Moves simulated links and interpolated targets, including the kept previous ones, rigidly by Transform */
+	void TransformSimulatedLinks(const FTransform& Transform);
+
+	/** Simulate all chains with one sub step loop and write the results to OutBoneTransforms */
+	void SimulateSoftBoneChains(FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms);
+
+	/** bWorldSpace should match bSimulationInWorldSpace, so the conversion of each bone is resolved at compile time */
+	template <bool bWorldSpace>
+	void ComputeTargetPositions(const FChainInfo& Chain, FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms, FSoftBoneVectorStream& OutTargetPositions);
+
+	/** Moves bones of an awake chain to RenderPositions in component space and gathers SimulatedDirections. bWorldSpace as above. */
+	template <bool bWorldSpace>
+	void UpdateBonePositions(const FChainInfo& Chain, TArray<FBoneTransform>& OutBoneTransforms);
+
+	/** Make sure targets and sleep buffers match the simulated links. Returns true if the interpolated targets had to be reallocated. */
+	bool UpdateScratchBuffers();
+
+	/** Swaps the per link evaluation buffers with the ones of the calling thread and sizes them for the links of ChainTemplate */
+	void AcquireEvaluationBuffers();
+
+	/** Hands the evaluation buffers back to the calling thread */
+	void ReleaseEvaluationBuffers();
+
+	/** Samples external forces into the links of the simulation. Returns true if any chain is pushed. */
+	bool UpdateExternalForces();
+
+	/** Accumulates the time to simulate, caches the component transform and picks the time step of the LOD tier. All of the update which doesn't need the anim instance. */
+	void UpdateSimulationTime(float DeltaTime, const FTransform& ComponentToWorld);
+
+	/** Select LOD tier, blend simulation weight and rank the instance for the frame budget. Called on update. */
+	void UpdateLOD(float DeltaTime);
+
+	/** Distance is to the closest view and ScreenSize is the ratio of the bounds radius to it. Not rendered components use at least NotRenderedLODTier. */
+	ESoftBoneLODTier::Type ComputeLODTier(float Distance, float ScreenSize, bool bRecentlyRendered) const;
+
+	/** Remove all simulated links. They are initialized again on the next evaluation. */
+	void ResetSimulation();
+
+	/** Output bone transforms of a sleeping chain from the cached result */
+	void ApplyCachedBoneTransforms(const FChainInfo& Chain, TArray<FBoneTransform>& OutBoneTransforms) const;
+
+	/** true if Chain is sleeping and its bones of the last awake frame are cached */
+	bool IsUsingCachedBones(const FChainInfo& Chain) const
+	{
+		return CachedDeltaRotations.Num() > 0 && Simulation.State.Chains[Chain.RangeIndex].bSleeping;
+	}
+
+	FSoftBoneSleepParams GetSleepParams() const;
+
+	/** Gather solver parameters from node properties */
+	FSoftBoneSolverParams GetSolverParams() const;
+
+	/** Update simulation space transforms and move simulated links along with the component when simulating in component space */
+	void UpdateSimulationSpace(const FTransform& ComponentToWorld);
+
+	/** Moves colliders with their bones on the animated pose into Simulation.Colliders in simulation space */
+	void UpdateColliders(FCSPose<FCompactPose>& MeshBases);
+
+	FORCEINLINE FVector ToSimulationSpace(const FVector& PositionInCS) const
+	{
+		return bSimulationInWorldSpace ? ComponentToSimulation.TransformPosition(PositionInCS) : PositionInCS;
+	}
+
+	FORCEINLINE FVector ToComponentSpace(const FVector& PositionInSimulationSpace) const
+	{
+		return bSimulationInWorldSpace ? SimulationToComponent.TransformPosition(PositionInSimulationSpace) : PositionInSimulationSpace;
+	}
+
+	/** Conversions for loops over bones, bWorldSpace should match bSimulationInWorldSpace */
+	template <bool bWorldSpace>
+	FORCEINLINE FVector ToSimulationSpace(const FVector& PositionInCS) const
+	{
+		return bWorldSpace ? ComponentToSimulation.TransformPosition(PositionInCS) : PositionInCS;
+	}
+
+	template <bool bWorldSpace>
+	FORCEINLINE FVector ToComponentSpace(const FVector& PositionInSimulationSpace) const
+	{
+		return bWorldSpace ? SimulationToComponent.TransformPosition(PositionInSimulationSpace) : PositionInSimulationSpace;
+	}
 
-	// re-orientation of bone local axes after translation calculation
-	void ReOrientBoneRotations(FChainInfo& Chain, FCSPose<FCompactPose>& MeshBases, TArray<FBoneTransform>& OutBoneTransforms, int32 OutTransformStartIndex);
+	// re-orientation of bone local axes after translation calculation, applies DeltaRotations of the chain
+	void ReOrientBoneRotations(const FChainInfo& Chain, TArray<FBoneTransform>& OutBoneTransforms);
 
 #if WITH_EDITOR
-	void DrawDebugData(UWorld* World, TArray<FSoftBoneLink>& PrevBoneLinks, TArray<FVector>& TargetPositions);
+	void DrawDebugData(const FTransform& ComponentToWorld);
 #endif // #if WITH_EDITOR
 };
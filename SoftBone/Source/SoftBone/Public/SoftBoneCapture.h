@@ -0,0 +1,70 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "SoftBoneSolver.h"
+
+struct FSoftBoneSimulationInstance;
+
+/**
+ *	Record and replay of solver inputs.
+ *	While SoftBone.Capture is set, every simulation instance streams what goes into FSoftBoneSolver::Simulate to its own binary file
+ *	in Saved/SoftBone/Captures. SoftBone.Replay feeds such a file back through the solver without a world or a skeletal mesh,
+ *	so frame spikes of real gameplay can be profiled, bisected and compared between solver versions.
+ */
+
+/** What the node saw in the frame its targets were gathered. Stored along with the solver inputs for reference. */
+struct FSoftBoneCaptureContext
+{
+	FTransform ComponentToWorld;
+	float DeltaTime;
+	float GravityZ;
+
+	FSoftBoneCaptureContext()
+		: ComponentToWorld(FTransform::Identity)
+		, DeltaTime(0.f)
+		, GravityZ(0.f)
+	{
+	}
+};
+
+/**
+ * Writes the capture file of one simulation instance.
+ * Frames only store what the solver reads every frame, i.e. targets, time, parameters, colliders and external accelerations.
+ * Whole links are stored as keyframes only when something else than the solver changed them since the last frame,
+ * e.g. when chains are initialized, moved along with the component or woken up.
+ * Instances with a compact state are quantized in between frames, so they store a keyframe in every frame.
+ */
+class SOFTBONE_API FSoftBoneCaptureWriter
+{
+public:
+	/** Opens a new file named after OwnerName */
+	explicit FSoftBoneCaptureWriter(const FName& OwnerName);
+
+	/** Ends and closes the file */
+	~FSoftBoneCaptureWriter();
+
+	bool IsOpen() const
+	{
+		return Archive != nullptr;
+	}
+
+	/** Called right before Instance is simulated. Writes a keyframe if its links changed since the last frame. */
+	void BeginFrame(FSoftBoneSimulationInstance& Instance);
+
+	/** Called right after Instance has been simulated. Writes the inputs of the frame and a checksum of the result. */
+	void EndFrame(FSoftBoneSimulationInstance& Instance);
+
+	/** true while SoftBone.Capture is set */
+	static bool IsCaptureEnabled();
+
+private:
+	FArchive* Archive;
+
+	/** Checksum of the links right after the last frame, the next frame writes a keyframe if it doesn't match anymore */
+	uint32 LastStateCrc;
+	bool bHasKeyframe;
+
+	/** Time to simulate handed to the solver in the current frame */
+	float TimeToSimulate;
+};
@@ -0,0 +1,143 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "BoneContainer.h"
+
+/**
+ *	Immutable chain data shared by all SoftBone nodes of the same configuration.
+ *	Bone paths, link layout and baked weight tables only depend on the mesh, its required bones and a few node settings,
+ *	so they are built once and nodes keep a reference. Instances only own their simulated links.
+ */
+
+/** A tree of bones under one root bone. Simple chains are trees with one leaf. */
+struct FChainInfo
+{
+	/** stored bone indices when initializing, sorted parent first */
+	TArray<FCompactPoseBoneIndex> BoneIndices;
+
+	/**
+	 * Parent of each link within the chain, INDEX_NONE for the root.
+	 * The first links match BoneIndices, followed by a virtual tip link per leaf bone if bAllowTipBoneRotation is true.
+	 */
+	TArray<int32> ParentIndices;
+
+	/** Link each bone turns toward, its first child or its virtual tip link. INDEX_NONE if the bone keeps the animated rotation. */
+	TArray<int32> AimIndices;
+
+	/**
+	 * Identifies each link independent of the LOD, twice the mesh bone index of its bone, plus one for a virtual tip link of that bone.
+	 * Links of the same key keep their simulated state when bones are initialized again.
+	 */
+	TArray<int32> LinkKeys;
+
+	/** Restoring weight of each link at Stiffness 1, baked from the weight curve. Stiffness only scales it, so it can change every frame. */
+	TArray<float> WeightTable;
+
+	/** Index of the root link of this chain in the simulation state shared by all chains */
+	int32 LinkOffset;
+
+	/** Num of links should be same as Num of ParentIndices */
+	int32 NumLinks;
+
+	/** Index of the root bone transform in OutBoneTransforms */
+	int32 TransformOffset;
+
+	/** Index of this chain in FSoftBoneChainState::Chains, INDEX_NONE if not simulated */
+	int32 RangeIndex;
+
+	FChainInfo()
+		: LinkOffset(0)
+		, NumLinks(0)
+		, TransformOffset(0)
+		, RangeIndex(INDEX_NONE)
+	{
+	}
+
+	void Empty()
+	{
+		BoneIndices.Empty();
+		ParentIndices.Empty();
+		AimIndices.Empty();
+		LinkKeys.Empty();
+		WeightTable.Empty();
+		LinkOffset = 0;
+		NumLinks = 0;
+		TransformOffset = 0;
+		RangeIndex = INDEX_NONE;
+	}
+};
+
+
+/** Everything the chains of a template are built from. Templates are shared by nodes with equal keys. */
+struct SOFTBONE_API FSoftBoneChainTemplateKey
+{
+	/** Mesh the bone indices are gathered from */
+	TWeakObjectPtr<UObject> Asset;
+
+	/** Bones of the current LOD, compact pose indices depend on them */
+	TArray<FBoneIndexType> RequiredBones;
+
+	/** Root and tip bone of each pair in the order of the node, the main pair first */
+	TArray<FName> RootBoneNames;
+	TArray<FName> TipBoneNames;
+
+	bool bAllowTipBoneRotation;
+
+	/** Weight settings the weight tables are baked with. Keys of the curve are only set if bUseWeightCurve is true. */
+	bool bUseWeightCurve;
+	TArray<FRichCurveKey> WeightKeys;
+
+	/** Hash of all of the above, set by UpdateHash */
+	uint32 Hash;
+
+	FSoftBoneChainTemplateKey()
+		: bAllowTipBoneRotation(true)
+		, bUseWeightCurve(true)
+		, Hash(0)
+	{
+	}
+
+	/** Call after all members have been set */
+	void UpdateHash();
+
+	bool operator==(const FSoftBoneChainTemplateKey& Other) const;
+};
+
+/**
+ * Chains of a node for one mesh LOD with their link ranges and weight tables, as laid out in FSoftBoneChainState.
+ * Never changed once registered. Nodes switching LOD or weight settings move to another template.
+ */
+struct SOFTBONE_API FSoftBoneChainTemplate
+{
+	FSoftBoneChainTemplateKey Key;
+
+	/** Chains sorted by root bone, links of each chain follow the links of the previous one */
+	TArray<FChainInfo> Chains;
+
+	/** Links and bone transforms of all chains */
+	int32 NumLinks;
+	int32 NumTransforms;
+
+	explicit FSoftBoneChainTemplate(const FSoftBoneChainTemplateKey& InKey);
+	~FSoftBoneChainTemplate();
+
+	/** Heap memory of the chains */
+	SIZE_T GetAllocatedSize() const;
+
+	/** Returns the registered template of Key, or null if there isn't any alive. Thread safe. */
+	static TSharedPtr<const FSoftBoneChainTemplate, ESPMode::ThreadSafe> Find(const FSoftBoneChainTemplateKey& Key);
+
+	/**
+	 * Shares a template whose chains have been built. If another thread registered the same key in the meantime, that one is returned instead.
+	 * Templates are unregistered when the last node lets go of them. Thread safe.
+	 */
+	static TSharedRef<const FSoftBoneChainTemplate, ESPMode::ThreadSafe> Register(const TSharedRef<FSoftBoneChainTemplate, ESPMode::ThreadSafe>& Template);
+
+	/** Number of templates alive */
+	static int32 GetNumTemplates();
+
+private:
+	/** Memory counted in the stats when registered */
+	SIZE_T RegisteredSize;
+};
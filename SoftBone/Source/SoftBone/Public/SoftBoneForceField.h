@@ -0,0 +1,168 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "SoftBoneSolver.h"
+
+/**
+ *	External forces like wind and explosions.
+ *	Each world has one force field which its manager updates on the game thread and shares again when its forces change. Nodes sample it once per chain
+ *	at the root of the chain, and the solver applies the samples as accelerations of all links in its vectorized integration,
+ *	so the cost of a force source doesn't grow with the number of links or sub steps.
+ */
+
+/** Wind at a component from the wind sources of its scene. Gusts add up to MaxGust to Speed. */
+struct FSoftBoneWind
+{
+	FVector Direction;
+	float Speed;
+	float MinGust;
+	float MaxGust;
+
+	/** Time of the force field when the wind was computed, drives the gusts */
+	float GustTime;
+
+	FSoftBoneWind()
+		: Direction(FVector::ZeroVector)
+		, Speed(0.f)
+		, MinGust(0.f)
+		, MaxGust(0.f)
+		, GustTime(0.f)
+	{
+	}
+
+	bool IsZero() const
+	{
+		return Direction.IsZero() || (Speed <= 0.f && MaxGust <= 0.f);
+	}
+};
+
+/**
+ * Wind directional source of the world, copied from its component on the game thread.
+ * The scene keeps its own copies for the render thread, which can't be read while the game thread runs.
+ */
+struct FSoftBoneWindSource
+{
+	FVector Position;
+	FVector Direction;
+
+	/** Weight of the source when the wind of several sources is blended */
+	float Strength;
+	float Speed;
+	float MinGust;
+	float MaxGust;
+
+	/** Point sources blow away from Position within Radius, directional ones blow along Direction everywhere */
+	float Radius;
+	bool bPointSource;
+
+	FSoftBoneWindSource()
+		: Position(FVector::ZeroVector)
+		, Direction(FVector::ZeroVector)
+		, Strength(0.f)
+		, Speed(0.f)
+		, MinGust(0.f)
+		, MaxGust(0.f)
+		, Radius(0.f)
+		, bPointSource(false)
+	{
+	}
+
+	bool operator==(const FSoftBoneWindSource& Other) const
+	{
+		return Position == Other.Position && Direction == Other.Direction && Strength == Other.Strength && Speed == Other.Speed
+			&& MinGust == Other.MinGust && MaxGust == Other.MaxGust && Radius == Other.Radius && bPointSource == Other.bPointSource;
+	}
+};
+
+/** Radial force like an explosion. Pushes links away from Origin, fading out linearly toward Radius and over Duration. */
+struct FSoftBoneRadialForce
+{
+	FVector Origin;
+	float Radius;
+
+	/** Acceleration at the origin in cm/s^2 */
+	float Strength;
+
+	/** Seconds the force lasts, 0 for one frame */
+	float Duration;
+
+	/** Seconds since the force has been added */
+	float Age;
+
+	FSoftBoneRadialForce()
+		: Origin(FVector::ZeroVector)
+		, Radius(0.f)
+		, Strength(0.f)
+		, Duration(0.f)
+		, Age(0.f)
+	{
+	}
+
+	FSoftBoneRadialForce(const FVector& InOrigin, float InRadius, float InStrength, float InDuration)
+		: Origin(InOrigin)
+		, Radius(InRadius)
+		, Strength(InStrength)
+		, Duration(InDuration)
+		, Age(0.f)
+	{
+	}
+};
+
+/** How a node responds to the force field */
+struct FSoftBoneForceScales
+{
+	/** Acceleration in cm/s^2 per unit of wind speed */
+	float Wind;
+
+	/** Scales accelerations of radial forces */
+	float Radial;
+
+	FSoftBoneForceScales()
+		: Wind(0.f)
+		, Radial(0.f)
+	{
+	}
+};
+
+/**
+ * Snapshot of the forces of a world. Immutable once the manager has shared it, so it can be sampled on any thread.
+ * Gusts move with the time of the wind gathered every frame, so a field of steady wind sources is shared only once.
+ */
+class SOFTBONE_API FSoftBoneForceField
+{
+public:
+	/** Seconds the field has been running wrapped to the gust period, copied into the wind computed from the field */
+	float Time;
+
+	TArray<FSoftBoneWindSource> WindSources;
+
+	TArray<FSoftBoneRadialForce> RadialForces;
+
+	FSoftBoneForceField()
+		: Time(0.f)
+	{
+	}
+
+	/** Moves gusts along and ages radial forces, removing the ones which have run out */
+	void Advance(float DeltaTime);
+
+	/** true if there is nothing to push links */
+	bool IsEmpty() const
+	{
+		return WindSources.Num() == 0 && RadialForces.Num() == 0;
+	}
+
+	/** Wind of WindSources at Position at the current Time, blended by their strengths the same way the scene blends the wind for rendering */
+	FSoftBoneWind ComputeWind(const FVector& Position) const;
+
+	/** Acceleration in world space at Position. Gusts travel along the wind from its GustTime, so neighbor chains sway with a delay. */
+	FVector Sample(const FVector& Position, const FSoftBoneWind& Wind, const FSoftBoneForceScales& Scales) const;
+
+	/**
+	 * Samples once per chain at the target of its root and writes the acceleration to every link of the chain in simulation space.
+	 * Targets are in simulation space, SimulationToWorld maps them into the field. OutAccelerations is resized to the links of State.
+	 * @return true if any chain got an acceleration
+	 */
+	bool SampleChains(const FSoftBoneChainState& State, const FSoftBoneVectorStream& TargetPositions, const FTransform& SimulationToWorld, const FSoftBoneWind& Wind, const FSoftBoneForceScales& Scales, FSoftBoneVectorStream& OutAccelerations) const;
+};
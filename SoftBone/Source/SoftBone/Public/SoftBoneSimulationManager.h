@@ -0,0 +1,352 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "SoftBoneSolver.h"
+#include "SoftBoneCapture.h"
+#include "SoftBoneForceField.h"
+
+/**
+ *	Batches the simulation of all SoftBone instances of a world.
+ *	Instances gather their targets during animation evaluation and the manager advances all of them at once
+ *	at the end of the frame with one ParallelFor, so a crowd is solved in a few large batches instead of many small ones.
+ *	The manager is also the game thread side of its instances. It gathers what they need from the world and their component
+ *	and draws their debug shapes, so nodes never touch UObjects while they are evaluated on worker threads.
+ */
+
+class FSoftBoneSimulationManager;
+class USkeletalMeshComponent;
+class UWindDirectionalSourceComponent;
+
+/** World and component data of an instance, gathered by its manager on the game thread at the end of each frame */
+struct SOFTBONE_API FSoftBoneGameThreadData
+{
+	/** From the world and its settings, the default gravity of the project until the instance has a manager */
+	float GravityZ;
+	float TimeDilation;
+
+	/** Distance from the closest view rendered last frame to the bounds of the component, 0 if nothing has been rendered */
+	float ViewDistance;
+
+	float BoundsRadius;
+	bool bRecentlyRendered;
+
+	/** Wind of the world at the bounds of the component, only gathered for instances using external forces */
+	FSoftBoneWind Wind;
+
+	/** Forces of the world, shared by all instances of the manager. Null while the world has no forces or no instance uses them. */
+	TSharedPtr<const FSoftBoneForceField, ESPMode::ThreadSafe> ForceField;
+
+	FSoftBoneGameThreadData();
+};
+
+#if WITH_EDITOR
+/** Debug shape queued during evaluation and drawn by the manager on the game thread */
+struct FSoftBoneDebugShape
+{
+	enum EType
+	{
+		Line,
+		Box,
+		Sphere,
+		Capsule,
+	};
+
+	EType Type;
+
+	/** Ends of lines and capsules, centers of boxes and spheres in world space */
+	FVector Start;
+	FVector End;
+
+	/** Radius of spheres and capsules, half size of boxes, thickness of lines */
+	float Size;
+
+	FColor Color;
+
+	FSoftBoneDebugShape(EType InType, const FVector& InStart, const FVector& InEnd, float InSize, const FColor& InColor)
+		: Type(InType)
+		, Start(InStart)
+		, End(InEnd)
+		, Size(InSize)
+		, Color(InColor)
+	{
+	}
+};
+#endif // #if WITH_EDITOR
+
+/** Simulated chains of one SoftBone node and everything needed to advance them without the node */
+struct SOFTBONE_API FSoftBoneSimulationInstance
+{
+	/** Simulated links of all chains of the node */
+	FSoftBoneChainState State;
+
+	/** Target positions gathered from the animated pose */
+	FSoftBoneVectorStream FinalTargetPositions;
+
+	/** Targets interpolated to the time of State, moved along with the links */
+	FSoftBoneVectorStream TargetPositions;
+
+	/** Targets of the last frame, or the ones sleeping chains fell asleep with. Empty while sleeping is disabled. */
+	FSoftBoneVectorStream ReferenceTargetPositions;
+
+	FSoftBoneSolverParams Params;
+
+	/** Colliders in simulation space, Params points to them while simulating */
+	TArray<FSoftBoneCollider> Colliders;
+
+	/** Acceleration of each link from external forces in simulation space, sampled once per chain. Empty without external forces. */
+	FSoftBoneVectorStream ExternalAccelerations;
+
+	/** Amount of time which is not simulated yet */
+	float RemainingTime;
+
+	float FixedTimeStep;
+	bool bFixedTimeStep;
+
+	/** Set when targets are gathered and cleared when the instance has been simulated */
+	bool bPendingSimulation;
+
+	/** true once queued for registration or registered to any manager */
+	bool bRegistered;
+
+	/** If true, the manager blends the wind sources of the world at the component */
+	bool bUseExternalForces;
+
+	/** Manager of the world of the component, set when registered */
+	FSoftBoneSimulationManager* Manager;
+
+	/** Component the node is evaluated for, only read by the manager on the game thread */
+	TWeakObjectPtr<const USkeletalMeshComponent> Component;
+
+	/** World and component data of the last frame, safe to read while evaluating on any thread */
+	FSoftBoneGameThreadData GameThreadData;
+
+	/** How much the instance matters, e.g. its screen size. Ranks instances when the frame budget runs out. */
+	float Significance;
+
+	/** Time spent in the last Simulate in seconds */
+	float LastSimulationTime;
+
+	/** Number of budget allocations in a row which deferred the instance. Raises its priority, so all instances get their turn. */
+	int32 NumDeferredFrames;
+
+	/** Set when the instance has been evaluated and cleared by the next budget allocation */
+	bool bActive;
+
+	/** If true, the instance should not be simulated this frame and its time keeps accumulating in RemainingTime */
+	bool bBudgetDeferred;
+
+	/**
+	 * If true, links are kept in CompactState in between evaluations, and all per link streams of the instance are empty.
+	 * They are expanded into buffers of the evaluating thread only while the instance is evaluated or simulated.
+	 */
+	bool bCompactState;
+
+	/**
+	 * Quantized links, targets and accelerations while the state is released.
+	 * Final targets are only kept while the manager is about to simulate the instance, evaluations gather them again.
+	 */
+	FSoftBoneCompactChainState CompactState;
+
+	/** true in between ExpandState and ReleaseState */
+	bool bStateExpanded;
+
+	/** Name of the capture file while SoftBone.Capture is set, e.g. the owning component */
+	FName OwnerName;
+
+	/** Frame data stored in captures along with the solver inputs */
+	FSoftBoneCaptureContext CaptureContext;
+
+	/** Open while SoftBone.Capture is set */
+	TSharedPtr<FSoftBoneCaptureWriter> CaptureWriter;
+
+	FSoftBoneSimulationInstance();
+	~FSoftBoneSimulationInstance();
+
+	/**
+	 * Nodes are copied along with their instance, but managers hold instances by address.
+	 * Copies are neither registered nor pending and open their own capture, the node registers them again when it's initialized.
+	 */
+	FSoftBoneSimulationInstance(const FSoftBoneSimulationInstance& Other);
+	FSoftBoneSimulationInstance& operator=(const FSoftBoneSimulationInstance& Other);
+
+	/** Advances all chains by RemainingTime */
+	void Simulate();
+
+	/** Restores per link streams from CompactState into buffers of the calling thread. Without bCompactState, released links are restored into the instance for good. */
+	void ExpandState();
+
+	/** Compresses per link streams back into CompactState and hands their buffers back to the calling thread */
+	void ReleaseState();
+
+	/** Heap memory of links, targets and accelerations kept by the instance in between evaluations */
+	SIZE_T GetAllocatedSize() const
+	{
+		return State.GetAllocatedSize() + FinalTargetPositions.GetAllocatedSize() + TargetPositions.GetAllocatedSize() + ReferenceTargetPositions.GetAllocatedSize()
+			+ ExternalAccelerations.GetAllocatedSize() + CompactState.GetAllocatedSize();
+	}
+
+	/** Heap memory of the buffers compact instances are expanded into on the calling thread */
+	static SIZE_T GetThreadScratchSize();
+
+	int32 GetNumChains() const
+	{
+		return (bStateExpanded || CompactState.Num() == 0) ? State.Chains.Num() : CompactState.Chains.Num();
+	}
+
+	int32 GetNumSleepingChains() const
+	{
+		return (bStateExpanded || CompactState.Num() == 0) ? State.NumSleepingChains : CompactState.NumSleepingChains;
+	}
+};
+
+class SOFTBONE_API FSoftBoneSimulationManager
+{
+public:
+	/** Managers without a world are not ticked. Call SimulatePendingInstances manually. */
+	explicit FSoftBoneSimulationManager(UWorld* InWorld = nullptr);
+	~FSoftBoneSimulationManager();
+
+	/** Returns the manager of World and creates it if needed. Thread safe. */
+	static FSoftBoneSimulationManager* Get(UWorld* World);
+
+	/** Destroys the manager of World */
+	static void OnWorldCleanup(UWorld* World, bool bSessionEnded, bool bCleanupResources);
+
+	/** Destroys managers of all worlds */
+	static void DestroyAll();
+
+	/** Ticks the manager of World once all tick groups of the world have run, see Tick */
+	static void OnWorldPostActorTick(UWorld* World, ELevelTick TickType, float DeltaSeconds);
+
+	/**
+	 * Thread safe. Registers Instance to the manager of the world of its Component on the game thread, after the next world tick.
+	 * Until then, the instance simulates on its own with default game thread data.
+	 */
+	static void QueueRegistration(FSoftBoneSimulationInstance* Instance);
+
+	/** Registers all queued instances, creating the managers of their worlds if needed. Game thread only. */
+	static void RegisterQueuedInstances();
+
+	/** Thread safe. Instances stay registered until they are destroyed. On the game thread, their game thread data is gathered right away. */
+	void Register(FSoftBoneSimulationInstance* Instance);
+	void Unregister(FSoftBoneSimulationInstance* Instance);
+
+	/** Thread safe. true if Instance is in the list of this manager. */
+	bool IsRegistered(const FSoftBoneSimulationInstance* Instance) const;
+
+	/** Removes Instance from all managers and the registration queue. Called when an instance is destroyed. */
+	static void UnregisterFromAll(FSoftBoneSimulationInstance* Instance);
+
+	/** Simulates all registered instances waiting for simulation in one batch */
+	void SimulatePendingInstances();
+
+	/**
+	 * Ranks instances evaluated since the last allocation by significance and the number of frames they have been waiting,
+	 * then lets the most important ones simulate in the next frame until their last costs add up to BudgetMs. The rest are deferred.
+	 * The most important instance is never deferred. If BudgetMs is not positive, no instance is deferred.
+	 */
+	void AllocateBudget(float BudgetMs);
+
+	/** Milliseconds of simulation per frame and world from SoftBone.FrameBudget, 0 if unlimited */
+	static float GetFrameBudget();
+
+	/** true if deferred instances should extrapolate their last state instead of holding it, from SoftBone.ExtrapolateDeferred */
+	static bool ShouldExtrapolateDeferred();
+
+	/** Gathers GameThreadData of all registered instances for their next evaluation. Game thread only. */
+	void UpdateGameThreadData();
+
+	/**
+	 * Adds a radial force like an explosion to the force field of the world. Instances using external forces feel it from the next frame
+	 * until it runs out after Duration seconds. Strength is the acceleration at Origin in cm/s^2. Game thread only.
+	 */
+	void AddRadialForce(const FVector& Origin, float Radius, float Strength, float Duration);
+
+	/**
+	 * Gathers the wind sources and shares the forces of this frame with the instances, if any of them uses external forces.
+	 * The last shared copy is kept as long as the forces don't change. Game thread only.
+	 */
+	void UpdateForceField(float DeltaTime);
+
+#if WITH_EDITOR
+	/** Thread safe. Shapes are drawn for one frame when the manager is ticked. */
+	void QueueDebugShapes(const TArray<FSoftBoneDebugShape>& Shapes);
+#endif // #if WITH_EDITOR
+
+	/** Number of instances deferred by the last budget allocation */
+	int32 GetNumDeferredInstances() const
+	{
+		return NumDeferredInstances;
+	}
+
+	/**
+	 * Simulates instances in parallel. Instances are independent, so each one is a work item of the ParallelFor.
+	 * If NumTasks is positive, instances are split into NumTasks contiguous slices instead, which limits the number of threads used.
+	 */
+	static void SimulateInstances(FSoftBoneSimulationInstance* const* Instances, int32 NumInstances, int32 NumTasks = 0);
+
+	int32 GetNumInstances() const
+	{
+		return Instances.Num();
+	}
+
+	UWorld* GetWorld() const
+	{
+		return World;
+	}
+
+	/**
+	 * Simulates the instances evaluated in this frame, allocates the budget of the next frame and gathers the data of the next evaluation.
+	 * Runs after the last tick group of the world, so components ticking late in the frame have gathered their targets by now.
+	 * Batched instances render the result of the previous batch, which is one frame behind their pose. Game thread only.
+	 */
+	void Tick(float DeltaTime);
+
+private:
+	UWorld* World;
+
+	/** Guards Instances, nodes register while animation is evaluated on worker threads */
+	mutable FCriticalSection InstancesLock;
+
+	TArray<FSoftBoneSimulationInstance*> Instances;
+
+	/** Scratch buffer for instances simulated in this batch */
+	TArray<FSoftBoneSimulationInstance*> PendingInstances;
+
+	/** Scratch buffer for instances ranked by the budget allocation */
+	TArray<FSoftBoneSimulationInstance*> ActiveInstances;
+
+	int32 NumDeferredInstances;
+
+	/** Gathers GameThreadData of Instance, needs the lock of the instances */
+	void UpdateGameThreadData(FSoftBoneSimulationInstance* Instance) const;
+
+	/** Forces of the next frame, only touched on the game thread */
+	FSoftBoneForceField ForceField;
+
+	/** Wind components of World, found again every few seconds instead of iterating all objects every frame */
+	TArray<TWeakObjectPtr<const UWindDirectionalSourceComponent>> WindComponents;
+
+	/** Seconds until WindComponents are found again */
+	float WindComponentsRefreshTime;
+
+	/** true if any registered instance uses external forces */
+	bool AnyInstanceUsesExternalForces() const;
+
+	/** Copies the wind sources of WindComponents into ForceField */
+	void GatherWindSources(float DeltaTime);
+
+	/** Copy of ForceField shared with the instances by the last UpdateForceField */
+	TSharedPtr<const FSoftBoneForceField, ESPMode::ThreadSafe> SharedForceField;
+
+#if WITH_EDITOR
+	/** Guards DebugShapes, nodes queue them while animation is evaluated on worker threads */
+	FCriticalSection DebugShapesLock;
+
+	TArray<FSoftBoneDebugShape> DebugShapes;
+
+	/** Draws and clears DebugShapes */
+	void DrawDebugShapes();
+#endif // #if WITH_EDITOR
+};
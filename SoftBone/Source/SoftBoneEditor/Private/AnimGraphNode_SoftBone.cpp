@@ -70,6 +70,7 @@ void UAnimGraphNode_SoftBone::CopyNodeDataFrom(const FAnimNode_Base* NewAnimNode
 	if (SoftBoneNode)
 	{
 		const TArray<FChainInfo>& Chains = SoftBoneNode->GetChainInfos();
+		const TArray<FVector>& RenderPositions = SoftBoneNode->GetRenderPositions();
 
 		int32 NumChains = Chains.Num();
 
@@ -77,30 +78,38 @@ void UAnimGraphNode_SoftBone::CopyNodeDataFrom(const FAnimNode_Base* NewAnimNode
 		{
 			BonePositionsArray.Empty();
 			BonePositionsArray.AddZeroed(NumChains);
+			BoneParentIndicesArray.Empty();
+			BoneParentIndicesArray.AddZeroed(NumChains);
 		}
 
 		for (int32 ChainIndex = 0; ChainIndex < NumChains; ChainIndex++)
 		{
 			TArray<FVector>& Positions = BonePositionsArray[ChainIndex];
+			TArray<int32>& ParentIndices = BoneParentIndicesArray[ChainIndex];
 
-			const TArray<FSoftBoneLink>& Links = Chains[ChainIndex].PrevBoneLinks;
-			int32 NumLinks = Links.Num();
+			const FChainInfo& Chain = Chains[ChainIndex];
 
-			// don't need to show a virtual link
-			if (SoftBoneNode->bAllowTipBoneRotation)
+			// don't need to show virtual links, they follow the bones
+			int32 NumLinks = Chain.BoneIndices.Num();
+
+			// links are not simulated yet
+			if (Chain.NumLinks == 0 || Chain.LinkOffset + NumLinks > RenderPositions.Num())
 			{
-				NumLinks = Links.Num() - 1;
+				NumLinks = 0;
 			}
 
 			if (Positions.Num() != NumLinks)
 			{
 				Positions.Empty();
 				Positions.AddUninitialized(NumLinks);
+				ParentIndices.Empty();
+				ParentIndices.AddUninitialized(NumLinks);
 			}
 
 			for (int32 PosIndex = 0; PosIndex < NumLinks; PosIndex++)
 			{
-				Positions[PosIndex] = Links[PosIndex].RenderPosition;
+				Positions[PosIndex] = RenderPositions[Chain.LinkOffset + PosIndex];
+				ParentIndices[PosIndex] = Chain.ParentIndices[PosIndex];
 			}
 		}
 	}
@@ -116,16 +125,17 @@ void UAnimGraphNode_SoftBone::Draw(FPrimitiveDrawInterface* PDI, USkeletalMeshCo
 	for (int32 ChainIndex = 0; ChainIndex < NumChains; ChainIndex++)
 	{
 		const TArray<FVector>& Positions = BonePositionsArray[ChainIndex];
+		const TArray<int32>& ParentIndices = BoneParentIndicesArray[ChainIndex];
 		int32 NumLinks = Positions.Num();
 
-		if (NumLinks > 0)
+		for (int32 Index = 0; Index < NumLinks; Index++)
 		{
-			PDI->DrawPoint(Positions[0], FColor::Red, 4.0f, SDPG_Foreground);
+			PDI->DrawPoint(Positions[Index], FColor::Red, 4.0f, SDPG_Foreground);
 
-			for (int32 Index = 1; Index < NumLinks; Index++)
+			// chains can branch, so each bone is connected to its parent
+			if (ParentIndices[Index] != INDEX_NONE)
 			{
-				PDI->DrawPoint(Positions[Index], FColor::Red, 4.0f, SDPG_Foreground);
-				PDI->DrawLine(Positions[Index - 1], Positions[Index], FColor::Red, SDPG_Foreground);
+				PDI->DrawLine(Positions[ParentIndices[Index]], Positions[Index], FColor::Red, SDPG_Foreground);
 			}
 		}
 	}
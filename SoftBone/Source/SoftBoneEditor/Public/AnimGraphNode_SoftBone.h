@@ -45,6 +45,9 @@ private:
 
 	/** To draw bone positions for debugging */
 	TArray<TArray<FVector>> BonePositionsArray;
+
+	/** Parent of each position in BonePositionsArray within its chain */
+	TArray<TArray<int32>> BoneParentIndicesArray;
 };
 
 #endif // #if WITH_EDITOR
\ No newline at end of file
@@ -0,0 +1,1582 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "SoftBoneSolver.h"
+
+DECLARE_CYCLE_STAT(TEXT("Simulate"), STAT_SoftBoneSimulate, STATGROUP_SoftBone);
+DECLARE_CYCLE_STAT(TEXT("Integration"), STAT_SoftBoneIntegration, STATGROUP_SoftBone);
+DECLARE_CYCLE_STAT(TEXT("Constraints"), STAT_SoftBoneConstraints, STATGROUP_SoftBone);
+DECLARE_CYCLE_STAT(TEXT("Collisions"), STAT_SoftBoneCollisions, STATGROUP_SoftBone);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Sub Steps"), STAT_SoftBoneSubSteps, STATGROUP_SoftBone);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Simulated Link Steps"), STAT_SoftBoneLinkSteps, STATGROUP_SoftBone);
+
+/////////////////////////////////////////////////////
+// FSoftBoneSolver
+
+/**
+ * Calls Function(BeginIndex, EndIndex) for each run of consecutive awake chains.
+ * If no chain is sleeping, all links including padding are one run.
+ */
+template <typename FunctionType>
+static void ForEachAwakeRun(const FSoftBoneChainState& State, FunctionType Function)
+{
+	if (State.NumSleepingChains == 0)
+	{
+		Function(0, State.Positions.NumPadded());
+		return;
+	}
+
+	int32 RunBegin = INDEX_NONE;
+	int32 RunEnd = INDEX_NONE;
+
+	for (int32 ChainIndex = 0; ChainIndex < State.Chains.Num(); ChainIndex++)
+	{
+		const FSoftBoneChainRange& Chain = State.Chains[ChainIndex];
+
+		if (Chain.bSleeping)
+		{
+			continue;
+		}
+
+		if (RunBegin != INDEX_NONE && Chain.LinkOffset != RunEnd)
+		{
+			Function(RunBegin, RunEnd);
+			RunBegin = INDEX_NONE;
+		}
+
+		if (RunBegin == INDEX_NONE)
+		{
+			RunBegin = Chain.LinkOffset;
+		}
+
+		RunEnd = Chain.LinkOffset + Chain.NumLinks;
+	}
+
+	if (RunBegin != INDEX_NONE)
+	{
+		Function(RunBegin, RunEnd);
+	}
+}
+
+/** Mask of lanes of the block at Index which are in [BeginIndex, EndIndex) */
+static FORCEINLINE VectorRegister GetLaneMask(int32 Index, const VectorRegister& BeginIndexVec, const VectorRegister& EndIndexVec)
+{
+	const VectorRegister LaneIndices = VectorAdd(VectorSetFloat1((float)Index), MakeVectorRegister(0.f, 1.f, 2.f, 3.f));
+	return VectorBitwiseAnd(VectorCompareGE(LaneIndices, BeginIndexVec), VectorCompareGT(EndIndexVec, LaneIndices));
+}
+
+/** Root bones should be fixed. Moves roots of awake chains onto their targets, and stops them if bResetVelocity is true. */
+static void PinRoots(FSoftBoneChainState& State, const FSoftBoneVectorStream& TargetPositions, bool bResetVelocity)
+{
+	for (int32 ChainIndex = 0; ChainIndex < State.Chains.Num(); ChainIndex++)
+	{
+		if (State.Chains[ChainIndex].bSleeping)
+		{
+			continue;
+		}
+
+		const int32 RootIndex = State.Chains[ChainIndex].LinkOffset;
+
+		State.Positions.Set(RootIndex, TargetPositions.Get(RootIndex));
+
+		if (bResetVelocity)
+		{
+			State.Velocities.Set(RootIndex, FVector::ZeroVector);
+		}
+	}
+}
+
+/**
+ * Advances links in [BeginIndex, EndIndex) by the closed form of their springs. Coefficients should be up to date.
+ * bLinkAccelerations should match whether Params has LinkAccelerations, so links without them don't load a stream of zeros.
+ */
+template <bool bLinkAccelerations>
+static void IntegrateAnalyticLinkRange(FSoftBoneChainState& State, const FSoftBoneVectorStream& TargetPositions, const FSoftBoneSolverParams& Params, int32 BeginIndex, int32 EndIndex)
+{
+	const int32 Alignment = FSoftBoneVectorStream::Alignment;
+	const int32 BeginBlock = BeginIndex & ~(Alignment - 1);
+	const int32 EndBlock = Align(EndIndex, Alignment);
+
+	const VectorRegister BeginIndexVec = VectorSetFloat1((float)BeginIndex);
+	const VectorRegister EndIndexVec = VectorSetFloat1((float)EndIndex);
+
+	float* RESTRICT PositionX = State.Positions.X.GetData();
+	float* RESTRICT PositionY = State.Positions.Y.GetData();
+	float* RESTRICT PositionZ = State.Positions.Z.GetData();
+	float* RESTRICT VelocityX = State.Velocities.X.GetData();
+	float* RESTRICT VelocityY = State.Velocities.Y.GetData();
+	float* RESTRICT VelocityZ = State.Velocities.Z.GetData();
+	const float* RESTRICT TargetX = TargetPositions.X.GetData();
+	const float* RESTRICT TargetY = TargetPositions.Y.GetData();
+	const float* RESTRICT TargetZ = TargetPositions.Z.GetData();
+
+	const FSoftBoneAnalyticCoefficients& Coefficients = State.AnalyticCoefficients;
+	const float* RESTRICT OffsetFromOffset = Coefficients.OffsetFromOffset.GetData();
+	const float* RESTRICT OffsetFromVelocity = Coefficients.OffsetFromVelocity.GetData();
+	const float* RESTRICT OffsetFromAcceleration = Coefficients.OffsetFromAcceleration.GetData();
+	const float* RESTRICT VelocityFromOffset = Coefficients.VelocityFromOffset.GetData();
+	const float* RESTRICT VelocityFromVelocity = Coefficients.VelocityFromVelocity.GetData();
+
+	const VectorRegister ExtAccelX = VectorSetFloat1(Params.ExternalAcceleration.X);
+	const VectorRegister ExtAccelY = VectorSetFloat1(Params.ExternalAcceleration.Y);
+	const VectorRegister ExtAccelZ = VectorSetFloat1(Params.ExternalAcceleration.Z);
+
+	const float* RESTRICT LinkAccelerationX = bLinkAccelerations ? Params.LinkAccelerations->X.GetData() : nullptr;
+	const float* RESTRICT LinkAccelerationY = bLinkAccelerations ? Params.LinkAccelerations->Y.GetData() : nullptr;
+	const float* RESTRICT LinkAccelerationZ = bLinkAccelerations ? Params.LinkAccelerations->Z.GetData() : nullptr;
+
+	for (int32 Index = BeginBlock; Index < EndBlock; Index += Alignment)
+	{
+		VectorRegister AccelX = ExtAccelX;
+		VectorRegister AccelY = ExtAccelY;
+		VectorRegister AccelZ = ExtAccelZ;
+
+		if (bLinkAccelerations)
+		{
+			AccelX = VectorAdd(AccelX, VectorLoadAligned(LinkAccelerationX + Index));
+			AccelY = VectorAdd(AccelY, VectorLoadAligned(LinkAccelerationY + Index));
+			AccelZ = VectorAdd(AccelZ, VectorLoadAligned(LinkAccelerationZ + Index));
+		}
+
+		const VectorRegister OffsetOffset = VectorLoadAligned(OffsetFromOffset + Index);
+		const VectorRegister OffsetVelocity = VectorLoadAligned(OffsetFromVelocity + Index);
+		const VectorRegister OffsetAcceleration = VectorLoadAligned(OffsetFromAcceleration + Index);
+		const VectorRegister VelocityOffset = VectorLoadAligned(VelocityFromOffset + Index);
+		const VectorRegister VelocityVelocity = VectorLoadAligned(VelocityFromVelocity + Index);
+
+		const VectorRegister PosX = VectorLoadAligned(PositionX + Index);
+		const VectorRegister PosY = VectorLoadAligned(PositionY + Index);
+		const VectorRegister PosZ = VectorLoadAligned(PositionZ + Index);
+		const VectorRegister OldVelX = VectorLoadAligned(VelocityX + Index);
+		const VectorRegister OldVelY = VectorLoadAligned(VelocityY + Index);
+		const VectorRegister OldVelZ = VectorLoadAligned(VelocityZ + Index);
+		const VectorRegister TgtX = VectorLoadAligned(TargetX + Index);
+		const VectorRegister TgtY = VectorLoadAligned(TargetY + Index);
+		const VectorRegister TgtZ = VectorLoadAligned(TargetZ + Index);
+
+		const VectorRegister OffsetX = VectorSubtract(PosX, TgtX);
+		const VectorRegister OffsetY = VectorSubtract(PosY, TgtY);
+		const VectorRegister OffsetZ = VectorSubtract(PosZ, TgtZ);
+
+		// velocity responds to a constant acceleration like the offset responds to the initial velocity
+		VectorRegister NewPosX = VectorAdd(TgtX, VectorMultiplyAdd(OffsetOffset, OffsetX, VectorMultiplyAdd(OffsetVelocity, OldVelX, VectorMultiply(OffsetAcceleration, AccelX))));
+		VectorRegister NewPosY = VectorAdd(TgtY, VectorMultiplyAdd(OffsetOffset, OffsetY, VectorMultiplyAdd(OffsetVelocity, OldVelY, VectorMultiply(OffsetAcceleration, AccelY))));
+		VectorRegister NewPosZ = VectorAdd(TgtZ, VectorMultiplyAdd(OffsetOffset, OffsetZ, VectorMultiplyAdd(OffsetVelocity, OldVelZ, VectorMultiply(OffsetAcceleration, AccelZ))));
+		VectorRegister NewVelX = VectorMultiplyAdd(VelocityOffset, OffsetX, VectorMultiplyAdd(VelocityVelocity, OldVelX, VectorMultiply(OffsetVelocity, AccelX)));
+		VectorRegister NewVelY = VectorMultiplyAdd(VelocityOffset, OffsetY, VectorMultiplyAdd(VelocityVelocity, OldVelY, VectorMultiply(OffsetVelocity, AccelY)));
+		VectorRegister NewVelZ = VectorMultiplyAdd(VelocityOffset, OffsetZ, VectorMultiplyAdd(VelocityVelocity, OldVelZ, VectorMultiply(OffsetVelocity, AccelZ)));
+
+		if (Index < BeginIndex || Index + Alignment > EndIndex)
+		{
+			const VectorRegister InRange = GetLaneMask(Index, BeginIndexVec, EndIndexVec);
+
+			NewPosX = VectorSelect(InRange, NewPosX, PosX);
+			NewPosY = VectorSelect(InRange, NewPosY, PosY);
+			NewPosZ = VectorSelect(InRange, NewPosZ, PosZ);
+			NewVelX = VectorSelect(InRange, NewVelX, OldVelX);
+			NewVelY = VectorSelect(InRange, NewVelY, OldVelY);
+			NewVelZ = VectorSelect(InRange, NewVelZ, OldVelZ);
+		}
+
+		VectorStoreAligned(NewPosX, PositionX + Index);
+		VectorStoreAligned(NewPosY, PositionY + Index);
+		VectorStoreAligned(NewPosZ, PositionZ + Index);
+		VectorStoreAligned(NewVelX, VelocityX + Index);
+		VectorStoreAligned(NewVelY, VelocityY + Index);
+		VectorStoreAligned(NewVelZ, VelocityZ + Index);
+	}
+}
+
+void FSoftBoneSolver::UpdateAnalyticCoefficients(FSoftBoneChainState& State, float TimeDelta, const FSoftBoneSolverParams& Params)
+{
+	FSoftBoneAnalyticCoefficients& Coefficients = State.AnalyticCoefficients;
+	const int32 NumPadded = State.RestoringWeights.Num();
+
+	if (Coefficients.OffsetFromOffset.Num() == NumPadded && Coefficients.IsUpToDate(TimeDelta, Params.DampingRatio, Params.ReferenceTimeStep))
+	{
+		return;
+	}
+
+	FSoftBoneFloatStream* const Streams[5] = { &Coefficients.OffsetFromOffset, &Coefficients.OffsetFromVelocity, &Coefficients.OffsetFromAcceleration, &Coefficients.VelocityFromOffset, &Coefficients.VelocityFromVelocity };
+
+	for (int32 StreamIndex = 0; StreamIndex < 5; StreamIndex++)
+	{
+		Streams[StreamIndex]->SetNumUninitialized(NumPadded);
+	}
+
+	const double Time = TimeDelta;
+	const double ReferenceTimeStep = Params.ReferenceTimeStep;
+
+	// velocity decays exponentially, losing DampingRatio of it per reference step
+	// CRT math in double, FMath only works in float and 1 - OffsetFromOffset cancels out for weak springs
+	const double RemainingVelocityRatio = 1.0 - FMath::Clamp(Params.DampingRatio, 0.f, 0.999f);
+	const double Damping = -log(RemainingVelocityRatio) / ReferenceTimeStep;
+	const double HalfDamping = 0.5 * Damping;
+	const double Decay = exp(-HalfDamping * Time);
+
+	for (int32 Index = 0; Index < NumPadded; Index++)
+	{
+		const double Stiffness = State.RestoringWeights[Index] / (ReferenceTimeStep * ReferenceTimeStep);
+		const double Discriminant = Stiffness - HalfDamping * HalfDamping;
+
+		// Offset(t) = Decay * (Offset * (Oscillation + HalfDamping * Phase) + Velocity * Phase)
+		// Phase is sin(wt)/w when under damped, sinh(wt)/w when over damped, and t when critically damped
+		double Oscillation = 1.0;
+		double Phase = Time;
+
+		if (Discriminant > KINDA_SMALL_NUMBER)
+		{
+			const double Frequency = sqrt(Discriminant);
+			Oscillation = cos(Frequency * Time);
+			Phase = sin(Frequency * Time) / Frequency;
+		}
+		else if (Discriminant < -KINDA_SMALL_NUMBER)
+		{
+			const double Rate = sqrt(-Discriminant);
+			Oscillation = cosh(Rate * Time);
+			Phase = sinh(Rate * Time) / Rate;
+		}
+
+		const double OffsetOffset = Decay * (Oscillation + HalfDamping * Phase);
+		const double OffsetVelocity = Decay * Phase;
+
+		// a constant acceleration moves the rest offset to Acceleration / Stiffness
+		double OffsetAcceleration;
+
+		if (Stiffness > SMALL_NUMBER)
+		{
+			OffsetAcceleration = (1.0 - OffsetOffset) / Stiffness;
+		}
+		else if (Damping > SMALL_NUMBER)
+		{
+			OffsetAcceleration = (Time - OffsetVelocity) / Damping;
+		}
+		else
+		{
+			OffsetAcceleration = 0.5 * Time * Time;
+		}
+
+		Coefficients.OffsetFromOffset[Index] = (float)OffsetOffset;
+		Coefficients.OffsetFromVelocity[Index] = (float)OffsetVelocity;
+		Coefficients.OffsetFromAcceleration[Index] = (float)OffsetAcceleration;
+		Coefficients.VelocityFromOffset[Index] = (float)(-Decay * Stiffness * Phase);
+		Coefficients.VelocityFromVelocity[Index] = (float)(Decay * (Oscillation - HalfDamping * Phase));
+	}
+
+	Coefficients.TimeStep = TimeDelta;
+	Coefficients.DampingRatio = Params.DampingRatio;
+	Coefficients.ReferenceTimeStep = Params.ReferenceTimeStep;
+}
+
+/**
+ * Integrates links in [BeginIndex, EndIndex) by blocks of vector width.
+ * Blocks which are partially out of the range keep the original values of outside lanes, so neighbor chains are not touched.
+ * bLinkAccelerations as in IntegrateAnalyticLinkRange.
+ */
+template <bool bLinkAccelerations>
+static void IntegrateLinkRange(FSoftBoneChainState& State, const FSoftBoneVectorStream& TargetPositions, float TimeDelta, const FSoftBoneSolverParams& Params, int32 BeginIndex, int32 EndIndex)
+{
+	const int32 Alignment = FSoftBoneVectorStream::Alignment;
+	const int32 BeginBlock = BeginIndex & ~(Alignment - 1);
+	const int32 EndBlock = Align(EndIndex, Alignment);
+
+	const VectorRegister BeginIndexVec = VectorSetFloat1((float)BeginIndex);
+	const VectorRegister EndIndexVec = VectorSetFloat1((float)EndIndex);
+
+	float* RESTRICT PositionX = State.Positions.X.GetData();
+	float* RESTRICT PositionY = State.Positions.Y.GetData();
+	float* RESTRICT PositionZ = State.Positions.Z.GetData();
+	float* RESTRICT VelocityX = State.Velocities.X.GetData();
+	float* RESTRICT VelocityY = State.Velocities.Y.GetData();
+	float* RESTRICT VelocityZ = State.Velocities.Z.GetData();
+	const float* RESTRICT TargetX = TargetPositions.X.GetData();
+	const float* RESTRICT TargetY = TargetPositions.Y.GetData();
+	const float* RESTRICT TargetZ = TargetPositions.Z.GetData();
+	const float* RESTRICT RestoringWeights = State.RestoringWeights.GetData();
+
+	// pre-calculate inverse time step
+	const VectorRegister InvTimeDelta = VectorSetFloat1(1.0f / TimeDelta);
+	const VectorRegister TimeDeltaVec = VectorSetFloat1(TimeDelta);
+	const VectorRegister DampingCoefficient = VectorSetFloat1(1.0f - Params.DampingRatio);
+
+	// external acceleration is same for all links, so scale it by time step once
+	const FVector ExtAccel = Params.ExternalAcceleration * TimeDelta;
+	const VectorRegister ExtAccelX = VectorSetFloat1(ExtAccel.X);
+	const VectorRegister ExtAccelY = VectorSetFloat1(ExtAccel.Y);
+	const VectorRegister ExtAccelZ = VectorSetFloat1(ExtAccel.Z);
+
+	const float* RESTRICT LinkAccelerationX = bLinkAccelerations ? Params.LinkAccelerations->X.GetData() : nullptr;
+	const float* RESTRICT LinkAccelerationY = bLinkAccelerations ? Params.LinkAccelerations->Y.GetData() : nullptr;
+	const float* RESTRICT LinkAccelerationZ = bLinkAccelerations ? Params.LinkAccelerations->Z.GetData() : nullptr;
+
+	// apply a force of restitution to go back to the kinematic position
+	for (int32 Index = BeginBlock; Index < EndBlock; Index += Alignment)
+	{
+		const VectorRegister RestoringWeight = VectorLoadAligned(RestoringWeights + Index);
+
+		VectorRegister StepAccelX = ExtAccelX;
+		VectorRegister StepAccelY = ExtAccelY;
+		VectorRegister StepAccelZ = ExtAccelZ;
+
+		if (bLinkAccelerations)
+		{
+			StepAccelX = VectorMultiplyAdd(VectorLoadAligned(LinkAccelerationX + Index), TimeDeltaVec, StepAccelX);
+			StepAccelY = VectorMultiplyAdd(VectorLoadAligned(LinkAccelerationY + Index), TimeDeltaVec, StepAccelY);
+			StepAccelZ = VectorMultiplyAdd(VectorLoadAligned(LinkAccelerationZ + Index), TimeDeltaVec, StepAccelZ);
+		}
+
+		VectorRegister PosX = VectorLoadAligned(PositionX + Index);
+		VectorRegister PosY = VectorLoadAligned(PositionY + Index);
+		VectorRegister PosZ = VectorLoadAligned(PositionZ + Index);
+
+		// RestoreImpulse = RestoringWeight * (Target - Position)
+		const VectorRegister RestoreImpulseX = VectorMultiply(VectorSubtract(VectorLoadAligned(TargetX + Index), PosX), RestoringWeight);
+		const VectorRegister RestoreImpulseY = VectorMultiply(VectorSubtract(VectorLoadAligned(TargetY + Index), PosY), RestoringWeight);
+		const VectorRegister RestoreImpulseZ = VectorMultiply(VectorSubtract(VectorLoadAligned(TargetZ + Index), PosZ), RestoringWeight);
+
+		// velocity integration
+		VectorRegister VelX = VectorAdd(VectorLoadAligned(VelocityX + Index), VectorAdd(VectorMultiply(RestoreImpulseX, InvTimeDelta), StepAccelX));
+		VectorRegister VelY = VectorAdd(VectorLoadAligned(VelocityY + Index), VectorAdd(VectorMultiply(RestoreImpulseY, InvTimeDelta), StepAccelY));
+		VectorRegister VelZ = VectorAdd(VectorLoadAligned(VelocityZ + Index), VectorAdd(VectorMultiply(RestoreImpulseZ, InvTimeDelta), StepAccelZ));
+
+		// position integration
+		PosX = VectorAdd(PosX, VectorMultiply(VelX, TimeDeltaVec));
+		PosY = VectorAdd(PosY, VectorMultiply(VelY, TimeDeltaVec));
+		PosZ = VectorAdd(PosZ, VectorMultiply(VelZ, TimeDeltaVec));
+
+		// damping
+		VelX = VectorMultiply(VelX, DampingCoefficient);
+		VelY = VectorMultiply(VelY, DampingCoefficient);
+		VelZ = VectorMultiply(VelZ, DampingCoefficient);
+
+		if (Index < BeginIndex || Index + Alignment > EndIndex)
+		{
+			// keep lanes out of the range
+			const VectorRegister InRange = GetLaneMask(Index, BeginIndexVec, EndIndexVec);
+
+			PosX = VectorSelect(InRange, PosX, VectorLoadAligned(PositionX + Index));
+			PosY = VectorSelect(InRange, PosY, VectorLoadAligned(PositionY + Index));
+			PosZ = VectorSelect(InRange, PosZ, VectorLoadAligned(PositionZ + Index));
+			VelX = VectorSelect(InRange, VelX, VectorLoadAligned(VelocityX + Index));
+			VelY = VectorSelect(InRange, VelY, VectorLoadAligned(VelocityY + Index));
+			VelZ = VectorSelect(InRange, VelZ, VectorLoadAligned(VelocityZ + Index));
+		}
+
+		VectorStoreAligned(PosX, PositionX + Index);
+		VectorStoreAligned(PosY, PositionY + Index);
+		VectorStoreAligned(PosZ, PositionZ + Index);
+		VectorStoreAligned(VelX, VelocityX + Index);
+		VectorStoreAligned(VelY, VelocityY + Index);
+		VectorStoreAligned(VelZ, VelocityZ + Index);
+	}
+}
+
+void FSoftBoneSolver::IntegrateLinks(FSoftBoneChainState& State, const FSoftBoneVectorStream& TargetPositions, float TimeDelta, const FSoftBoneSolverParams& Params)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SoftBoneIntegration);
+
+	// integrate runs of consecutive awake chains
+	ForEachAwakeRun(State, [&](int32 BeginIndex, int32 EndIndex)
+	{
+		if (Params.LinkAccelerations)
+		{
+			IntegrateLinkRange<true>(State, TargetPositions, TimeDelta, Params, BeginIndex, EndIndex);
+		}
+		else
+		{
+			IntegrateLinkRange<false>(State, TargetPositions, TimeDelta, Params, BeginIndex, EndIndex);
+		}
+	});
+}
+
+/** XPBD prediction of links in [BeginIndex, EndIndex), moves them by their velocities after external acceleration. bLinkAccelerations as in IntegrateAnalyticLinkRange. */
+template <bool bLinkAccelerations>
+static void PredictLinkRange(FSoftBoneChainState& State, float TimeDelta, const FSoftBoneSolverParams& Params, int32 BeginIndex, int32 EndIndex)
+{
+	const int32 Alignment = FSoftBoneVectorStream::Alignment;
+	const int32 BeginBlock = BeginIndex & ~(Alignment - 1);
+	const int32 EndBlock = Align(EndIndex, Alignment);
+
+	const VectorRegister BeginIndexVec = VectorSetFloat1((float)BeginIndex);
+	const VectorRegister EndIndexVec = VectorSetFloat1((float)EndIndex);
+
+	float* RESTRICT PositionX = State.Positions.X.GetData();
+	float* RESTRICT PositionY = State.Positions.Y.GetData();
+	float* RESTRICT PositionZ = State.Positions.Z.GetData();
+	float* RESTRICT VelocityX = State.Velocities.X.GetData();
+	float* RESTRICT VelocityY = State.Velocities.Y.GetData();
+	float* RESTRICT VelocityZ = State.Velocities.Z.GetData();
+
+	const VectorRegister TimeDeltaVec = VectorSetFloat1(TimeDelta);
+	const FVector ExtAccel = Params.ExternalAcceleration * TimeDelta;
+	const VectorRegister ExtAccelX = VectorSetFloat1(ExtAccel.X);
+	const VectorRegister ExtAccelY = VectorSetFloat1(ExtAccel.Y);
+	const VectorRegister ExtAccelZ = VectorSetFloat1(ExtAccel.Z);
+
+	const float* RESTRICT LinkAccelerationX = bLinkAccelerations ? Params.LinkAccelerations->X.GetData() : nullptr;
+	const float* RESTRICT LinkAccelerationY = bLinkAccelerations ? Params.LinkAccelerations->Y.GetData() : nullptr;
+	const float* RESTRICT LinkAccelerationZ = bLinkAccelerations ? Params.LinkAccelerations->Z.GetData() : nullptr;
+
+	for (int32 Index = BeginBlock; Index < EndBlock; Index += Alignment)
+	{
+		VectorRegister StepAccelX = ExtAccelX;
+		VectorRegister StepAccelY = ExtAccelY;
+		VectorRegister StepAccelZ = ExtAccelZ;
+
+		if (bLinkAccelerations)
+		{
+			StepAccelX = VectorMultiplyAdd(VectorLoadAligned(LinkAccelerationX + Index), TimeDeltaVec, StepAccelX);
+			StepAccelY = VectorMultiplyAdd(VectorLoadAligned(LinkAccelerationY + Index), TimeDeltaVec, StepAccelY);
+			StepAccelZ = VectorMultiplyAdd(VectorLoadAligned(LinkAccelerationZ + Index), TimeDeltaVec, StepAccelZ);
+		}
+
+		const VectorRegister PosX = VectorLoadAligned(PositionX + Index);
+		const VectorRegister PosY = VectorLoadAligned(PositionY + Index);
+		const VectorRegister PosZ = VectorLoadAligned(PositionZ + Index);
+		const VectorRegister VelX = VectorAdd(VectorLoadAligned(VelocityX + Index), StepAccelX);
+		const VectorRegister VelY = VectorAdd(VectorLoadAligned(VelocityY + Index), StepAccelY);
+		const VectorRegister VelZ = VectorAdd(VectorLoadAligned(VelocityZ + Index), StepAccelZ);
+
+		// only positions are written, velocities are derived from them after the constraints
+		VectorRegister NewPosX = VectorMultiplyAdd(VelX, TimeDeltaVec, PosX);
+		VectorRegister NewPosY = VectorMultiplyAdd(VelY, TimeDeltaVec, PosY);
+		VectorRegister NewPosZ = VectorMultiplyAdd(VelZ, TimeDeltaVec, PosZ);
+
+		if (Index < BeginIndex || Index + Alignment > EndIndex)
+		{
+			const VectorRegister InRange = GetLaneMask(Index, BeginIndexVec, EndIndexVec);
+
+			NewPosX = VectorSelect(InRange, NewPosX, PosX);
+			NewPosY = VectorSelect(InRange, NewPosY, PosY);
+			NewPosZ = VectorSelect(InRange, NewPosZ, PosZ);
+		}
+
+		VectorStoreAligned(NewPosX, PositionX + Index);
+		VectorStoreAligned(NewPosY, PositionY + Index);
+		VectorStoreAligned(NewPosZ, PositionZ + Index);
+	}
+}
+
+/**
+ * One XPBD iteration of the restoring constraints of links in [BeginIndex, EndIndex).
+ * Each link is pulled toward its target with compliance ComplianceScale / RestoringWeight, where ComplianceScale is (ReferenceTimeStep / TimeDelta)^2.
+ * Both sides of the multiplier update are multiplied by the weight, so links without any weight don't divide by zero.
+ */
+static void SolveRestoringConstraintRange(FSoftBoneChainState& State, const FSoftBoneVectorStream& TargetPositions, float ComplianceScale, int32 BeginIndex, int32 EndIndex)
+{
+	const int32 Alignment = FSoftBoneVectorStream::Alignment;
+	const int32 BeginBlock = BeginIndex & ~(Alignment - 1);
+	const int32 EndBlock = Align(EndIndex, Alignment);
+
+	const VectorRegister BeginIndexVec = VectorSetFloat1((float)BeginIndex);
+	const VectorRegister EndIndexVec = VectorSetFloat1((float)EndIndex);
+
+	float* RESTRICT PositionX = State.Positions.X.GetData();
+	float* RESTRICT PositionY = State.Positions.Y.GetData();
+	float* RESTRICT PositionZ = State.Positions.Z.GetData();
+	float* RESTRICT LambdaX = State.RestoringLambdas.X.GetData();
+	float* RESTRICT LambdaY = State.RestoringLambdas.Y.GetData();
+	float* RESTRICT LambdaZ = State.RestoringLambdas.Z.GetData();
+	const float* RESTRICT TargetX = TargetPositions.X.GetData();
+	const float* RESTRICT TargetY = TargetPositions.Y.GetData();
+	const float* RESTRICT TargetZ = TargetPositions.Z.GetData();
+	const float* RESTRICT RestoringWeights = State.RestoringWeights.GetData();
+
+	const VectorRegister ComplianceScaleVec = VectorSetFloat1(ComplianceScale);
+
+	for (int32 Index = BeginBlock; Index < EndBlock; Index += Alignment)
+	{
+		const VectorRegister RestoringWeight = VectorLoadAligned(RestoringWeights + Index);
+		const VectorRegister InvDenominator = VectorReciprocalAccurate(VectorAdd(RestoringWeight, ComplianceScaleVec));
+
+		const VectorRegister PosX = VectorLoadAligned(PositionX + Index);
+		const VectorRegister PosY = VectorLoadAligned(PositionY + Index);
+		const VectorRegister PosZ = VectorLoadAligned(PositionZ + Index);
+		const VectorRegister LamX = VectorLoadAligned(LambdaX + Index);
+		const VectorRegister LamY = VectorLoadAligned(LambdaY + Index);
+		const VectorRegister LamZ = VectorLoadAligned(LambdaZ + Index);
+
+		// DeltaLambda = (Weight * (Target - Position) - ComplianceScale * Lambda) / (Weight + ComplianceScale), inverse mass is 1
+		VectorRegister DeltaX = VectorMultiply(VectorSubtract(VectorMultiply(VectorSubtract(VectorLoadAligned(TargetX + Index), PosX), RestoringWeight), VectorMultiply(LamX, ComplianceScaleVec)), InvDenominator);
+		VectorRegister DeltaY = VectorMultiply(VectorSubtract(VectorMultiply(VectorSubtract(VectorLoadAligned(TargetY + Index), PosY), RestoringWeight), VectorMultiply(LamY, ComplianceScaleVec)), InvDenominator);
+		VectorRegister DeltaZ = VectorMultiply(VectorSubtract(VectorMultiply(VectorSubtract(VectorLoadAligned(TargetZ + Index), PosZ), RestoringWeight), VectorMultiply(LamZ, ComplianceScaleVec)), InvDenominator);
+
+		if (Index < BeginIndex || Index + Alignment > EndIndex)
+		{
+			const VectorRegister InRange = GetLaneMask(Index, BeginIndexVec, EndIndexVec);
+
+			DeltaX = VectorBitwiseAnd(DeltaX, InRange);
+			DeltaY = VectorBitwiseAnd(DeltaY, InRange);
+			DeltaZ = VectorBitwiseAnd(DeltaZ, InRange);
+		}
+
+		VectorStoreAligned(VectorAdd(PosX, DeltaX), PositionX + Index);
+		VectorStoreAligned(VectorAdd(PosY, DeltaY), PositionY + Index);
+		VectorStoreAligned(VectorAdd(PosZ, DeltaZ), PositionZ + Index);
+		VectorStoreAligned(VectorAdd(LamX, DeltaX), LambdaX + Index);
+		VectorStoreAligned(VectorAdd(LamY, DeltaY), LambdaY + Index);
+		VectorStoreAligned(VectorAdd(LamZ, DeltaZ), LambdaZ + Index);
+	}
+}
+
+/**
+ * One XPBD iteration of the rigid length constraints of the links of a chain in [BeginIndex, EndIndex), BeginIndex is its root.
+ * Unlike the explicit solver, both ends move by their inverse masses. Roots are pinned, so they have no inverse mass.
+ * @return Largest length error before the correction
+ */
+static float SolveLengthConstraintRangeXPBD(FSoftBoneChainState& State, int32 BeginIndex, int32 EndIndex)
+{
+	float* PositionX = State.Positions.X.GetData();
+	float* PositionY = State.Positions.Y.GetData();
+	float* PositionZ = State.Positions.Z.GetData();
+	const float* Lengths = State.Lengths.GetData();
+	const int32* ParentIndices = State.ParentIndices.GetData();
+
+	float MaxError = 0.f;
+
+	for (int32 LinkIndex = BeginIndex + 1; LinkIndex < EndIndex; LinkIndex++)
+	{
+		const int32 ParentIndex = ParentIndices[LinkIndex];
+
+		const float DeltaX = PositionX[LinkIndex] - PositionX[ParentIndex];
+		const float DeltaY = PositionY[LinkIndex] - PositionY[ParentIndex];
+		const float DeltaZ = PositionZ[LinkIndex] - PositionZ[ParentIndex];
+		const float DistanceSquared = DeltaX * DeltaX + DeltaY * DeltaY + DeltaZ * DeltaZ;
+
+		if (DistanceSquared <= SMALL_NUMBER)
+		{
+			continue;
+		}
+
+		const float InvDistance = FMath::InvSqrt(DistanceSquared);
+		const float Error = DistanceSquared * InvDistance - Lengths[LinkIndex];
+		MaxError = FMath::Max(MaxError, FMath::Abs(Error));
+
+		// inverse masses are 1 except for the root, which takes none of the correction
+		const bool bParentPinned = (ParentIndex == BeginIndex);
+		const float Correction = Error * InvDistance * (bParentPinned ? 1.f : 0.5f);
+		const float ParentCorrection = bParentPinned ? 0.f : Correction;
+
+		PositionX[LinkIndex] -= DeltaX * Correction;
+		PositionY[LinkIndex] -= DeltaY * Correction;
+		PositionZ[LinkIndex] -= DeltaZ * Correction;
+		PositionX[ParentIndex] += DeltaX * ParentCorrection;
+		PositionY[ParentIndex] += DeltaY * ParentCorrection;
+		PositionZ[ParentIndex] += DeltaZ * ParentCorrection;
+	}
+
+	return MaxError;
+}
+
+/** XPBD velocity update of links in [BeginIndex, EndIndex) from the positions before and after the sub step */
+static void UpdateVelocityRange(FSoftBoneChainState& State, float TimeDelta, float DampingCoefficient, int32 BeginIndex, int32 EndIndex)
+{
+	const int32 Alignment = FSoftBoneVectorStream::Alignment;
+	const int32 BeginBlock = BeginIndex & ~(Alignment - 1);
+	const int32 EndBlock = Align(EndIndex, Alignment);
+
+	const VectorRegister BeginIndexVec = VectorSetFloat1((float)BeginIndex);
+	const VectorRegister EndIndexVec = VectorSetFloat1((float)EndIndex);
+
+	const float* RESTRICT PositionX = State.Positions.X.GetData();
+	const float* RESTRICT PositionY = State.Positions.Y.GetData();
+	const float* RESTRICT PositionZ = State.Positions.Z.GetData();
+	const float* RESTRICT PrevPositionX = State.PreviousPositions.X.GetData();
+	const float* RESTRICT PrevPositionY = State.PreviousPositions.Y.GetData();
+	const float* RESTRICT PrevPositionZ = State.PreviousPositions.Z.GetData();
+	float* RESTRICT VelocityX = State.Velocities.X.GetData();
+	float* RESTRICT VelocityY = State.Velocities.Y.GetData();
+	float* RESTRICT VelocityZ = State.Velocities.Z.GetData();
+
+	// damping is folded into the inverse time step
+	const VectorRegister Scale = VectorSetFloat1(DampingCoefficient / TimeDelta);
+
+	for (int32 Index = BeginBlock; Index < EndBlock; Index += Alignment)
+	{
+		VectorRegister VelX = VectorMultiply(VectorSubtract(VectorLoadAligned(PositionX + Index), VectorLoadAligned(PrevPositionX + Index)), Scale);
+		VectorRegister VelY = VectorMultiply(VectorSubtract(VectorLoadAligned(PositionY + Index), VectorLoadAligned(PrevPositionY + Index)), Scale);
+		VectorRegister VelZ = VectorMultiply(VectorSubtract(VectorLoadAligned(PositionZ + Index), VectorLoadAligned(PrevPositionZ + Index)), Scale);
+
+		if (Index < BeginIndex || Index + Alignment > EndIndex)
+		{
+			const VectorRegister InRange = GetLaneMask(Index, BeginIndexVec, EndIndexVec);
+
+			VelX = VectorSelect(InRange, VelX, VectorLoadAligned(VelocityX + Index));
+			VelY = VectorSelect(InRange, VelY, VectorLoadAligned(VelocityY + Index));
+			VelZ = VectorSelect(InRange, VelZ, VectorLoadAligned(VelocityZ + Index));
+		}
+
+		VectorStoreAligned(VelX, VelocityX + Index);
+		VectorStoreAligned(VelY, VelocityY + Index);
+		VectorStoreAligned(VelZ, VelocityZ + Index);
+	}
+}
+
+
+/** Solves distance constraints of the links of a chain in [BeginIndex, EndIndex). BeginIndex is the root which is fixed. */
+static void SolveLengthConstraintRange(FSoftBoneChainState& State, int32 BeginIndex, int32 EndIndex)
+{
+	float* PositionX = State.Positions.X.GetData();
+	float* PositionY = State.Positions.Y.GetData();
+	float* PositionZ = State.Positions.Z.GetData();
+	const float* Lengths = State.Lengths.GetData();
+	const int32* ParentIndices = State.ParentIndices.GetData();
+
+	// solve distance constraint
+	// each link depends on the result of its parent, so this can't be vectorized across links
+	// links are sorted parent first, so one pass is enough
+	// only the first link of a chain is a root, so links after it always have a parent
+	for (int32 LinkIndex = BeginIndex + 1; LinkIndex < EndIndex; LinkIndex++)
+	{
+		const int32 ParentIndex = ParentIndices[LinkIndex];
+
+		const float DeltaX = PositionX[LinkIndex] - PositionX[ParentIndex];
+		const float DeltaY = PositionY[LinkIndex] - PositionY[ParentIndex];
+		const float DeltaZ = PositionZ[LinkIndex] - PositionZ[ParentIndex];
+
+		const float Scale = FMath::InvSqrt(DeltaX * DeltaX + DeltaY * DeltaY + DeltaZ * DeltaZ);
+		const float Length = Lengths[LinkIndex];
+
+		PositionX[LinkIndex] = PositionX[ParentIndex] + (DeltaX * Scale) * Length;
+		PositionY[LinkIndex] = PositionY[ParentIndex] + (DeltaY * Scale) * Length;
+		PositionZ[LinkIndex] = PositionZ[ParentIndex] + (DeltaZ * Scale) * Length;
+	}
+}
+
+void FSoftBoneSolver::SolveLengthConstraints(FSoftBoneChainState& State)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SoftBoneConstraints);
+
+	for (int32 ChainIndex = 0; ChainIndex < State.Chains.Num(); ChainIndex++)
+	{
+		const FSoftBoneChainRange& Chain = State.Chains[ChainIndex];
+
+		if (!Chain.bSleeping)
+		{
+			SolveLengthConstraintRange(State, Chain.LinkOffset, Chain.LinkOffset + Chain.NumLinks);
+		}
+	}
+}
+
+/** Pushes links in [BeginIndex, EndIndex) out of Collider by blocks of vector width. Lanes out of the range are kept. */
+static void CollideLinkRange(FSoftBoneChainState& State, const FSoftBoneCollider& Collider, int32 BeginIndex, int32 EndIndex)
+{
+	const int32 Alignment = FSoftBoneVectorStream::Alignment;
+	const int32 BeginBlock = BeginIndex & ~(Alignment - 1);
+	const int32 EndBlock = Align(EndIndex, Alignment);
+
+	const VectorRegister BeginIndexVec = VectorSetFloat1((float)BeginIndex);
+	const VectorRegister EndIndexVec = VectorSetFloat1((float)EndIndex);
+
+	float* RESTRICT PositionX = State.Positions.X.GetData();
+	float* RESTRICT PositionY = State.Positions.Y.GetData();
+	float* RESTRICT PositionZ = State.Positions.Z.GetData();
+
+	const FVector Segment = Collider.End - Collider.Start;
+	const float SegmentSizeSquared = Segment.SizeSquared();
+
+	// spheres always project onto the start
+	const VectorRegister InvSegmentSizeSquared = VectorSetFloat1((SegmentSizeSquared > SMALL_NUMBER) ? 1.f / SegmentSizeSquared : 0.f);
+	const VectorRegister StartX = VectorSetFloat1(Collider.Start.X);
+	const VectorRegister StartY = VectorSetFloat1(Collider.Start.Y);
+	const VectorRegister StartZ = VectorSetFloat1(Collider.Start.Z);
+	const VectorRegister SegmentX = VectorSetFloat1(Segment.X);
+	const VectorRegister SegmentY = VectorSetFloat1(Segment.Y);
+	const VectorRegister SegmentZ = VectorSetFloat1(Segment.Z);
+	const VectorRegister Radius = VectorSetFloat1(Collider.Radius);
+	const VectorRegister RadiusSquared = VectorSetFloat1(Collider.Radius * Collider.Radius);
+	const VectorRegister MinDistanceSquared = VectorSetFloat1(SMALL_NUMBER);
+	const VectorRegister Zero = VectorZero();
+	const VectorRegister One = VectorOne();
+
+	for (int32 Index = BeginBlock; Index < EndBlock; Index += Alignment)
+	{
+		const VectorRegister PosX = VectorLoadAligned(PositionX + Index);
+		const VectorRegister PosY = VectorLoadAligned(PositionY + Index);
+		const VectorRegister PosZ = VectorLoadAligned(PositionZ + Index);
+
+		// closest point on the segment
+		const VectorRegister Projection = VectorMultiply(
+			VectorMultiplyAdd(VectorSubtract(PosX, StartX), SegmentX, VectorMultiplyAdd(VectorSubtract(PosY, StartY), SegmentY, VectorMultiply(VectorSubtract(PosZ, StartZ), SegmentZ))),
+			InvSegmentSizeSquared);
+		const VectorRegister T = VectorMin(VectorMax(Projection, Zero), One);
+
+		const VectorRegister ClosestX = VectorMultiplyAdd(SegmentX, T, StartX);
+		const VectorRegister ClosestY = VectorMultiplyAdd(SegmentY, T, StartY);
+		const VectorRegister ClosestZ = VectorMultiplyAdd(SegmentZ, T, StartZ);
+
+		const VectorRegister DeltaX = VectorSubtract(PosX, ClosestX);
+		const VectorRegister DeltaY = VectorSubtract(PosY, ClosestY);
+		const VectorRegister DeltaZ = VectorSubtract(PosZ, ClosestZ);
+		const VectorRegister DistanceSquared = VectorMultiplyAdd(DeltaX, DeltaX, VectorMultiplyAdd(DeltaY, DeltaY, VectorMultiply(DeltaZ, DeltaZ)));
+
+		VectorRegister Inside = VectorCompareGT(RadiusSquared, DistanceSquared);
+
+		if (Index < BeginIndex || Index + Alignment > EndIndex)
+		{
+			Inside = VectorBitwiseAnd(Inside, GetLaneMask(Index, BeginIndexVec, EndIndexVec));
+		}
+
+		// move onto the surface along the direction from the closest point
+		const VectorRegister Scale = VectorMultiply(Radius, VectorReciprocalSqrtAccurate(VectorMax(DistanceSquared, MinDistanceSquared)));
+
+		VectorStoreAligned(VectorSelect(Inside, VectorMultiplyAdd(DeltaX, Scale, ClosestX), PosX), PositionX + Index);
+		VectorStoreAligned(VectorSelect(Inside, VectorMultiplyAdd(DeltaY, Scale, ClosestY), PosY), PositionY + Index);
+		VectorStoreAligned(VectorSelect(Inside, VectorMultiplyAdd(DeltaZ, Scale, ClosestZ), PosZ), PositionZ + Index);
+	}
+}
+
+void FSoftBoneSolver::SolveCollisions(FSoftBoneChainState& State, const FSoftBoneCollider* Colliders, int32 NumColliders)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SoftBoneCollisions);
+
+	const int32 Alignment = FSoftBoneVectorStream::Alignment;
+
+	for (int32 ChainIndex = 0; ChainIndex < State.Chains.Num(); ChainIndex++)
+	{
+		const FSoftBoneChainRange& Chain = State.Chains[ChainIndex];
+
+		if (Chain.bSleeping || Chain.NumLinks < 2)
+		{
+			continue;
+		}
+
+		const int32 BeginIndex = Chain.LinkOffset + 1;
+		const int32 EndIndex = Chain.LinkOffset + Chain.NumLinks;
+
+		// lanes out of the chain are replaced by its root, so links of neighbor chains and padding don't grow the bounds
+		const FVector RootPosition = State.Positions.Get(Chain.LinkOffset);
+		const VectorRegister RootX = VectorSetFloat1(RootPosition.X);
+		const VectorRegister RootY = VectorSetFloat1(RootPosition.Y);
+		const VectorRegister RootZ = VectorSetFloat1(RootPosition.Z);
+		const VectorRegister RootIndexVec = VectorSetFloat1((float)Chain.LinkOffset);
+		const VectorRegister EndIndexVec = VectorSetFloat1((float)EndIndex);
+
+		VectorRegister MinX = RootX;
+		VectorRegister MinY = RootY;
+		VectorRegister MinZ = RootZ;
+		VectorRegister MaxX = RootX;
+		VectorRegister MaxY = RootY;
+		VectorRegister MaxZ = RootZ;
+
+		for (int32 Index = Chain.LinkOffset & ~(Alignment - 1); Index < EndIndex; Index += Alignment)
+		{
+			const VectorRegister InRange = GetLaneMask(Index, RootIndexVec, EndIndexVec);
+			const VectorRegister PosX = VectorSelect(InRange, VectorLoadAligned(State.Positions.X.GetData() + Index), RootX);
+			const VectorRegister PosY = VectorSelect(InRange, VectorLoadAligned(State.Positions.Y.GetData() + Index), RootY);
+			const VectorRegister PosZ = VectorSelect(InRange, VectorLoadAligned(State.Positions.Z.GetData() + Index), RootZ);
+
+			MinX = VectorMin(MinX, PosX);
+			MinY = VectorMin(MinY, PosY);
+			MinZ = VectorMin(MinZ, PosZ);
+			MaxX = VectorMax(MaxX, PosX);
+			MaxY = VectorMax(MaxY, PosY);
+			MaxZ = VectorMax(MaxZ, PosZ);
+		}
+
+		float Lanes[6][Alignment];
+		VectorStore(MinX, Lanes[0]);
+		VectorStore(MinY, Lanes[1]);
+		VectorStore(MinZ, Lanes[2]);
+		VectorStore(MaxX, Lanes[3]);
+		VectorStore(MaxY, Lanes[4]);
+		VectorStore(MaxZ, Lanes[5]);
+
+		FVector BoundsMin(Lanes[0][0], Lanes[1][0], Lanes[2][0]);
+		FVector BoundsMax(Lanes[3][0], Lanes[4][0], Lanes[5][0]);
+
+		for (int32 Lane = 1; Lane < Alignment; Lane++)
+		{
+			BoundsMin = BoundsMin.ComponentMin(FVector(Lanes[0][Lane], Lanes[1][Lane], Lanes[2][Lane]));
+			BoundsMax = BoundsMax.ComponentMax(FVector(Lanes[3][Lane], Lanes[4][Lane], Lanes[5][Lane]));
+		}
+
+		const FVector BoundsCenter = (BoundsMin + BoundsMax) * 0.5f;
+		const float BoundsRadius = (BoundsMax - BoundsMin).Size() * 0.5f;
+
+		for (int32 ColliderIndex = 0; ColliderIndex < NumColliders; ColliderIndex++)
+		{
+			const FSoftBoneCollider& Collider = Colliders[ColliderIndex];
+
+			const float ReachDistance = BoundsRadius + Collider.Radius;
+
+			// early out for chains far from the collider
+			if (FVector::DistSquared(BoundsCenter, FMath::ClosestPointOnSegment(BoundsCenter, Collider.Start, Collider.End)) < ReachDistance * ReachDistance)
+			{
+				CollideLinkRange(State, Collider, BeginIndex, EndIndex);
+			}
+		}
+	}
+}
+
+/** XPBD sub step of FSoftBoneSolver::TimeIntegrationXPBD specialized on the options which can't change during a sub step */
+template <bool bBoneLengthConstraint, bool bCollisions>
+static void TimeIntegrationXPBDVariant(FSoftBoneChainState& State, const FSoftBoneVectorStream& TargetPositions, float TimeDelta, const FSoftBoneSolverParams& Params)
+{
+	check(TargetPositions.Num() == State.Num());
+
+	// velocities are derived from the positions at the beginning of the step, which are also the ones for interpolated rendering
+	State.PreviousPositions.CopyFrom(State.Positions);
+	State.RestoringLambdas.SetZero();
+
+	{
+		SCOPE_CYCLE_COUNTER(STAT_SoftBoneIntegration);
+
+		ForEachAwakeRun(State, [&](int32 BeginIndex, int32 EndIndex)
+		{
+			if (Params.LinkAccelerations)
+			{
+				PredictLinkRange<true>(State, TimeDelta, Params, BeginIndex, EndIndex);
+			}
+			else
+			{
+				PredictLinkRange<false>(State, TimeDelta, Params, BeginIndex, EndIndex);
+			}
+		});
+
+		PinRoots(State, TargetPositions, false);
+	}
+
+	// compliance of each link is (ReferenceTimeStep^2 / RestoringWeight), scaled by 1 / TimeDelta^2 as XPBD does
+	// so the stiffness per second stays the same at any time step
+	const float ComplianceScale = FMath::Square(Params.ReferenceTimeStep / TimeDelta);
+
+	const int32 MaxIterations = FMath::Max(Params.NumIterations, 1);
+
+	State.NumIterations = 0;
+
+	{
+		SCOPE_CYCLE_COUNTER(STAT_SoftBoneConstraints);
+
+		// restoring constraints are independent of each other, so the first iteration of all chains is vectorized at once
+		ForEachAwakeRun(State, [&](int32 BeginIndex, int32 EndIndex)
+		{
+			SolveRestoringConstraintRange(State, TargetPositions, ComplianceScale, BeginIndex, EndIndex);
+		});
+
+		for (int32 ChainIndex = 0; ChainIndex < State.Chains.Num(); ChainIndex++)
+		{
+			const FSoftBoneChainRange& Chain = State.Chains[ChainIndex];
+
+			if (Chain.bSleeping)
+			{
+				continue;
+			}
+
+			const int32 BeginIndex = Chain.LinkOffset;
+			const int32 EndIndex = Chain.LinkOffset + Chain.NumLinks;
+
+			// a restoring constraint is satisfied by one update unless length constraints moved its link afterwards,
+			// so the length error tells whether the chain has converged
+			float MaxError = bBoneLengthConstraint ? SolveLengthConstraintRangeXPBD(State, BeginIndex, EndIndex) : 0.f;
+			State.NumIterations++;
+
+			// chains converge on their own, so still ones stop early while swinging ones keep iterating
+			for (int32 Iteration = 1; Iteration < Params.NumIterations && MaxError > Params.ConvergenceTolerance; Iteration++)
+			{
+				SolveRestoringConstraintRange(State, TargetPositions, ComplianceScale, BeginIndex, EndIndex);
+				MaxError = SolveLengthConstraintRangeXPBD(State, BeginIndex, EndIndex);
+				State.NumIterations++;
+			}
+		}
+	}
+
+	if (bCollisions)
+	{
+		FSoftBoneSolver::SolveCollisions(State, Params.Colliders, Params.NumColliders);
+	}
+
+	SCOPE_CYCLE_COUNTER(STAT_SoftBoneIntegration);
+
+	// the damping ratio is the loss of velocity per reference step
+	const float DampingCoefficient = FMath::Pow(1.0f - FMath::Clamp(Params.DampingRatio, 0.f, 1.f), TimeDelta / Params.ReferenceTimeStep);
+
+	ForEachAwakeRun(State, [&](int32 BeginIndex, int32 EndIndex)
+	{
+		UpdateVelocityRange(State, TimeDelta, DampingCoefficient, BeginIndex, EndIndex);
+	});
+
+	PinRoots(State, TargetPositions, true);
+}
+
+/**
+ * Sub step specialized on the integration and the options which can't change during a sub step.
+ * Every combination is compiled into its own loops, so none of them tests the options while solving.
+ */
+template <ESoftBoneIntegration::Type Integration, bool bBoneLengthConstraint, bool bCollisions>
+static void TimeIntegrationVariant(FSoftBoneChainState& State, const FSoftBoneVectorStream& TargetPositions, float TimeDelta, const FSoftBoneSolverParams& Params)
+{
+	check(TargetPositions.Num() == State.Num());
+
+	if (Integration == ESoftBoneIntegration::XPBD)
+	{
+		TimeIntegrationXPBDVariant<bBoneLengthConstraint, bCollisions>(State, TargetPositions, TimeDelta, Params);
+		return;
+	}
+
+	if (Integration == ESoftBoneIntegration::Analytic)
+	{
+		SCOPE_CYCLE_COUNTER(STAT_SoftBoneIntegration);
+
+		FSoftBoneSolver::UpdateAnalyticCoefficients(State, TimeDelta, Params);
+
+		ForEachAwakeRun(State, [&](int32 BeginIndex, int32 EndIndex)
+		{
+			if (Params.LinkAccelerations)
+			{
+				IntegrateAnalyticLinkRange<true>(State, TargetPositions, Params, BeginIndex, EndIndex);
+			}
+			else
+			{
+				IntegrateAnalyticLinkRange<false>(State, TargetPositions, Params, BeginIndex, EndIndex);
+			}
+		});
+	}
+	else
+	{
+		FSoftBoneSolver::IntegrateLinks(State, TargetPositions, TimeDelta, Params);
+	}
+
+	PinRoots(State, TargetPositions, true);
+
+	// without length constraints, each bone stretches like a soft body
+	if (bBoneLengthConstraint)
+	{
+		FSoftBoneSolver::SolveLengthConstraints(State);
+	}
+
+	if (bCollisions)
+	{
+		FSoftBoneSolver::SolveCollisions(State, Params.Colliders, Params.NumColliders);
+	}
+}
+
+FSoftBoneSolver::FTimeIntegrationFunction FSoftBoneSolver::GetTimeIntegrationFunction(ESoftBoneIntegration::Type Integration, bool bBoneLengthConstraint, bool bCollisions)
+{
+	// indexed by [Integration][bBoneLengthConstraint][bCollisions]
+	static const FTimeIntegrationFunction Variants[3][2][2] =
+	{
+		{
+			{ &TimeIntegrationVariant<ESoftBoneIntegration::Explicit, false, false>, &TimeIntegrationVariant<ESoftBoneIntegration::Explicit, false, true> },
+			{ &TimeIntegrationVariant<ESoftBoneIntegration::Explicit, true, false>, &TimeIntegrationVariant<ESoftBoneIntegration::Explicit, true, true> },
+		},
+		{
+			{ &TimeIntegrationVariant<ESoftBoneIntegration::XPBD, false, false>, &TimeIntegrationVariant<ESoftBoneIntegration::XPBD, false, true> },
+			{ &TimeIntegrationVariant<ESoftBoneIntegration::XPBD, true, false>, &TimeIntegrationVariant<ESoftBoneIntegration::XPBD, true, true> },
+		},
+		{
+			{ &TimeIntegrationVariant<ESoftBoneIntegration::Analytic, false, false>, &TimeIntegrationVariant<ESoftBoneIntegration::Analytic, false, true> },
+			{ &TimeIntegrationVariant<ESoftBoneIntegration::Analytic, true, false>, &TimeIntegrationVariant<ESoftBoneIntegration::Analytic, true, true> },
+		},
+	};
+
+	check(Integration >= 0 && Integration < ARRAY_COUNT(Variants));
+
+	return Variants[Integration][bBoneLengthConstraint ? 1 : 0][bCollisions ? 1 : 0];
+}
+
+void FSoftBoneSolver::TimeIntegration(FSoftBoneChainState& State, const FSoftBoneVectorStream& TargetPositions, float TimeDelta, const FSoftBoneSolverParams& Params)
+{
+	GetTimeIntegrationFunction(Params)(State, TargetPositions, TimeDelta, Params);
+}
+
+void FSoftBoneSolver::TimeIntegrationXPBD(FSoftBoneChainState& State, const FSoftBoneVectorStream& TargetPositions, float TimeDelta, const FSoftBoneSolverParams& Params)
+{
+	GetTimeIntegrationFunction(ESoftBoneIntegration::XPBD, Params.bBoneLengthConstraint, Params.NumColliders > 0)(State, TargetPositions, TimeDelta, Params);
+}
+
+float FSoftBoneSolver::Simulate(FSoftBoneChainState& State, const FSoftBoneVectorStream& FinalTargetPositions, FSoftBoneVectorStream& TargetPositions, float InRemainingTime, float FixedTimeStep, bool bFixedTimeStep, const FSoftBoneSolverParams& Params)
+{
+	SCOPE_CYCLE_COUNTER(STAT_SoftBoneSimulate);
+
+	const int32 NumLinks = State.Num();
+
+	if (TargetPositions.Num() != NumLinks)
+	{
+		TargetPositions.SetNumZeroed(NumLinks);
+		TargetPositions.CopyFrom(FinalTargetPositions);
+	}
+
+	check(Params.LinkAccelerations == nullptr || Params.LinkAccelerations->NumPadded() == State.Positions.NumPadded());
+
+	// nothing to simulate, but time still passes
+	if (State.Chains.Num() > 0 && State.NumSleepingChains == State.Chains.Num())
+	{
+		return bFixedTimeStep ? FMath::Fmod(InRemainingTime, FixedTimeStep) : 0.f;
+	}
+
+	// copy only the root bones' positions
+	for (int32 ChainIndex = 0; ChainIndex < State.Chains.Num(); ChainIndex++)
+	{
+		const int32 RootIndex = State.Chains[ChainIndex].LinkOffset;
+		TargetPositions.Set(RootIndex, State.Positions.Get(RootIndex));
+	}
+
+	// options can't change while simulating, so pick the specialized sub step once
+	const FTimeIntegrationFunction Integrate = GetTimeIntegrationFunction(Params);
+
+	// the explicit integration always pulls from the current positions, which makes its stiffness depend on the number of steps
+	const FSoftBoneVectorStream& StartPositions = (Params.Integration == ESoftBoneIntegration::Explicit) ? State.Positions : TargetPositions;
+
+	int32 NumSubSteps = 0;
+
+	if (bFixedTimeStep)
+	{
+		const int32 NumPadded = State.Positions.NumPadded();
+
+		// drop whole steps beyond the budget but keep the fraction, so the phase of the sub step clock doesn't depend on the hitch
+		if (Params.MaxSubSteps > 0 && InRemainingTime >= (Params.MaxSubSteps + 1) * FixedTimeStep)
+		{
+			InRemainingTime = Params.MaxSubSteps * FixedTimeStep + FMath::Fmod(InRemainingTime, FixedTimeStep);
+		}
+
+		while (InRemainingTime >= FixedTimeStep)
+		{
+			// keep the state before the last step of this frame for interpolated rendering
+			if (InRemainingTime < 2.f * FixedTimeStep)
+			{
+				State.PreviousPositions.CopyFrom(State.Positions);
+			}
+
+			float FixedTimeRatio = FixedTimeStep / InRemainingTime;
+			float RemainedRatio = 1.0f - FixedTimeRatio;
+
+			const VectorRegister FixedTimeRatioVec = VectorSetFloat1(FixedTimeRatio);
+			const VectorRegister RemainedRatioVec = VectorSetFloat1(RemainedRatio);
+
+			// interpolate target positions
+			for (int32 Index = 0; Index < NumPadded; Index += FSoftBoneVectorStream::Alignment)
+			{
+				VectorStoreAligned(VectorAdd(VectorMultiply(VectorLoadAligned(FinalTargetPositions.X.GetData() + Index), FixedTimeRatioVec), VectorMultiply(VectorLoadAligned(StartPositions.X.GetData() + Index), RemainedRatioVec)), TargetPositions.X.GetData() + Index);
+				VectorStoreAligned(VectorAdd(VectorMultiply(VectorLoadAligned(FinalTargetPositions.Y.GetData() + Index), FixedTimeRatioVec), VectorMultiply(VectorLoadAligned(StartPositions.Y.GetData() + Index), RemainedRatioVec)), TargetPositions.Y.GetData() + Index);
+				VectorStoreAligned(VectorAdd(VectorMultiply(VectorLoadAligned(FinalTargetPositions.Z.GetData() + Index), FixedTimeRatioVec), VectorMultiply(VectorLoadAligned(StartPositions.Z.GetData() + Index), RemainedRatioVec)), TargetPositions.Z.GetData() + Index);
+			}
+
+			Integrate(State, TargetPositions, FixedTimeStep, Params);
+
+			InRemainingTime -= FixedTimeStep;
+			NumSubSteps++;
+		}
+	}
+	else if (InRemainingTime > 0.f)
+	{
+		int32 NumSteps = 1;
+
+		// time accumulated over several frames is caught up in shorter steps, one explicit step that long would overshoot
+		if (Params.MaxStepTime > 0.f && InRemainingTime > Params.MaxStepTime)
+		{
+			NumSteps = FMath::CeilToInt(InRemainingTime / Params.MaxStepTime - KINDA_SMALL_NUMBER);
+
+			// like whole fixed steps, time beyond the limit is dropped
+			if (Params.MaxSubSteps > 0 && NumSteps > Params.MaxSubSteps)
+			{
+				NumSteps = Params.MaxSubSteps;
+				InRemainingTime = NumSteps * Params.MaxStepTime;
+			}
+		}
+
+		if (NumSteps == 1)
+		{
+			// simulate the whole remaining time at once toward the final targets
+			TargetPositions.CopyFrom(FinalTargetPositions);
+			State.PreviousPositions.CopyFrom(State.Positions);
+
+			Integrate(State, TargetPositions, InRemainingTime, Params);
+		}
+		else
+		{
+			const int32 NumPadded = State.Positions.NumPadded();
+			const float StepTime = InRemainingTime / NumSteps;
+
+			for (int32 Step = 0; Step < NumSteps; Step++)
+			{
+				if (Step == NumSteps - 1)
+				{
+					State.PreviousPositions.CopyFrom(State.Positions);
+				}
+
+				// targets move linearly toward the final ones, which the last step reaches exactly
+				const VectorRegister StepRatioVec = VectorSetFloat1(1.f / (NumSteps - Step));
+				const VectorRegister RemainedRatioVec = VectorSetFloat1(1.f - 1.f / (NumSteps - Step));
+
+				for (int32 Index = 0; Index < NumPadded; Index += FSoftBoneVectorStream::Alignment)
+				{
+					VectorStoreAligned(VectorAdd(VectorMultiply(VectorLoadAligned(FinalTargetPositions.X.GetData() + Index), StepRatioVec), VectorMultiply(VectorLoadAligned(StartPositions.X.GetData() + Index), RemainedRatioVec)), TargetPositions.X.GetData() + Index);
+					VectorStoreAligned(VectorAdd(VectorMultiply(VectorLoadAligned(FinalTargetPositions.Y.GetData() + Index), StepRatioVec), VectorMultiply(VectorLoadAligned(StartPositions.Y.GetData() + Index), RemainedRatioVec)), TargetPositions.Y.GetData() + Index);
+					VectorStoreAligned(VectorAdd(VectorMultiply(VectorLoadAligned(FinalTargetPositions.Z.GetData() + Index), StepRatioVec), VectorMultiply(VectorLoadAligned(StartPositions.Z.GetData() + Index), RemainedRatioVec)), TargetPositions.Z.GetData() + Index);
+				}
+
+				Integrate(State, TargetPositions, StepTime, Params);
+			}
+		}
+
+		InRemainingTime = 0.f;
+		NumSubSteps += NumSteps;
+	}
+
+#if STATS
+	int32 NumAwakeLinks = 0;
+
+	for (int32 ChainIndex = 0; ChainIndex < State.Chains.Num(); ChainIndex++)
+	{
+		NumAwakeLinks += State.Chains[ChainIndex].bSleeping ? 0 : State.Chains[ChainIndex].NumLinks;
+	}
+
+	INC_DWORD_STAT_BY(STAT_SoftBoneSubSteps, NumSubSteps);
+	INC_DWORD_STAT_BY(STAT_SoftBoneLinkSteps, NumSubSteps * NumAwakeLinks);
+#endif // #if STATS
+
+	return InRemainingTime;
+}
+
+/** Transforms Stream by Matrix. Translation is only applied if bTranslate is true. */
+static void TransformStream(FSoftBoneVectorStream& Stream, const FMatrix& Matrix, bool bTranslate)
+{
+	// row vector convention, P' = P * M
+	const VectorRegister M00 = VectorSetFloat1(Matrix.M[0][0]);
+	const VectorRegister M01 = VectorSetFloat1(Matrix.M[0][1]);
+	const VectorRegister M02 = VectorSetFloat1(Matrix.M[0][2]);
+	const VectorRegister M10 = VectorSetFloat1(Matrix.M[1][0]);
+	const VectorRegister M11 = VectorSetFloat1(Matrix.M[1][1]);
+	const VectorRegister M12 = VectorSetFloat1(Matrix.M[1][2]);
+	const VectorRegister M20 = VectorSetFloat1(Matrix.M[2][0]);
+	const VectorRegister M21 = VectorSetFloat1(Matrix.M[2][1]);
+	const VectorRegister M22 = VectorSetFloat1(Matrix.M[2][2]);
+	const VectorRegister TranslationX = bTranslate ? VectorSetFloat1(Matrix.M[3][0]) : VectorZero();
+	const VectorRegister TranslationY = bTranslate ? VectorSetFloat1(Matrix.M[3][1]) : VectorZero();
+	const VectorRegister TranslationZ = bTranslate ? VectorSetFloat1(Matrix.M[3][2]) : VectorZero();
+
+	float* RESTRICT StreamX = Stream.X.GetData();
+	float* RESTRICT StreamY = Stream.Y.GetData();
+	float* RESTRICT StreamZ = Stream.Z.GetData();
+
+	for (int32 Index = 0; Index < Stream.NumPadded(); Index += FSoftBoneVectorStream::Alignment)
+	{
+		const VectorRegister X = VectorLoadAligned(StreamX + Index);
+		const VectorRegister Y = VectorLoadAligned(StreamY + Index);
+		const VectorRegister Z = VectorLoadAligned(StreamZ + Index);
+
+		VectorStoreAligned(VectorMultiplyAdd(X, M00, VectorMultiplyAdd(Y, M10, VectorMultiplyAdd(Z, M20, TranslationX))), StreamX + Index);
+		VectorStoreAligned(VectorMultiplyAdd(X, M01, VectorMultiplyAdd(Y, M11, VectorMultiplyAdd(Z, M21, TranslationY))), StreamY + Index);
+		VectorStoreAligned(VectorMultiplyAdd(X, M02, VectorMultiplyAdd(Y, M12, VectorMultiplyAdd(Z, M22, TranslationZ))), StreamZ + Index);
+	}
+}
+
+void FSoftBoneSolver::TransformLinks(FSoftBoneChainState& State, const FTransform& Transform)
+{
+	const FMatrix Matrix = Transform.ToMatrixWithScale();
+
+	TransformStream(State.Positions, Matrix, true);
+	TransformStream(State.PreviousPositions, Matrix, true);
+
+	// velocities are directions, so they don't get any translation
+	TransformStream(State.Velocities, Matrix, false);
+}
+
+void FSoftBoneSolver::TransformPositions(FSoftBoneVectorStream& Positions, const FTransform& Transform)
+{
+	TransformStream(Positions, Transform.ToMatrixWithScale(), true);
+}
+
+/** Rounds Value / Scale to the nearest integer which fits in 16 bits */
+static FORCEINLINE int16 QuantizeSigned(float Value, float InvScale)
+{
+	return (int16)FMath::Clamp(FMath::RoundToInt(Value * InvScale), -MAX_int16, (int32)MAX_int16);
+}
+
+static FORCEINLINE uint16 QuantizeUnsigned(float Value, float InvScale)
+{
+	return (uint16)FMath::Clamp(FMath::RoundToInt(Value * InvScale), 0, (int32)MAX_uint16);
+}
+
+/** Scale which maps MaxValue to MaxQuantized, or 1 if all values are zero */
+static FORCEINLINE float GetQuantizationScale(float MaxValue, float MaxQuantized)
+{
+	return (MaxValue > 0.f) ? MaxValue / MaxQuantized : 1.f;
+}
+
+static FORCEINLINE void QuantizeVector(int16* OutValue, const FVector& Value, float InvScale)
+{
+	OutValue[0] = QuantizeSigned(Value.X, InvScale);
+	OutValue[1] = QuantizeSigned(Value.Y, InvScale);
+	OutValue[2] = QuantizeSigned(Value.Z, InvScale);
+}
+
+static FORCEINLINE FVector DequantizeVector(const int16* Value, float Scale)
+{
+	return FVector(Value[0] * Scale, Value[1] * Scale, Value[2] * Scale);
+}
+
+/** true if Stream is given and has a value for each link */
+static FORCEINLINE bool HasLinkStream(const FSoftBoneVectorStream* Stream, const FSoftBoneChainState& State)
+{
+	return Stream && Stream->Num() > 0 && Stream->Num() == State.Num();
+}
+
+/** Sizes Positions for the links of CompactState if the stream is kept, or empties it */
+static FORCEINLINE void ResizeCompactPositions(TArray<FSoftBoneCompactPosition>& Positions, bool bKeep, int32 NumLinks)
+{
+	Positions.Reset(bKeep ? NumLinks : 0);
+
+	if (bKeep)
+	{
+		Positions.AddUninitialized(NumLinks);
+	}
+}
+
+void FSoftBoneSolver::CompressState(const FSoftBoneChainState& State, const FSoftBoneVectorStream& TargetPositions, FSoftBoneCompactChainState& OutCompactState,
+	const FSoftBoneVectorStream* FinalTargetPositions, const FSoftBoneVectorStream* ReferenceTargetPositions, const FSoftBoneVectorStream* LinkAccelerations)
+{
+	const bool bHasTargetPositions = (TargetPositions.Num() == State.Num());
+	const bool bHasFinalTargetPositions = HasLinkStream(FinalTargetPositions, State);
+	const bool bHasReferenceTargetPositions = HasLinkStream(ReferenceTargetPositions, State);
+	const bool bHasLinkAccelerations = HasLinkStream(LinkAccelerations, State);
+
+	OutCompactState.Links.Reset(State.Num());
+	OutCompactState.Links.AddUninitialized(State.Num());
+	OutCompactState.Chains.Reset(State.Chains.Num());
+	ResizeCompactPositions(OutCompactState.FinalTargetPositions, bHasFinalTargetPositions, State.Num());
+	ResizeCompactPositions(OutCompactState.ReferenceTargetPositions, bHasReferenceTargetPositions, State.Num());
+	OutCompactState.NumSleepingChains = State.NumSleepingChains;
+	OutCompactState.bHasTargetPositions = bHasTargetPositions;
+	OutCompactState.bHasLinkAccelerations = bHasLinkAccelerations;
+
+	for (int32 ChainIndex = 0; ChainIndex < State.Chains.Num(); ChainIndex++)
+	{
+		const FSoftBoneChainRange& Range = State.Chains[ChainIndex];
+		const int32 BeginIndex = Range.LinkOffset;
+		const int32 EndIndex = Range.LinkOffset + Range.NumLinks;
+
+		FSoftBoneCompactChain& Chain = OutCompactState.Chains[OutCompactState.Chains.AddUninitialized()];
+		Chain.Range = Range;
+		Chain.Origin = (Range.NumLinks > 0) ? State.Positions.Get(BeginIndex) : FVector::ZeroVector;
+		Chain.Acceleration = (bHasLinkAccelerations && Range.NumLinks > 0) ? LinkAccelerations->Get(BeginIndex) : FVector::ZeroVector;
+
+		// fit the scales to the largest values of the chain
+		float MaxOffset = 0.f;
+		float MaxVelocity = 0.f;
+		float MaxLength = 0.f;
+		float MaxWeight = 0.f;
+
+		for (int32 Index = BeginIndex; Index < EndIndex; Index++)
+		{
+			MaxOffset = FMath::Max(MaxOffset, (State.Positions.Get(Index) - Chain.Origin).GetAbsMax());
+			MaxOffset = FMath::Max(MaxOffset, (State.PreviousPositions.Get(Index) - Chain.Origin).GetAbsMax());
+
+			if (bHasTargetPositions)
+			{
+				MaxOffset = FMath::Max(MaxOffset, (TargetPositions.Get(Index) - Chain.Origin).GetAbsMax());
+			}
+
+			if (bHasFinalTargetPositions)
+			{
+				MaxOffset = FMath::Max(MaxOffset, (FinalTargetPositions->Get(Index) - Chain.Origin).GetAbsMax());
+			}
+
+			if (bHasReferenceTargetPositions)
+			{
+				MaxOffset = FMath::Max(MaxOffset, (ReferenceTargetPositions->Get(Index) - Chain.Origin).GetAbsMax());
+			}
+
+			MaxVelocity = FMath::Max(MaxVelocity, State.Velocities.Get(Index).GetAbsMax());
+			MaxLength = FMath::Max(MaxLength, State.Lengths[Index]);
+			MaxWeight = FMath::Max(MaxWeight, State.RestoringWeights[Index]);
+		}
+
+		Chain.PositionScale = GetQuantizationScale(MaxOffset, MAX_int16);
+		Chain.VelocityScale = GetQuantizationScale(MaxVelocity, MAX_int16);
+		Chain.LengthScale = GetQuantizationScale(MaxLength, MAX_uint16);
+		Chain.WeightScale = GetQuantizationScale(MaxWeight, MAX_uint16);
+
+		const float InvPositionScale = 1.f / Chain.PositionScale;
+		const float InvVelocityScale = 1.f / Chain.VelocityScale;
+		const float InvLengthScale = 1.f / Chain.LengthScale;
+		const float InvWeightScale = 1.f / Chain.WeightScale;
+
+		for (int32 Index = BeginIndex; Index < EndIndex; Index++)
+		{
+			FSoftBoneCompactLink& Link = OutCompactState.Links[Index];
+
+			const FVector Position = State.Positions.Get(Index);
+			QuantizeVector(Link.Position, Position - Chain.Origin, InvPositionScale);
+			QuantizeVector(Link.PreviousPosition, State.PreviousPositions.Get(Index) - Chain.Origin, InvPositionScale);
+			QuantizeVector(Link.TargetPosition, (bHasTargetPositions ? TargetPositions.Get(Index) : Position) - Chain.Origin, InvPositionScale);
+			QuantizeVector(Link.Velocity, State.Velocities.Get(Index), InvVelocityScale);
+
+			if (bHasFinalTargetPositions)
+			{
+				QuantizeVector(OutCompactState.FinalTargetPositions[Index].Value, FinalTargetPositions->Get(Index) - Chain.Origin, InvPositionScale);
+			}
+
+			if (bHasReferenceTargetPositions)
+			{
+				QuantizeVector(OutCompactState.ReferenceTargetPositions[Index].Value, ReferenceTargetPositions->Get(Index) - Chain.Origin, InvPositionScale);
+			}
+
+			Link.Length = QuantizeUnsigned(State.Lengths[Index], InvLengthScale);
+			Link.RestoringWeight = QuantizeUnsigned(State.RestoringWeights[Index], InvWeightScale);
+
+			// offset 0 marks a root, any other link's parent comes before it in the same chain
+			const int32 ParentIndex = State.ParentIndices[Index];
+
+			if (ParentIndex == INDEX_NONE)
+			{
+				Link.ParentOffset = 0;
+			}
+			else
+			{
+				checkSlow(ParentIndex >= BeginIndex && ParentIndex < Index && Index - ParentIndex <= MAX_uint16);
+				Link.ParentOffset = (uint16)(Index - ParentIndex);
+			}
+		}
+	}
+}
+
+void FSoftBoneSolver::DecompressState(const FSoftBoneCompactChainState& CompactState, FSoftBoneChainState& OutState, FSoftBoneVectorStream& OutTargetPositions,
+	FSoftBoneVectorStream* OutFinalTargetPositions, FSoftBoneVectorStream* OutReferenceTargetPositions, FSoftBoneVectorStream* OutLinkAccelerations)
+{
+	const bool bHasFinalTargetPositions = (CompactState.FinalTargetPositions.Num() > 0);
+	const bool bHasReferenceTargetPositions = (CompactState.ReferenceTargetPositions.Num() > 0);
+
+	OutState.Reset(CompactState.Num());
+	OutTargetPositions.SetNumZeroed(CompactState.bHasTargetPositions ? CompactState.Num() : 0);
+
+	if (OutFinalTargetPositions)
+	{
+		OutFinalTargetPositions->SetNumZeroed(bHasFinalTargetPositions ? CompactState.Num() : 0);
+	}
+
+	if (OutReferenceTargetPositions)
+	{
+		OutReferenceTargetPositions->SetNumZeroed(bHasReferenceTargetPositions ? CompactState.Num() : 0);
+	}
+
+	if (OutLinkAccelerations)
+	{
+		OutLinkAccelerations->SetNumZeroed(CompactState.bHasLinkAccelerations ? CompactState.Num() : 0);
+	}
+
+	for (int32 ChainIndex = 0; ChainIndex < CompactState.Chains.Num(); ChainIndex++)
+	{
+		const FSoftBoneCompactChain& Chain = CompactState.Chains[ChainIndex];
+		const int32 BeginIndex = OutState.AddChain(Chain.Range.NumLinks);
+		const int32 EndIndex = BeginIndex + Chain.Range.NumLinks;
+
+		OutState.Chains.Last().bSleeping = Chain.Range.bSleeping;
+		OutState.Chains.Last().SleepTime = Chain.Range.SleepTime;
+
+		for (int32 Index = BeginIndex; Index < EndIndex; Index++)
+		{
+			const FSoftBoneCompactLink& Link = CompactState.Links[Index];
+
+			OutState.Positions.Set(Index, Chain.Origin + DequantizeVector(Link.Position, Chain.PositionScale));
+			OutState.PreviousPositions.Set(Index, Chain.Origin + DequantizeVector(Link.PreviousPosition, Chain.PositionScale));
+			OutState.Velocities.Set(Index, DequantizeVector(Link.Velocity, Chain.VelocityScale));
+			OutState.ParentIndices[Index] = (Link.ParentOffset > 0) ? Index - Link.ParentOffset : INDEX_NONE;
+			OutState.Lengths[Index] = Link.Length * Chain.LengthScale;
+			OutState.RestoringWeights[Index] = Link.RestoringWeight * Chain.WeightScale;
+
+			if (CompactState.bHasTargetPositions)
+			{
+				OutTargetPositions.Set(Index, Chain.Origin + DequantizeVector(Link.TargetPosition, Chain.PositionScale));
+			}
+
+			if (OutFinalTargetPositions && bHasFinalTargetPositions)
+			{
+				OutFinalTargetPositions->Set(Index, Chain.Origin + DequantizeVector(CompactState.FinalTargetPositions[Index].Value, Chain.PositionScale));
+			}
+
+			if (OutReferenceTargetPositions && bHasReferenceTargetPositions)
+			{
+				OutReferenceTargetPositions->Set(Index, Chain.Origin + DequantizeVector(CompactState.ReferenceTargetPositions[Index].Value, Chain.PositionScale));
+			}
+
+			if (OutLinkAccelerations && CompactState.bHasLinkAccelerations)
+			{
+				OutLinkAccelerations->Set(Index, Chain.Acceleration);
+			}
+		}
+	}
+
+	OutState.NumSleepingChains = CompactState.NumSleepingChains;
+}
+
+void FSoftBoneSolver::PullBonesToFinalPosition(const FSoftBoneChainState& State, const FSoftBoneVectorStream& FinalTargetPositions, const FSoftBoneVectorStream& TargetPositions, FVector* OutRenderPositions)
+{
+	for (int32 ChainIndex = 0; ChainIndex < State.Chains.Num(); ChainIndex++)
+	{
+		const FSoftBoneChainRange& Chain = State.Chains[ChainIndex];
+
+		const FVector RootBoneDiff = FinalTargetPositions.Get(Chain.LinkOffset) - TargetPositions.Get(Chain.LinkOffset);
+
+		for (int32 Index = Chain.LinkOffset; Index < Chain.LinkOffset + Chain.NumLinks; Index++)
+		{
+			OutRenderPositions[Index] = State.Positions.Get(Index) + RootBoneDiff;
+		}
+	}
+}
+
+void FSoftBoneSolver::InterpolateBonesToFinalPosition(const FSoftBoneChainState& State, const FSoftBoneVectorStream& FinalTargetPositions, float Alpha, FVector* OutRenderPositions)
+{
+	for (int32 ChainIndex = 0; ChainIndex < State.Chains.Num(); ChainIndex++)
+	{
+		const FSoftBoneChainRange& Chain = State.Chains[ChainIndex];
+
+		for (int32 Index = Chain.LinkOffset; Index < Chain.LinkOffset + Chain.NumLinks; Index++)
+		{
+			OutRenderPositions[Index] = FMath::Lerp(State.PreviousPositions.Get(Index), State.Positions.Get(Index), Alpha);
+		}
+
+		// the interpolated root lags behind, so move the chain back onto the current pose
+		const FVector RootBoneDiff = FinalTargetPositions.Get(Chain.LinkOffset) - OutRenderPositions[Chain.LinkOffset];
+
+		for (int32 Index = Chain.LinkOffset; Index < Chain.LinkOffset + Chain.NumLinks; Index++)
+		{
+			OutRenderPositions[Index] += RootBoneDiff;
+		}
+	}
+}
+
+void FSoftBoneSolver::ExtrapolateBonesToFinalPosition(const FSoftBoneChainState& State, const FSoftBoneVectorStream& FinalTargetPositions, float Time, FVector* OutRenderPositions)
+{
+	for (int32 ChainIndex = 0; ChainIndex < State.Chains.Num(); ChainIndex++)
+	{
+		const FSoftBoneChainRange& Chain = State.Chains[ChainIndex];
+
+		for (int32 Index = Chain.LinkOffset; Index < Chain.LinkOffset + Chain.NumLinks; Index++)
+		{
+			OutRenderPositions[Index] = State.Positions.Get(Index) + State.Velocities.Get(Index) * Time;
+		}
+
+		const FVector RootBoneDiff = FinalTargetPositions.Get(Chain.LinkOffset) - OutRenderPositions[Chain.LinkOffset];
+
+		for (int32 Index = Chain.LinkOffset; Index < Chain.LinkOffset + Chain.NumLinks; Index++)
+		{
+			OutRenderPositions[Index] += RootBoneDiff;
+		}
+	}
+}
+
+FQuat FSoftBoneSolver::ComputeDeltaRotation(const FVector& OldDir, const FVector& NewDir)
+{
+	// Calculate axis of rotation from pre-translation vector to post-translation vector
+	FVector const RotationAxis = FVector::CrossProduct(OldDir, NewDir).GetSafeNormal();
+	float const RotationAngle = FMath::Acos(FVector::DotProduct(OldDir, NewDir));
+	FQuat const DeltaRotation = FQuat(RotationAxis, RotationAngle);
+	// We're going to multiply it, in order to not have to re-normalize the final quaternion, it has to be a unit quaternion.
+	checkSlow(DeltaRotation.IsNormalized());
+
+	return DeltaRotation;
+}
+
+void FSoftBoneSolver::ComputeShortestArcRotations(const FSoftBoneVectorStream& FromDirections, const FSoftBoneVectorStream& ToDirections, FSoftBoneQuatStream& OutRotations)
+{
+	check(FromDirections.NumPadded() == ToDirections.NumPadded());
+
+	const int32 NumPadded = FromDirections.NumPadded();
+
+	if (OutRotations.NumPadded() != NumPadded)
+	{
+		OutRotations.SetNumZeroed(FromDirections.Num());
+	}
+
+	// rotations closer to a half turn than this, relative to the lengths of both directions, have no stable axis
+	const VectorRegister MinNormSquared = VectorSetFloat1(1.e-6f);
+	const VectorRegister One = VectorOne();
+	const VectorRegister Zero = VectorZero();
+
+	for (int32 Index = 0; Index < NumPadded; Index += FSoftBoneVectorStream::Alignment)
+	{
+		const VectorRegister AX = VectorLoadAligned(FromDirections.X.GetData() + Index);
+		const VectorRegister AY = VectorLoadAligned(FromDirections.Y.GetData() + Index);
+		const VectorRegister AZ = VectorLoadAligned(FromDirections.Z.GetData() + Index);
+		const VectorRegister BX = VectorLoadAligned(ToDirections.X.GetData() + Index);
+		const VectorRegister BY = VectorLoadAligned(ToDirections.Y.GetData() + Index);
+		const VectorRegister BZ = VectorLoadAligned(ToDirections.Z.GetData() + Index);
+
+		const VectorRegister Dot = VectorMultiplyAdd(AX, BX, VectorMultiplyAdd(AY, BY, VectorMultiply(AZ, BZ)));
+		const VectorRegister LengthsSquared = VectorMultiply(
+			VectorMultiplyAdd(AX, AX, VectorMultiplyAdd(AY, AY, VectorMultiply(AZ, AZ))),
+			VectorMultiplyAdd(BX, BX, VectorMultiplyAdd(BY, BY, VectorMultiply(BZ, BZ))));
+
+		// q = (|A||B| + A.B, A x B) normalized, which is the half angle rotation for directions of any length
+		// zero lengths give NaN here, which fails the comparison below
+		const VectorRegister QW = VectorAdd(VectorMultiply(LengthsSquared, VectorReciprocalSqrtAccurate(LengthsSquared)), Dot);
+		const VectorRegister QX = VectorSubtract(VectorMultiply(AY, BZ), VectorMultiply(AZ, BY));
+		const VectorRegister QY = VectorSubtract(VectorMultiply(AZ, BX), VectorMultiply(AX, BZ));
+		const VectorRegister QZ = VectorSubtract(VectorMultiply(AX, BY), VectorMultiply(AY, BX));
+
+		const VectorRegister NormSquared = VectorMultiplyAdd(QW, QW, VectorMultiplyAdd(QX, QX, VectorMultiplyAdd(QY, QY, VectorMultiply(QZ, QZ))));
+		const VectorRegister ValidMask = VectorCompareGT(NormSquared, VectorMultiply(LengthsSquared, MinNormSquared));
+		const VectorRegister InvNorm = VectorReciprocalSqrtAccurate(NormSquared);
+
+		VectorStoreAligned(VectorSelect(ValidMask, VectorMultiply(QX, InvNorm), Zero), OutRotations.X.GetData() + Index);
+		VectorStoreAligned(VectorSelect(ValidMask, VectorMultiply(QY, InvNorm), Zero), OutRotations.Y.GetData() + Index);
+		VectorStoreAligned(VectorSelect(ValidMask, VectorMultiply(QZ, InvNorm), Zero), OutRotations.Z.GetData() + Index);
+		VectorStoreAligned(VectorSelect(ValidMask, VectorMultiply(QW, InvNorm), One), OutRotations.W.GetData() + Index);
+	}
+}
+
+void FSoftBoneSolver::UpdateSleepStates(FSoftBoneChainState& State, const FSoftBoneVectorStream& FinalTargetPositions, FSoftBoneVectorStream& ReferenceTargetPositions, const FSoftBoneSleepParams& SleepParams, float DeltaTime)
+{
+	check(ReferenceTargetPositions.Num() == State.Num());
+
+	const float VelocityThresholdSquared = FMath::Square(SleepParams.VelocityThreshold);
+	const float TargetThresholdSquared = FMath::Square(SleepParams.TargetThreshold);
+
+	State.NumSleepingChains = 0;
+
+	for (int32 ChainIndex = 0; ChainIndex < State.Chains.Num(); ChainIndex++)
+	{
+		FSoftBoneChainRange& Chain = State.Chains[ChainIndex];
+		const int32 EndIndex = Chain.LinkOffset + Chain.NumLinks;
+
+		// sleeping chains compare with the targets they fell asleep with, so slow drift wakes them up as well
+		float MaxTargetDeltaSquared = 0.f;
+		for (int32 LinkIndex = Chain.LinkOffset; LinkIndex < EndIndex; LinkIndex++)
+		{
+			MaxTargetDeltaSquared = FMath::Max(MaxTargetDeltaSquared, FVector::DistSquared(FinalTargetPositions.Get(LinkIndex), ReferenceTargetPositions.Get(LinkIndex)));
+		}
+
+		const bool bTargetsMoved = (MaxTargetDeltaSquared > TargetThresholdSquared);
+
+		if (Chain.bSleeping)
+		{
+			if (!bTargetsMoved)
+			{
+				State.NumSleepingChains++;
+				continue;
+			}
+
+			Chain.bSleeping = false;
+			Chain.SleepTime = 0.f;
+		}
+		else
+		{
+			float MaxSpeedSquared = 0.f;
+			for (int32 LinkIndex = Chain.LinkOffset; LinkIndex < EndIndex; LinkIndex++)
+			{
+				MaxSpeedSquared = FMath::Max(MaxSpeedSquared, State.Velocities.Get(LinkIndex).SizeSquared());
+			}
+
+			// a swinging chain slows down at its turning points, so it should stay still for a while
+			Chain.SleepTime = (!bTargetsMoved && MaxSpeedSquared < VelocityThresholdSquared) ? Chain.SleepTime + DeltaTime : 0.f;
+
+			if (Chain.SleepTime >= SleepParams.Delay)
+			{
+				Chain.bSleeping = true;
+				State.NumSleepingChains++;
+
+				// wake up from rest
+				for (int32 LinkIndex = Chain.LinkOffset; LinkIndex < EndIndex; LinkIndex++)
+				{
+					State.Velocities.Set(LinkIndex, FVector::ZeroVector);
+				}
+			}
+		}
+
+		for (int32 LinkIndex = Chain.LinkOffset; LinkIndex < EndIndex; LinkIndex++)
+		{
+			ReferenceTargetPositions.Set(LinkIndex, FinalTargetPositions.Get(LinkIndex));
+		}
+	}
+}
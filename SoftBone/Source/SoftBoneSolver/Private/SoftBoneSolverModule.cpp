@@ -0,0 +1,6 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "SoftBoneSolver.h"
+#include "ModuleManager.h"
+
+IMPLEMENT_MODULE(FDefaultModuleImpl, SoftBoneSolver)
@@ -0,0 +1,678 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "Core.h"
+
+/**
+ *	Engine independent solver for soft bone chains.
+ *	It only works on plain position, velocity and length buffers, so it doesn't know anything about poses, components or worlds
+ *	and can be run and profiled without a skeletal mesh. Its module only depends on Core.
+ */
+
+DECLARE_STATS_GROUP(TEXT("SoftBone"), STATGROUP_SoftBone, STATCAT_Advanced);
+
+/** Sphere or capsule links are pushed out of. A sphere has the same start and end. */
+struct FSoftBoneCollider
+{
+	/** Ends of the capsule segment in simulation space */
+	FVector Start;
+	FVector End;
+
+	float Radius;
+
+	FSoftBoneCollider()
+		: Start(FVector::ZeroVector)
+		, End(FVector::ZeroVector)
+		, Radius(0.f)
+	{
+	}
+
+	FSoftBoneCollider(const FVector& InStart, const FVector& InEnd, float InRadius)
+		: Start(InStart)
+		, End(InEnd)
+		, Radius(InRadius)
+	{
+	}
+};
+
+/** How links are advanced toward their targets in each step */
+namespace ESoftBoneIntegration
+{
+	enum Type
+	{
+		/** Restoring impulse scaled by the time step and one length constraint pass. The motion depends on the time step. */
+		Explicit,
+		/** Iterated XPBD constraints with compliances defined at ReferenceTimeStep */
+		XPBD,
+		/**
+		 * Closed form solution of the damped spring of each link toward its target, defined at ReferenceTimeStep like XPBD,
+		 * then one length constraint pass. Stable at any time step, so one step per frame looks like fixed steps.
+		 */
+		Analytic,
+	};
+}
+
+struct FSoftBoneVectorStream;
+
+/** Parameters shared by all links of a chain during a simulation step */
+struct FSoftBoneSolverParams
+{
+	/** Acceleration applied to all links except the root. (e.g. Gravity) */
+	FVector ExternalAcceleration;
+
+	/**
+	 * Acceleration of each link added to ExternalAcceleration, e.g. wind sampled once per chain. Null if there is none.
+	 * Padded like the state. Not owned, it should stay valid while simulating.
+	 */
+	const FSoftBoneVectorStream* LinkAccelerations;
+
+	/** ranged [0..1] Velocity Damping Ratio, 0 means No damping, 1 means Velocity will be 0 at next tick. */
+	float DampingRatio;
+
+	/** if false, bone length will be stretched like a spring */
+	bool bBoneLengthConstraint;
+
+	/** Maximum number of fixed sub steps per call of Simulate. Whole steps beyond it are dropped. 0 means no limit. */
+	int32 MaxSubSteps;
+
+	/**
+	 * Longest step in seconds without fixed time steps, 0 means no limit. Time accumulated over several frames, e.g. by an instance
+	 * deferred by the frame budget, is simulated in equal steps no longer than this, at most MaxSubSteps of them.
+	 */
+	float MaxStepTime;
+
+	/** Colliders resolved after the length constraints. Not owned, they should stay valid while simulating. */
+	const FSoftBoneCollider* Colliders;
+	int32 NumColliders;
+
+	/**
+	 * With XPBD, links are predicted and constraints are solved iteratively instead of the explicit restoring impulse.
+	 * XPBD and Analytic turn restoring weights into stiffnesses and damping into a loss per second at ReferenceTimeStep,
+	 * so the motion stays the same at any time step. The explicit solver only looks like this when it steps at ReferenceTimeStep.
+	 */
+	ESoftBoneIntegration::Type Integration;
+
+	/** Maximum number of constraint iterations per sub step in XPBD */
+	int32 NumIterations;
+
+	/** XPBD stops iterating a chain when none of its lengths was off by more than this in the last iteration */
+	float ConvergenceTolerance;
+
+	/** Time step which restoring weights and damping ratio are defined at in XPBD and Analytic */
+	float ReferenceTimeStep;
+
+	FSoftBoneSolverParams()
+		: ExternalAcceleration(FVector::ZeroVector)
+		, LinkAccelerations(nullptr)
+		, DampingRatio(0.1f)
+		, bBoneLengthConstraint(true)
+		, MaxSubSteps(0)
+		, MaxStepTime(0.f)
+		, Colliders(nullptr)
+		, NumColliders(0)
+		, Integration(ESoftBoneIntegration::Explicit)
+		, NumIterations(2)
+		, ConvergenceTolerance(0.1f)
+		, ReferenceTimeStep(1.f / 120.f)
+	{
+	}
+};
+
+/** Thresholds to put still chains to sleep */
+struct FSoftBoneSleepParams
+{
+	/** Chains fall asleep when all links are slower than this */
+	float VelocityThreshold;
+
+	/** Chains fall asleep when no target moved farther than this since the last frame, and wake up when any target moved farther than this */
+	float TargetThreshold;
+
+	/** Time in seconds to stay still before falling asleep */
+	float Delay;
+
+	FSoftBoneSleepParams()
+		: VelocityThreshold(1.f)
+		, TargetThreshold(0.1f)
+		, Delay(0.5f)
+	{
+	}
+};
+
+/** Float stream aligned and padded for vector registers */
+typedef TArray<float, TAlignedHeapAllocator<16>> FSoftBoneFloatStream;
+
+/**
+ * Structure of arrays of vectors. X, Y and Z are stored in separate streams
+ * which are padded with zeros to a multiple of the vector register width, so kernels can process 4 links at once.
+ */
+struct FSoftBoneVectorStream
+{
+	enum { Alignment = 4 };
+
+	FSoftBoneFloatStream X;
+	FSoftBoneFloatStream Y;
+	FSoftBoneFloatStream Z;
+
+	FSoftBoneVectorStream()
+		: NumElements(0)
+	{
+	}
+
+	int32 Num() const
+	{
+		return NumElements;
+	}
+
+	/** Number of elements including padding */
+	int32 NumPadded() const
+	{
+		return X.Num();
+	}
+
+	static int32 GetPaddedNum(int32 InNum)
+	{
+		return Align(InNum, (int32)Alignment);
+	}
+
+	void SetNumZeroed(int32 InNum)
+	{
+		const int32 PaddedNum = GetPaddedNum(InNum);
+
+		X.Reset(PaddedNum);
+		Y.Reset(PaddedNum);
+		Z.Reset(PaddedNum);
+		X.AddZeroed(PaddedNum);
+		Y.AddZeroed(PaddedNum);
+		Z.AddZeroed(PaddedNum);
+
+		NumElements = InNum;
+	}
+
+	/** Sets all elements to zero without reallocating */
+	void SetZero()
+	{
+		FMemory::Memzero(X.GetData(), sizeof(float) * NumPadded());
+		FMemory::Memzero(Y.GetData(), sizeof(float) * NumPadded());
+		FMemory::Memzero(Z.GetData(), sizeof(float) * NumPadded());
+	}
+
+	/** Copies all elements from a stream of the same size without reallocating */
+	void CopyFrom(const FSoftBoneVectorStream& Other)
+	{
+		check(NumPadded() == Other.NumPadded());
+
+		FMemory::Memcpy(X.GetData(), Other.X.GetData(), sizeof(float) * Other.NumPadded());
+		FMemory::Memcpy(Y.GetData(), Other.Y.GetData(), sizeof(float) * Other.NumPadded());
+		FMemory::Memcpy(Z.GetData(), Other.Z.GetData(), sizeof(float) * Other.NumPadded());
+	}
+
+	FORCEINLINE FVector Get(int32 Index) const
+	{
+		return FVector(X[Index], Y[Index], Z[Index]);
+	}
+
+	FORCEINLINE void Set(int32 Index, const FVector& Value)
+	{
+		X[Index] = Value.X;
+		Y[Index] = Value.Y;
+		Z[Index] = Value.Z;
+	}
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return X.GetAllocatedSize() + Y.GetAllocatedSize() + Z.GetAllocatedSize();
+	}
+
+private:
+	int32 NumElements;
+};
+
+/** Structure of arrays of quaternions, padded like FSoftBoneVectorStream */
+struct FSoftBoneQuatStream
+{
+	FSoftBoneFloatStream X;
+	FSoftBoneFloatStream Y;
+	FSoftBoneFloatStream Z;
+	FSoftBoneFloatStream W;
+
+	int32 NumPadded() const
+	{
+		return X.Num();
+	}
+
+	void SetNumZeroed(int32 InNum)
+	{
+		const int32 PaddedNum = FSoftBoneVectorStream::GetPaddedNum(InNum);
+
+		FSoftBoneFloatStream* const Streams[4] = { &X, &Y, &Z, &W };
+
+		for (int32 StreamIndex = 0; StreamIndex < 4; StreamIndex++)
+		{
+			Streams[StreamIndex]->Reset(PaddedNum);
+			Streams[StreamIndex]->AddZeroed(PaddedNum);
+		}
+	}
+
+	FORCEINLINE FQuat Get(int32 Index) const
+	{
+		return FQuat(X[Index], Y[Index], Z[Index], W[Index]);
+	}
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return X.GetAllocatedSize() + Y.GetAllocatedSize() + Z.GetAllocatedSize() + W.GetAllocatedSize();
+	}
+};
+
+/**
+ * Closed form of the damped spring of each link over one time step, per link and padded like the vector streams.
+ * With Offset = Position - Target, the step is
+ *   Offset' = OffsetFromOffset * Offset + OffsetFromVelocity * Velocity + OffsetFromAcceleration * Acceleration
+ *   Velocity' = VelocityFromOffset * Offset + VelocityFromVelocity * Velocity + OffsetFromVelocity * Acceleration
+ * Coefficients only depend on the time step, restoring weights and damping, so they are computed again only when one of them changes.
+ */
+struct FSoftBoneAnalyticCoefficients
+{
+	FSoftBoneFloatStream OffsetFromOffset;
+	FSoftBoneFloatStream OffsetFromVelocity;
+	FSoftBoneFloatStream OffsetFromAcceleration;
+	FSoftBoneFloatStream VelocityFromOffset;
+	FSoftBoneFloatStream VelocityFromVelocity;
+
+	/** Inputs the coefficients have been computed with. 0 time step means they are out of date. */
+	float TimeStep;
+	float DampingRatio;
+	float ReferenceTimeStep;
+
+	FSoftBoneAnalyticCoefficients()
+		: TimeStep(0.f)
+		, DampingRatio(0.f)
+		, ReferenceTimeStep(0.f)
+	{
+	}
+
+	void Invalidate()
+	{
+		TimeStep = 0.f;
+	}
+
+	bool IsUpToDate(float InTimeStep, float InDampingRatio, float InReferenceTimeStep) const
+	{
+		return TimeStep == InTimeStep && DampingRatio == InDampingRatio && ReferenceTimeStep == InReferenceTimeStep;
+	}
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return OffsetFromOffset.GetAllocatedSize() + OffsetFromVelocity.GetAllocatedSize() + OffsetFromAcceleration.GetAllocatedSize()
+			+ VelocityFromOffset.GetAllocatedSize() + VelocityFromVelocity.GetAllocatedSize();
+	}
+};
+
+/** Range of links of a chain in FSoftBoneChainState. The first link of the range is the root of the chain. */
+struct FSoftBoneChainRange
+{
+	int32 LinkOffset;
+	int32 NumLinks;
+
+	/** Sleeping chains are skipped by the solver */
+	bool bSleeping;
+
+	/** How long the chain has been still while awake */
+	float SleepTime;
+
+	FSoftBoneChainRange()
+		: LinkOffset(0)
+		, NumLinks(0)
+		, bSleeping(false)
+		, SleepTime(0.f)
+	{
+	}
+
+	FSoftBoneChainRange(int32 InLinkOffset, int32 InNumLinks)
+		: LinkOffset(InLinkOffset)
+		, NumLinks(InNumLinks)
+		, bSleeping(false)
+		, SleepTime(0.f)
+	{
+	}
+};
+
+/**
+ * Dynamic state of all chains, flattened into one buffer so they can be advanced together in one sub step loop.
+ * Root links of chains don't have a parent and they are always pinned to their target positions.
+ * Links are stored in parent-first order. Hot data which is read and written in every sub step is split from cold data which is only read.
+ */
+struct FSoftBoneChainState
+{
+	/** Current simulated positions */
+	FSoftBoneVectorStream Positions;
+
+	/** Simulated positions before the last sub step, for rendering in between the last two fixed states */
+	FSoftBoneVectorStream PreviousPositions;
+
+	/** Current velocities */
+	FSoftBoneVectorStream Velocities;
+
+	/** Accumulated multipliers of the restoring constraints in the current XPBD sub step */
+	FSoftBoneVectorStream RestoringLambdas;
+
+	/** Pre-calculated weight for restoring. Padded like the vector streams. */
+	FSoftBoneFloatStream RestoringWeights;
+
+	/** Distance to its parent link. */
+	TArray<float> Lengths;
+
+	/** Index of parent link, INDEX_NONE for root links */
+	TArray<int32> ParentIndices;
+
+	/** Allocated by the analytic integration on its first step */
+	FSoftBoneAnalyticCoefficients AnalyticCoefficients;
+
+	/** Links of each chain */
+	TArray<FSoftBoneChainRange> Chains;
+
+	/** Number of chains in Chains which are sleeping */
+	int32 NumSleepingChains;
+
+	/** Constraint iterations run by all awake chains in the last XPBD sub step. Chains stop iterating on their own when they converge. */
+	int32 NumIterations;
+
+	FSoftBoneChainState()
+		: NumSleepingChains(0)
+		, NumIterations(0)
+	{
+	}
+
+	int32 Num() const
+	{
+		return Positions.Num();
+	}
+
+	/** Allocates zeroed links and removes all chains. Links should be set by AddChain and SetLink afterwards */
+	void Reset(int32 NumLinks = 0)
+	{
+		Positions.SetNumZeroed(NumLinks);
+		PreviousPositions.SetNumZeroed(NumLinks);
+		Velocities.SetNumZeroed(NumLinks);
+		RestoringLambdas.SetNumZeroed(NumLinks);
+
+		const int32 PaddedNum = FSoftBoneVectorStream::GetPaddedNum(NumLinks);
+		RestoringWeights.Reset(PaddedNum);
+		RestoringWeights.AddZeroed(PaddedNum);
+
+		Lengths.Reset(NumLinks);
+		Lengths.AddZeroed(NumLinks);
+
+		ParentIndices.Reset(NumLinks);
+		ParentIndices.AddUninitialized(NumLinks);
+
+		Chains.Reset();
+		NumSleepingChains = 0;
+
+		AnalyticCoefficients.Invalidate();
+	}
+
+	/** Wakes up all chains, e.g. when the simulation space has moved */
+	void WakeAllChains()
+	{
+		for (int32 ChainIndex = 0; ChainIndex < Chains.Num(); ChainIndex++)
+		{
+			Chains[ChainIndex].bSleeping = false;
+			Chains[ChainIndex].SleepTime = 0.f;
+		}
+
+		NumSleepingChains = 0;
+	}
+
+	/** Reserves a range of NumLinks links right after the last chain and returns the offset of its root link */
+	int32 AddChain(int32 NumLinks)
+	{
+		const int32 LinkOffset = (Chains.Num() > 0) ? Chains.Last().LinkOffset + Chains.Last().NumLinks : 0;
+		check(LinkOffset + NumLinks <= Num());
+
+		Chains.Add(FSoftBoneChainRange(LinkOffset, NumLinks));
+		return LinkOffset;
+	}
+
+	void SetLink(int32 Index, const FVector& InPosition, int32 InParentIndex, float InLength, float InRestoringWeight)
+	{
+		checkSlow(InParentIndex < Index);
+
+		Positions.Set(Index, InPosition);
+		PreviousPositions.Set(Index, InPosition);
+		Velocities.Set(Index, FVector::ZeroVector);
+		ParentIndices[Index] = InParentIndex;
+		Lengths[Index] = InLength;
+		RestoringWeights[Index] = InRestoringWeight;
+
+		AnalyticCoefficients.Invalidate();
+	}
+
+	/** Changes the restoring weight of a link, e.g. when stiffness is driven at runtime. Its dynamic state is kept. */
+	void SetRestoringWeight(int32 Index, float InRestoringWeight)
+	{
+		RestoringWeights[Index] = InRestoringWeight;
+		AnalyticCoefficients.Invalidate();
+	}
+
+	/** Heap memory of all links and chains */
+	SIZE_T GetAllocatedSize() const
+	{
+		return Positions.GetAllocatedSize() + PreviousPositions.GetAllocatedSize() + Velocities.GetAllocatedSize() + RestoringLambdas.GetAllocatedSize()
+			+ RestoringWeights.GetAllocatedSize() + Lengths.GetAllocatedSize() + ParentIndices.GetAllocatedSize() + Chains.GetAllocatedSize()
+			+ AnalyticCoefficients.GetAllocatedSize();
+	}
+};
+
+/**
+ * One link of FSoftBoneCompactChainState in 16 bits per component.
+ * Positions are relative to the origin of the chain, all values are in units of the scales of their chain.
+ */
+struct FSoftBoneCompactLink
+{
+	int16 Position[3];
+	int16 PreviousPosition[3];
+	int16 TargetPosition[3];
+	int16 Velocity[3];
+	uint16 Length;
+	uint16 RestoringWeight;
+
+	/** Number of links back to the parent, 0 for the root */
+	uint16 ParentOffset;
+};
+
+/** Position of optional per link streams of FSoftBoneCompactChainState, relative to the origin of its chain like the links */
+struct FSoftBoneCompactPosition
+{
+	int16 Value[3];
+};
+
+/** Origin and quantization scales of one chain of FSoftBoneCompactChainState */
+struct FSoftBoneCompactChain
+{
+	FSoftBoneChainRange Range;
+
+	/** Position of the root link, the other positions are relative to it */
+	FVector Origin;
+
+	/** Size of one step of each quantized value. The largest value of the chain is stored as the largest integer. */
+	float PositionScale;
+	float VelocityScale;
+	float LengthScale;
+	float WeightScale;
+
+	/** External acceleration of all links of the chain. Forces are sampled once per chain, so one is kept instead of a stream. */
+	FVector Acceleration;
+};
+
+/**
+ * Reduced precision copy of FSoftBoneChainState and its interpolated targets, for instances which are kept for long between simulations, e.g. crowds.
+ * Links are 30 bytes instead of 72 bytes of full precision streams. Per step scratch data like the XPBD multipliers and the analytic coefficients is not kept.
+ * Positions are stored relative to the root of their chain, so the precision depends on the size of the chain rather than on the distance to the origin.
+ * Final and reference targets take 6 more bytes per link each, and only while they are kept.
+ */
+struct FSoftBoneCompactChainState
+{
+	TArray<FSoftBoneCompactLink> Links;
+	TArray<FSoftBoneCompactChain> Chains;
+
+	/** Targets gathered by the last evaluation, empty if they weren't kept */
+	TArray<FSoftBoneCompactPosition> FinalTargetPositions;
+
+	/** Targets sleeping is measured against, empty if they weren't kept */
+	TArray<FSoftBoneCompactPosition> ReferenceTargetPositions;
+
+	/** Number of chains in Chains which are sleeping */
+	int32 NumSleepingChains;
+
+	/** False if there were no interpolated targets, i.e. they haven't been simulated yet */
+	bool bHasTargetPositions;
+
+	/** True if Acceleration of the chains has been kept */
+	bool bHasLinkAccelerations;
+
+	FSoftBoneCompactChainState()
+		: NumSleepingChains(0)
+		, bHasTargetPositions(false)
+		, bHasLinkAccelerations(false)
+	{
+	}
+
+	int32 Num() const
+	{
+		return Links.Num();
+	}
+
+	/** Removes all links keeping the allocations */
+	void Reset()
+	{
+		Links.Reset();
+		Chains.Reset();
+		FinalTargetPositions.Reset();
+		ReferenceTargetPositions.Reset();
+		NumSleepingChains = 0;
+		bHasTargetPositions = false;
+		bHasLinkAccelerations = false;
+	}
+
+	SIZE_T GetAllocatedSize() const
+	{
+		return Links.GetAllocatedSize() + Chains.GetAllocatedSize() + FinalTargetPositions.GetAllocatedSize() + ReferenceTargetPositions.GetAllocatedSize();
+	}
+};
+
+struct SOFTBONESOLVER_API FSoftBoneSolver
+{
+	/** One sub step of all chains, see TimeIntegration */
+	typedef void (*FTimeIntegrationFunction)(FSoftBoneChainState& State, const FSoftBoneVectorStream& TargetPositions, float TimeDelta, const FSoftBoneSolverParams& Params);
+
+	/**
+	 * Advances all chains by TimeDelta.
+	 * Applies a force of restitution toward TargetPositions plus external acceleration, then solves bone length constraints.
+	 * TargetPositions should have the same number of elements as the state.
+	 */
+	static void TimeIntegration(FSoftBoneChainState& State, const FSoftBoneVectorStream& TargetPositions, float TimeDelta, const FSoftBoneSolverParams& Params);
+
+	/**
+	 * Returns TimeIntegration compiled for one combination of the options which stay the same while simulating,
+	 * so the sub step loop doesn't branch on them. Simulate picks it once before its sub steps.
+	 */
+	static FTimeIntegrationFunction GetTimeIntegrationFunction(ESoftBoneIntegration::Type Integration, bool bBoneLengthConstraint, bool bCollisions);
+
+	/** Variant for Params.Integration, Params.bBoneLengthConstraint and whether Params has any collider */
+	static FTimeIntegrationFunction GetTimeIntegrationFunction(const FSoftBoneSolverParams& Params)
+	{
+		return GetTimeIntegrationFunction(Params.Integration, Params.bBoneLengthConstraint, Params.NumColliders > 0);
+	}
+
+	/**
+	 * Advances all chains by TimeDelta with XPBD. Links move by their velocities and external acceleration first,
+	 * then restoring and length constraints are iterated up to Params.NumIterations times until the corrections fall below Params.ConvergenceTolerance.
+	 * Velocities are derived from the corrected positions. Called by TimeIntegration with XPBD integration.
+	 */
+	static void TimeIntegrationXPBD(FSoftBoneChainState& State, const FSoftBoneVectorStream& TargetPositions, float TimeDelta, const FSoftBoneSolverParams& Params);
+
+	/**
+	 * Computes State.AnalyticCoefficients for TimeDelta if they are out of date.
+	 * Each link is a damped spring with stiffness RestoringWeight / ReferenceTimeStep^2 which loses DampingRatio of its velocity per ReferenceTimeStep,
+	 * the same as the explicit solver stepping at ReferenceTimeStep. Solved in double precision, once per change of the time step.
+	 */
+	static void UpdateAnalyticCoefficients(FSoftBoneChainState& State, float TimeDelta, const FSoftBoneSolverParams& Params);
+
+	/** Vectorized velocity and position integration of links of awake chains. It doesn't pin the roots. */
+	static void IntegrateLinks(FSoftBoneChainState& State, const FSoftBoneVectorStream& TargetPositions, float TimeDelta, const FSoftBoneSolverParams& Params);
+
+	/** Moves each link of awake chains onto its parent's position keeping its length */
+	static void SolveLengthConstraints(FSoftBoneChainState& State);
+
+	/**
+	 * Pushes links of awake chains out of the colliders. Root links are pinned and never pushed.
+	 * Chains whose bounding sphere doesn't touch a collider skip it, the others test 4 links at once.
+	 */
+	static void SolveCollisions(FSoftBoneChainState& State, const FSoftBoneCollider* Colliders, int32 NumColliders);
+
+	/**
+	 * Consumes InRemainingTime in FixedTimeStep sub steps while interpolating targets from the current positions to FinalTargetPositions.
+	 * If bFixedTimeStep is false, all of the remaining time is simulated in one step, or in equal steps if it's longer than Params.MaxStepTime.
+	 * If more than Params.MaxSubSteps steps are due, the excess whole steps are dropped before interpolating, so a hitch slows the simulation down
+	 * instead of making the next frame even longer. The result only depends on the inputs, so it stays deterministic.
+	 * TargetPositions holds the targets interpolated to the time of the state. The explicit integration interpolates each step from the current positions,
+	 * the time consistent ones from these targets, so the targets move linearly in time whatever the step is.
+	 * Keep it between calls and move it along with the links, it's filled with FinalTargetPositions if its size doesn't match.
+	 * @return Remaining time which was not simulated
+	 */
+	static float Simulate(FSoftBoneChainState& State, const FSoftBoneVectorStream& FinalTargetPositions, FSoftBoneVectorStream& TargetPositions, float InRemainingTime, float FixedTimeStep, bool bFixedTimeStep, const FSoftBoneSolverParams& Params);
+
+	/** Moves all links rigidly by Transform. Positions are fully transformed, velocities are only rotated and scaled. */
+	static void TransformLinks(FSoftBoneChainState& State, const FTransform& Transform);
+
+	/** Fully transforms all positions of Positions, e.g. interpolated targets which have to move along with the links */
+	static void TransformPositions(FSoftBoneVectorStream& Positions, const FTransform& Transform);
+
+	/**
+	 * Quantizes State and its interpolated targets into OutCompactState. Scales are fitted to each chain, so nothing is clipped.
+	 * Final targets, reference targets and link accelerations are kept as well if they are given and match the links.
+	 * Accelerations are kept once per chain from its root, like the force field samples them.
+	 */
+	static void CompressState(const FSoftBoneChainState& State, const FSoftBoneVectorStream& TargetPositions, FSoftBoneCompactChainState& OutCompactState,
+		const FSoftBoneVectorStream* FinalTargetPositions = nullptr, const FSoftBoneVectorStream* ReferenceTargetPositions = nullptr, const FSoftBoneVectorStream* LinkAccelerations = nullptr);
+
+	/**
+	 * Restores links and interpolated targets from CompactState. Allocations of OutState are reused if they are large enough.
+	 * Optional streams are restored if they are given, streams which haven't been kept are emptied keeping their allocations.
+	 */
+	static void DecompressState(const FSoftBoneCompactChainState& CompactState, FSoftBoneChainState& OutState, FSoftBoneVectorStream& OutTargetPositions,
+		FSoftBoneVectorStream* OutFinalTargetPositions = nullptr, FSoftBoneVectorStream* OutReferenceTargetPositions = nullptr, FSoftBoneVectorStream* OutLinkAccelerations = nullptr);
+
+	/**
+	 * make the final positions by pulling simulated positions to destinations
+	 * Each chain is moved by the difference between the final and the last interpolated target of its root.
+	 */
+	static void PullBonesToFinalPosition(const FSoftBoneChainState& State, const FSoftBoneVectorStream& FinalTargetPositions, const FSoftBoneVectorStream& TargetPositions, FVector* OutRenderPositions);
+
+	/**
+	 * make the final positions by blending the last two fixed states by Alpha and pulling them to destinations
+	 * Alpha is the unsimulated remaining time in fixed steps. Rendering lags one sub step behind, but moves smoothly even if the simulation runs slower than the frame rate.
+	 */
+	static void InterpolateBonesToFinalPosition(const FSoftBoneChainState& State, const FSoftBoneVectorStream& FinalTargetPositions, float Alpha, FVector* OutRenderPositions);
+
+	/** make the final positions by moving simulated positions along their velocities for Time and pulling them to destinations */
+	static void ExtrapolateBonesToFinalPosition(const FSoftBoneChainState& State, const FSoftBoneVectorStream& FinalTargetPositions, float Time, FVector* OutRenderPositions);
+
+	/**
+	 * Puts chains to sleep which have stayed still for SleepParams.Delay and wakes up chains whose targets moved.
+	 * Call once per frame before simulating. ReferenceTargetPositions keeps the targets of the last frame or the ones sleeping chains fell asleep with.
+	 */
+	static void UpdateSleepStates(FSoftBoneChainState& State, const FSoftBoneVectorStream& FinalTargetPositions, FSoftBoneVectorStream& ReferenceTargetPositions, const FSoftBoneSleepParams& SleepParams, float DeltaTime);
+
+	/** Calculates the rotation which turns OldDir to NewDir. Both directions should be normalized. */
+	static FQuat ComputeDeltaRotation(const FVector& OldDir, const FVector& NewDir);
+
+	/**
+	 * Calculates the shortest arc rotation which turns each of FromDirections to the matching one of ToDirections, 4 at once.
+	 * Directions don't need to be normalized. The quaternion is built from the dot and cross products without any trigonometric function.
+	 * Zero length and opposite directions result in the identity. OutRotations is resized to match the directions.
+	 */
+	static void ComputeShortestArcRotations(const FSoftBoneVectorStream& FromDirections, const FSoftBoneVectorStream& ToDirections, FSoftBoneQuatStream& OutRotations);
+};
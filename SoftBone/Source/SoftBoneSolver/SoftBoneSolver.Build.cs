@@ -0,0 +1,22 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+namespace UnrealBuildTool.Rules
+{
+	public class SoftBoneSolver : ModuleRules
+	{
+        public SoftBoneSolver(TargetInfo Target)
+		{
+            PublicIncludePaths.Add("SoftBoneSolver/Public");
+            PrivateIncludePaths.Add("SoftBoneSolver/Private");
+
+            // the solver only works on plain buffers, so it builds without Engine.h or the precompiled header of the plugin
+            PCHUsage = PCHUsageMode.NoSharedPCHs;
+
+            PublicDependencyModuleNames.AddRange(
+                new string[] { 
+				"Core", 
+			    }
+            );
+		}
+	}
+}
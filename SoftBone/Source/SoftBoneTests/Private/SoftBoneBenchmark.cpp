@@ -0,0 +1,1398 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "SoftBoneTestsPrivatePCH.h"
+#include "SoftBoneBenchmark.h"
+#include "SoftBoneSimulationManager.h"
+#include "SoftBoneForceField.h"
+
+#if !UE_BUILD_SHIPPING
+
+/////////////////////////////////////////////////////
+// SoftBone solver benchmark
+//
+// Runs the solver on synthetic chains without any skeletal mesh or world, so that the cost per link can be measured
+// on a headless build. (e.g. UE4Editor-Cmd <Project> -nullrhi -ExecCmds="SoftBone.Benchmark 256 16 600, Quit")
+// USoftBoneBenchmarkCommandlet runs it as well and exits with an error code if any check fails.
+//
+// All chains are simulated in one flattened state like chains of a node, and compared with one sub step loop per chain.
+// Re-orientation of the final links is compared between the axis-angle rotation and the batched shortest arc rotation.
+// XPBD at 30Hz and the explicit solver at 30Hz are compared with themselves at 120Hz, which shows how much the motion depends on the time step.
+// Without fixed steps, chains catching up 8 deferred frames at once are compared with chains simulated every frame.
+// Collision cost is measured with one capsule under each row of chains, touching them or moved far away so every chain is culled.
+// The compact state is compared with full precision links in memory per link, cost of the round trip and drift of the positions.
+// External forces are measured with gusty wind and a repeated explosion sampled once per chain and frame, against the same chains without forces.
+// Differences and errors are checked against tolerances at the end, failures are logged as errors.
+//
+// usage : SoftBone.Benchmark [NumChains] [NumLinksPerChain] [NumFrames]
+//
+// SoftBone.BatchBenchmark simulates many instances like FSoftBoneSimulationManager does and measures how throughput scales with the number of tasks
+// they are split into. The task graph keeps all its workers, so this is a task count sweep : each run uses at most as many threads as it has tasks.
+//
+// usage : SoftBone.BatchBenchmark [NumInstances] [NumChainsPerInstance] [NumLinksPerChain] [NumFrames]
+
+namespace SoftBoneBenchmark
+{
+	/** Frame time of the scripted motion */
+	static const float FrameDeltaTime = 1.f / 60.f;
+
+	/** Solver rate */
+	static const float FixedTimeStep = 1.f / 120.f;
+
+	/** Length of each synthetic bone */
+	static const float BoneLength = 10.f;
+
+	/** Chains simulated together in one flattened state, like all chains of a SoftBone node */
+	typedef FSoftBoneSimulationInstance FSyntheticScene;
+
+	/**
+	 * Array of structs version of the solver which was used before the structure of arrays layout.
+	 * Kept here as a reference for both performance and results.
+	 */
+	struct FReferenceChain
+	{
+		TArray<FVector> Positions;
+		TArray<FVector> Velocities;
+		TArray<float> Lengths;
+		TArray<float> RestoringWeights;
+		TArray<FVector> TargetPositions;
+		float RemainingTime;
+
+		void Initialize(const FSoftBoneChainState& State, const FSoftBoneChainRange& Chain)
+		{
+			const int32 NumLinks = Chain.NumLinks;
+
+			Positions.SetNumUninitialized(NumLinks);
+			Velocities.SetNumZeroed(NumLinks);
+			Lengths.SetNumUninitialized(NumLinks);
+			RestoringWeights.SetNumUninitialized(NumLinks);
+			TargetPositions.SetNumUninitialized(NumLinks);
+			RemainingTime = 0.f;
+
+			for (int32 Index = 0; Index < NumLinks; Index++)
+			{
+				Positions[Index] = State.Positions.Get(Chain.LinkOffset + Index);
+				Lengths[Index] = State.Lengths[Chain.LinkOffset + Index];
+				RestoringWeights[Index] = State.RestoringWeights[Chain.LinkOffset + Index];
+			}
+		}
+
+		void TimeIntegration(float TimeDelta, const FSoftBoneSolverParams& Params)
+		{
+			float DampingCoefficient = 1.0f - Params.DampingRatio;
+			float InvTimeDelta = 1.0f / TimeDelta;
+
+			Positions[0] = TargetPositions[0];
+
+			for (int32 Index = 1; Index < Positions.Num(); Index++)
+			{
+				FVector RestoreImpulse = RestoringWeights[Index] * (TargetPositions[Index] - Positions[Index]);
+
+				Velocities[Index] += ((RestoreImpulse * InvTimeDelta) + (Params.ExternalAcceleration * TimeDelta));
+				FVector MoveDelta = Velocities[Index] * TimeDelta;
+				Velocities[Index] *= DampingCoefficient;
+
+				Positions[Index] += MoveDelta;
+			}
+
+			if (Params.bBoneLengthConstraint)
+			{
+				for (int32 Index = 1; Index < Positions.Num(); Index++)
+				{
+					Positions[Index] = Positions[Index - 1] + (Positions[Index] - Positions[Index - 1]).GetUnsafeNormal() * Lengths[Index];
+				}
+			}
+		}
+
+		float Simulate(const FSoftBoneVectorStream& FinalTargetPositions, int32 LinkOffset, float InRemainingTime, const FSoftBoneSolverParams& Params)
+		{
+			TargetPositions[0] = Positions[0];
+
+			while (InRemainingTime >= FixedTimeStep)
+			{
+				float FixedTimeRatio = FixedTimeStep / InRemainingTime;
+				float RemainedRatio = 1.0f - FixedTimeRatio;
+
+				for (int32 Index = 0; Index < TargetPositions.Num(); Index++)
+				{
+					TargetPositions[Index] = FixedTimeRatio * FinalTargetPositions.Get(LinkOffset + Index) + RemainedRatio * Positions[Index];
+				}
+
+				TimeIntegration(FixedTimeStep, Params);
+
+				InRemainingTime -= FixedTimeStep;
+			}
+
+			return InRemainingTime;
+		}
+	};
+
+	/** Root motion of a chain at the given time. Chains are placed on a grid and sway on their own phase. */
+	static FVector GetRootPosition(int32 ChainIndex, float Time)
+	{
+		const float Phase = ChainIndex * 0.37f;
+		const FVector GridOffset((ChainIndex % 32) * 100.f, (ChainIndex / 32) * 100.f, 0.f);
+
+		return GridOffset + FVector(FMath::Sin(Time * 6.f + Phase) * 50.f, FMath::Cos(Time * 4.f + Phase) * 30.f, FMath::Sin(Time * 2.f) * 10.f);
+	}
+
+	/** Targets form a straight chain hanging along X from the root */
+	static void ComputeTargetPositions(FSyntheticScene& Scene, const FSoftBoneChainRange& Chain, const FVector& RootPosition)
+	{
+		for (int32 Index = 0; Index < Chain.NumLinks; Index++)
+		{
+			Scene.FinalTargetPositions.Set(Chain.LinkOffset + Index, RootPosition + FVector(Index * BoneLength, 0.f, 0.f));
+		}
+	}
+
+	/** Updates targets of all chains in the scene. Chains of the scene are numbered from FirstChainIndex for their root motion. */
+	static void ComputeTargetPositions(FSyntheticScene& Scene, int32 FirstChainIndex, float Time)
+	{
+		for (int32 ChainIndex = 0; ChainIndex < Scene.State.Chains.Num(); ChainIndex++)
+		{
+			ComputeTargetPositions(Scene, Scene.State.Chains[ChainIndex], GetRootPosition(FirstChainIndex + ChainIndex, Time));
+		}
+	}
+
+	/** Allocates NumChains chains of NumLinks links. Links are placed by SetLinksToTargets once initial targets are computed */
+	static void InitializeScene(FSyntheticScene& Scene, int32 NumChains, int32 NumLinks)
+	{
+		const int32 NumAllLinks = NumChains * NumLinks;
+
+		Scene.FinalTargetPositions.SetNumZeroed(NumAllLinks);
+		Scene.TargetPositions.SetNumZeroed(NumAllLinks);
+		Scene.RemainingTime = 0.f;
+
+		Scene.State.Reset(NumAllLinks);
+
+		for (int32 ChainIndex = 0; ChainIndex < NumChains; ChainIndex++)
+		{
+			Scene.State.AddChain(NumLinks);
+		}
+	}
+
+	static void SetLinksToTargets(FSyntheticScene& Scene)
+	{
+		for (int32 ChainIndex = 0; ChainIndex < Scene.State.Chains.Num(); ChainIndex++)
+		{
+			const FSoftBoneChainRange& Chain = Scene.State.Chains[ChainIndex];
+
+			for (int32 Index = 0; Index < Chain.NumLinks; Index++)
+			{
+				const int32 LinkIndex = Chain.LinkOffset + Index;
+				const int32 ParentIndex = (Index > 0) ? LinkIndex - 1 : INDEX_NONE;
+				const float Length = (Index > 0) ? BoneLength : 0.f;
+				const float RestoringWeight = (Index > 0) ? 0.1f / Index : 0.f;
+
+				Scene.State.SetLink(LinkIndex, Scene.FinalTargetPositions.Get(LinkIndex), ParentIndex, Length, RestoringWeight);
+			}
+		}
+
+		Scene.TargetPositions.CopyFrom(Scene.FinalTargetPositions);
+	}
+
+	/** Advances all chains of the scene by one frame and returns the number of sub steps. Without fixed time step, the frame is one step. */
+	static int32 SimulateScene(FSyntheticScene& Scene, const FSoftBoneSolverParams& Params, float SubStepTime = FixedTimeStep, bool bFixedTimeStep = true)
+	{
+		const float TimeToSimulate = Scene.RemainingTime + FrameDeltaTime;
+
+		Scene.RemainingTime = FSoftBoneSolver::Simulate(Scene.State, Scene.FinalTargetPositions, Scene.TargetPositions, TimeToSimulate, SubStepTime, bFixedTimeStep, Params);
+
+		return bFixedTimeStep ? FMath::RoundToInt((TimeToSimulate - Scene.RemainingTime) / SubStepTime) : 1;
+	}
+
+	/** Allocates NumChains chains of NumLinks links at rest on their targets of the first frame. Chains are numbered from FirstChainIndex for their root motion. */
+	static void SetUpScene(FSyntheticScene& Scene, int32 NumChains, int32 NumLinks, int32 FirstChainIndex = 0)
+	{
+		InitializeScene(Scene, NumChains, NumLinks);
+		ComputeTargetPositions(Scene, FirstChainIndex, 0.f);
+		SetLinksToTargets(Scene);
+	}
+
+	/** Simulation time of a scene and the sub steps it took */
+	struct FSceneTiming
+	{
+		/** Sub steps of all chains. Chains of a scene consume the same time, so each sub step of the scene counts once per chain. */
+		int64 NumChainSteps;
+		double Seconds;
+
+		FSceneTiming()
+			: NumChainSteps(0)
+			, Seconds(0.0)
+		{
+		}
+
+		double GetNanoSecondsPerLinkStep(int32 NumLinks) const
+		{
+			const double NumLinkSteps = (double)NumChainSteps * NumLinks;
+			return (NumLinkSteps > 0.0) ? (Seconds * 1.0e9) / NumLinkSteps : 0.0;
+		}
+	};
+
+	/** Advances Scene by one frame like SimulateScene and adds the time and sub steps to Timing */
+	static void SimulateSceneTimed(FSyntheticScene& Scene, const FSoftBoneSolverParams& Params, FSceneTiming& Timing)
+	{
+		const double StartTime = FPlatformTime::Seconds();
+		const int32 NumSubSteps = SimulateScene(Scene, Params);
+		Timing.Seconds += FPlatformTime::Seconds() - StartTime;
+		Timing.NumChainSteps += (int64)NumSubSteps * Scene.State.Chains.Num();
+	}
+
+	/** Moves the targets of Scene along the scripted motion for NumFrames and simulates it after each frame. Only the simulation is timed. */
+	static FSceneTiming MeasureScene(FSyntheticScene& Scene, int32 NumFrames, const FSoftBoneSolverParams& Params, int32 FirstChainIndex = 0)
+	{
+		FSceneTiming Timing;
+
+		for (int32 Frame = 0; Frame < NumFrames; Frame++)
+		{
+			ComputeTargetPositions(Scene, FirstChainIndex, (Frame + 1) * FrameDeltaTime);
+			SimulateSceneTimed(Scene, Params, Timing);
+		}
+
+		return Timing;
+	}
+
+	/** Component motion for the component space comparison. Moves and turns around like a running character. */
+	static FTransform GetComponentToWorld(float Time)
+	{
+		const FQuat Rotation(FVector(0.f, 0.f, 1.f), FMath::Sin(Time * 3.f) * 1.5f);
+		return FTransform(Rotation, FVector(FMath::Sin(Time * 5.f) * 100.f, Time * 300.f, FMath::Abs(FMath::Sin(Time * 8.f)) * 20.f));
+	}
+
+	/**
+	 * Simulates the same chain in world space and in component space with the inertial frame correction,
+	 * and returns the max distance between both results in world space.
+	 */
+	static float CompareComponentSpaceSimulation(int32 NumLinks, int32 NumFrames, const FSoftBoneSolverParams& WorldParams)
+	{
+		FSyntheticScene WorldChain;
+		FSyntheticScene ComponentChain;
+
+		// chain targets are static in component space
+		InitializeScene(ComponentChain, 1, NumLinks);
+		ComputeTargetPositions(ComponentChain, ComponentChain.State.Chains[0], FVector::ZeroVector);
+		SetLinksToTargets(ComponentChain);
+
+		InitializeScene(WorldChain, 1, NumLinks);
+		ComputeTargetPositions(WorldChain, WorldChain.State.Chains[0], FVector::ZeroVector);
+		SetLinksToTargets(WorldChain);
+
+		FTransform PrevComponentToWorld = GetComponentToWorld(0.f);
+		FSoftBoneSolver::TransformLinks(WorldChain.State, PrevComponentToWorld);
+		FSoftBoneSolver::TransformPositions(WorldChain.TargetPositions, PrevComponentToWorld);
+
+		FSoftBoneVectorStream ComponentTargets;
+		ComponentTargets.SetNumZeroed(NumLinks);
+		ComponentTargets.CopyFrom(ComponentChain.FinalTargetPositions);
+
+		float MaxError = 0.f;
+
+		for (int32 Frame = 0; Frame < NumFrames; Frame++)
+		{
+			const FTransform ComponentToWorld = GetComponentToWorld((Frame + 1) * FrameDeltaTime);
+
+			// world space : convert every target to world space
+			for (int32 Index = 0; Index < NumLinks; Index++)
+			{
+				WorldChain.FinalTargetPositions.Set(Index, ComponentToWorld.TransformPosition(ComponentTargets.Get(Index)));
+			}
+
+			WorldChain.RemainingTime = FSoftBoneSolver::Simulate(WorldChain.State, WorldChain.FinalTargetPositions, WorldChain.TargetPositions, WorldChain.RemainingTime + FrameDeltaTime, FixedTimeStep, true, WorldParams);
+
+			// component space : move links once by the motion of the component
+			const FTransform FrameDelta = PrevComponentToWorld.GetRelativeTransform(ComponentToWorld);
+			FSoftBoneSolver::TransformLinks(ComponentChain.State, FrameDelta);
+			FSoftBoneSolver::TransformPositions(ComponentChain.TargetPositions, FrameDelta);
+			PrevComponentToWorld = ComponentToWorld;
+
+			FSoftBoneSolverParams ComponentParams = WorldParams;
+			ComponentParams.ExternalAcceleration = ComponentToWorld.InverseTransformVector(WorldParams.ExternalAcceleration);
+
+			ComponentChain.RemainingTime = FSoftBoneSolver::Simulate(ComponentChain.State, ComponentTargets, ComponentChain.TargetPositions, ComponentChain.RemainingTime + FrameDeltaTime, FixedTimeStep, true, ComponentParams);
+
+			for (int32 Index = 0; Index < NumLinks; Index++)
+			{
+				const FVector ComponentResultInWorld = ComponentToWorld.TransformPosition(ComponentChain.State.Positions.Get(Index));
+				MaxError = FMath::Max(MaxError, FVector::Dist(ComponentResultInWorld, WorldChain.State.Positions.Get(Index)));
+			}
+		}
+
+		return MaxError;
+	}
+
+	/**
+	 * Re-orients all links of the scene from their target directions to their simulated directions
+	 * with the axis-angle rotation and with the batched shortest arc, and returns the max difference between the quaternions.
+	 */
+	static float CompareReOrientation(const FSyntheticScene& Scene, int32 NumRepeats, double& OutAxisAngleNanoSeconds, double& OutShortestArcNanoSeconds)
+	{
+		const FSoftBoneChainState& State = Scene.State;
+		const int32 NumLinks = State.Num();
+
+		FSoftBoneVectorStream RestDirections;
+		FSoftBoneVectorStream SimulatedDirections;
+		RestDirections.SetNumZeroed(NumLinks);
+		SimulatedDirections.SetNumZeroed(NumLinks);
+
+		for (int32 ChainIndex = 0; ChainIndex < State.Chains.Num(); ChainIndex++)
+		{
+			const FSoftBoneChainRange& Chain = State.Chains[ChainIndex];
+
+			for (int32 Index = Chain.LinkOffset; Index < Chain.LinkOffset + Chain.NumLinks - 1; Index++)
+			{
+				RestDirections.Set(Index, Scene.FinalTargetPositions.Get(Index + 1) - Scene.FinalTargetPositions.Get(Index));
+				SimulatedDirections.Set(Index, State.Positions.Get(Index + 1) - State.Positions.Get(Index));
+			}
+		}
+
+		TArray<FQuat> AxisAngleRotations;
+		AxisAngleRotations.Init(FQuat::Identity, NumLinks);
+
+		const double AxisAngleStartTime = FPlatformTime::Seconds();
+
+		for (int32 Repeat = 0; Repeat < NumRepeats; Repeat++)
+		{
+			for (int32 ChainIndex = 0; ChainIndex < State.Chains.Num(); ChainIndex++)
+			{
+				const FSoftBoneChainRange& Chain = State.Chains[ChainIndex];
+
+				for (int32 Index = Chain.LinkOffset; Index < Chain.LinkOffset + Chain.NumLinks - 1; Index++)
+				{
+					AxisAngleRotations[Index] = FSoftBoneSolver::ComputeDeltaRotation(RestDirections.Get(Index).GetUnsafeNormal(), SimulatedDirections.Get(Index).GetUnsafeNormal());
+				}
+			}
+		}
+
+		const double AxisAngleSeconds = FPlatformTime::Seconds() - AxisAngleStartTime;
+
+		FSoftBoneQuatStream ShortestArcRotations;
+
+		const double ShortestArcStartTime = FPlatformTime::Seconds();
+
+		for (int32 Repeat = 0; Repeat < NumRepeats; Repeat++)
+		{
+			FSoftBoneSolver::ComputeShortestArcRotations(RestDirections, SimulatedDirections, ShortestArcRotations);
+		}
+
+		const double ShortestArcSeconds = FPlatformTime::Seconds() - ShortestArcStartTime;
+
+		const double NumRotations = (double)NumRepeats * (NumLinks - State.Chains.Num());
+		OutAxisAngleNanoSeconds = (NumRotations > 0.0) ? AxisAngleSeconds * 1.0e9 / NumRotations : 0.0;
+		OutShortestArcNanoSeconds = (NumRotations > 0.0) ? ShortestArcSeconds * 1.0e9 / NumRotations : 0.0;
+
+		float MaxError = 0.f;
+
+		for (int32 ChainIndex = 0; ChainIndex < State.Chains.Num(); ChainIndex++)
+		{
+			const FSoftBoneChainRange& Chain = State.Chains[ChainIndex];
+
+			for (int32 Index = Chain.LinkOffset; Index < Chain.LinkOffset + Chain.NumLinks - 1; Index++)
+			{
+				const FQuat A = AxisAngleRotations[Index];
+				const FQuat B = ShortestArcRotations.Get(Index);
+
+				MaxError = FMath::Max(MaxError, FMath::Max(FMath::Max(FMath::Abs(A.X - B.X), FMath::Abs(A.Y - B.Y)), FMath::Max(FMath::Abs(A.Z - B.Z), FMath::Abs(A.W - B.W))));
+			}
+		}
+
+		return MaxError;
+	}
+
+	/**
+	 * Simulates chains without fixed steps like a node which is deferred by the frame budget, catching up NumDeferredFrames at once,
+	 * and returns the max distance after each catch up to the same chains simulated every frame. Catching up is limited to steps of
+	 * one frame by Params.MaxStepTime, 0 simulates all of the accumulated time in one step.
+	 */
+	static float CompareDeferredCatchUp(int32 NumChains, int32 NumLinks, int32 NumFrames, const FSoftBoneSolverParams& Params, int32 NumDeferredFrames)
+	{
+		FSoftBoneSolverParams EveryFrameParams = Params;
+		EveryFrameParams.MaxStepTime = FrameDeltaTime;
+
+		FSyntheticScene EveryFrame;
+		SetUpScene(EveryFrame, NumChains, NumLinks);
+
+		FSyntheticScene Deferred;
+		SetUpScene(Deferred, NumChains, NumLinks);
+
+		float MaxDifference = 0.f;
+
+		for (int32 Frame = 0; Frame < NumFrames; Frame++)
+		{
+			const float Time = (Frame + 1) * FrameDeltaTime;
+
+			ComputeTargetPositions(EveryFrame, 0, Time);
+			EveryFrame.RemainingTime = FSoftBoneSolver::Simulate(EveryFrame.State, EveryFrame.FinalTargetPositions, EveryFrame.TargetPositions, FrameDeltaTime, FrameDeltaTime, false, EveryFrameParams);
+
+			Deferred.RemainingTime += FrameDeltaTime;
+
+			if ((Frame + 1) % NumDeferredFrames != 0)
+			{
+				continue;
+			}
+
+			ComputeTargetPositions(Deferred, 0, Time);
+			Deferred.RemainingTime = FSoftBoneSolver::Simulate(Deferred.State, Deferred.FinalTargetPositions, Deferred.TargetPositions, Deferred.RemainingTime, FrameDeltaTime, false, Params);
+
+			for (int32 Index = 0; Index < EveryFrame.State.Num(); Index++)
+			{
+				MaxDifference = FMath::Max(MaxDifference, FVector::Dist(EveryFrame.State.Positions.Get(Index), Deferred.State.Positions.Get(Index)));
+			}
+		}
+
+		return MaxDifference;
+	}
+
+	/** Result of CompareTimeSteps */
+	struct FTimeStepComparison
+	{
+		/** Max distance between links of both rates after frames where both consumed all of their time */
+		float MaxDifference;
+
+		/** Cost per link and frame of each rate */
+		double LowRateNanoSeconds;
+		double ReferenceRateNanoSeconds;
+
+		/** Iterations per chain in the last XPBD sub step of each frame at the low rate on average */
+		float AverageIterations;
+	};
+
+	/** Simulates the same chains with Params at LowTimeStep and at FixedTimeStep and compares both motions */
+	static FTimeStepComparison CompareTimeSteps(int32 NumChains, int32 NumLinks, int32 NumFrames, const FSoftBoneSolverParams& Params, float LowTimeStep)
+	{
+		FSyntheticScene LowRateScene;
+		FSyntheticScene ReferenceScene;
+		FSyntheticScene* const Scenes[2] = { &LowRateScene, &ReferenceScene };
+		const float TimeSteps[2] = { LowTimeStep, FixedTimeStep };
+		double Seconds[2] = { 0.0, 0.0 };
+
+		for (int32 SceneIndex = 0; SceneIndex < 2; SceneIndex++)
+		{
+			SetUpScene(*Scenes[SceneIndex], NumChains, NumLinks);
+		}
+
+		FTimeStepComparison Result;
+		Result.MaxDifference = 0.f;
+		Result.AverageIterations = 0.f;
+
+		for (int32 Frame = 0; Frame < NumFrames; Frame++)
+		{
+			for (int32 SceneIndex = 0; SceneIndex < 2; SceneIndex++)
+			{
+				ComputeTargetPositions(*Scenes[SceneIndex], 0, (Frame + 1) * FrameDeltaTime);
+
+				const double StartTime = FPlatformTime::Seconds();
+
+				SimulateScene(*Scenes[SceneIndex], Params, TimeSteps[SceneIndex]);
+
+				Seconds[SceneIndex] += FPlatformTime::Seconds() - StartTime;
+			}
+
+			Result.AverageIterations += (float)LowRateScene.State.NumIterations / NumChains;
+
+			// the low rate steps less often than frames, so states are only comparable when both are up to date
+			if (LowRateScene.RemainingTime > KINDA_SMALL_NUMBER || ReferenceScene.RemainingTime > KINDA_SMALL_NUMBER)
+			{
+				continue;
+			}
+
+			for (int32 Index = 0; Index < LowRateScene.State.Num(); Index++)
+			{
+				Result.MaxDifference = FMath::Max(Result.MaxDifference, FVector::Dist(LowRateScene.State.Positions.Get(Index), ReferenceScene.State.Positions.Get(Index)));
+			}
+		}
+
+		const double NumLinkFrames = (double)NumChains * NumLinks * NumFrames;
+		Result.LowRateNanoSeconds = Seconds[0] * 1.0e9 / NumLinkFrames;
+		Result.ReferenceRateNanoSeconds = Seconds[1] * 1.0e9 / NumLinkFrames;
+		Result.AverageIterations /= NumFrames;
+
+		return Result;
+	}
+
+	/** Integration setup compared by CompareIntegrators */
+	struct FIntegratorCase
+	{
+		const TCHAR* Name;
+		ESoftBoneIntegration::Type Integration;
+		float TimeStep;
+		bool bFixedTimeStep;
+
+		/** Results */
+		float MaxError;
+		float AverageError;
+		double NanoSecondsPerLinkFrame;
+	};
+
+	/**
+	 * Simulates the same chains with each case and with the analytic integration at ReferenceHertz,
+	 * and measures how far each case gets from the reference over all frames.
+	 */
+	static void CompareIntegrators(int32 NumChains, int32 NumLinks, int32 NumFrames, const FSoftBoneSolverParams& Params, float ReferenceHertz, FIntegratorCase* Cases, int32 NumCases)
+	{
+		FSyntheticScene ReferenceScene;
+		SetUpScene(ReferenceScene, NumChains, NumLinks);
+
+		TArray<FSyntheticScene> Scenes;
+		Scenes.AddDefaulted(NumCases);
+
+		for (int32 CaseIndex = 0; CaseIndex < NumCases; CaseIndex++)
+		{
+			SetUpScene(Scenes[CaseIndex], NumChains, NumLinks);
+
+			Cases[CaseIndex].MaxError = 0.f;
+			Cases[CaseIndex].AverageError = 0.f;
+			Cases[CaseIndex].NanoSecondsPerLinkFrame = 0.0;
+		}
+
+		FSoftBoneSolverParams ReferenceParams = Params;
+		ReferenceParams.Integration = ESoftBoneIntegration::Analytic;
+
+		for (int32 Frame = 0; Frame < NumFrames; Frame++)
+		{
+			const float Time = (Frame + 1) * FrameDeltaTime;
+
+			ComputeTargetPositions(ReferenceScene, 0, Time);
+			SimulateScene(ReferenceScene, ReferenceParams, 1.f / ReferenceHertz);
+
+			for (int32 CaseIndex = 0; CaseIndex < NumCases; CaseIndex++)
+			{
+				FIntegratorCase& Case = Cases[CaseIndex];
+				FSyntheticScene& Scene = Scenes[CaseIndex];
+
+				FSoftBoneSolverParams CaseParams = Params;
+				CaseParams.Integration = Case.Integration;
+
+				ComputeTargetPositions(Scene, 0, Time);
+
+				const double StartTime = FPlatformTime::Seconds();
+
+				SimulateScene(Scene, CaseParams, Case.TimeStep, Case.bFixedTimeStep);
+
+				Case.NanoSecondsPerLinkFrame += FPlatformTime::Seconds() - StartTime;
+
+				for (int32 Index = 0; Index < Scene.State.Num(); Index++)
+				{
+					const float Error = FVector::Dist(Scene.State.Positions.Get(Index), ReferenceScene.State.Positions.Get(Index));
+
+					Case.MaxError = FMath::Max(Case.MaxError, Error);
+					Case.AverageError += Error;
+				}
+			}
+		}
+
+		const double NumLinkFrames = (double)NumChains * NumLinks * NumFrames;
+
+		for (int32 CaseIndex = 0; CaseIndex < NumCases; CaseIndex++)
+		{
+			Cases[CaseIndex].AverageError /= NumLinkFrames;
+			Cases[CaseIndex].NanoSecondsPerLinkFrame *= 1.0e9 / NumLinkFrames;
+		}
+	}
+
+	/** One capsule lying under each row of 32 chains. Every chain touches the capsule of its row unless Height moves them away. */
+	static void InitializeColliders(TArray<FSoftBoneCollider>& Colliders, int32 NumChains, float Height)
+	{
+		const int32 NumRows = FMath::DivideAndRoundUp(NumChains, 32);
+
+		Colliders.Reset();
+
+		for (int32 Row = 0; Row < NumRows; Row++)
+		{
+			Colliders.Add(FSoftBoneCollider(FVector(-100.f, Row * 100.f, Height), FVector(3300.f, Row * 100.f, Height), 20.f));
+		}
+	}
+
+	/** Simulates chains with Colliders, returns the cost per link step in nanoseconds and the max penetration left after the last frame */
+	static double MeasureCollisionCost(int32 NumChains, int32 NumLinks, int32 NumFrames, const FSoftBoneSolverParams& Params, const TArray<FSoftBoneCollider>& Colliders, float& OutMaxPenetration)
+	{
+		FSyntheticScene Scene;
+		SetUpScene(Scene, NumChains, NumLinks);
+
+		FSoftBoneSolverParams CollisionParams = Params;
+		CollisionParams.Colliders = Colliders.GetData();
+		CollisionParams.NumColliders = Colliders.Num();
+
+		const FSceneTiming Timing = MeasureScene(Scene, NumFrames, CollisionParams);
+
+		OutMaxPenetration = 0.f;
+
+		for (int32 ChainIndex = 0; ChainIndex < NumChains; ChainIndex++)
+		{
+			const FSoftBoneChainRange& Chain = Scene.State.Chains[ChainIndex];
+
+			// roots are pinned to their targets and never pushed
+			for (int32 Index = Chain.LinkOffset + 1; Index < Chain.LinkOffset + Chain.NumLinks; Index++)
+			{
+				const FVector Position = Scene.State.Positions.Get(Index);
+
+				for (int32 ColliderIndex = 0; ColliderIndex < Colliders.Num(); ColliderIndex++)
+				{
+					const FSoftBoneCollider& Collider = Colliders[ColliderIndex];
+					const FVector Closest = FMath::ClosestPointOnSegment(Position, Collider.Start, Collider.End);
+
+					OutMaxPenetration = FMath::Max(OutMaxPenetration, Collider.Radius - FVector::Dist(Position, Closest));
+				}
+			}
+		}
+
+		return Timing.GetNanoSecondsPerLinkStep(NumLinks);
+	}
+
+	struct FCompactStateComparison
+	{
+		/** Heap memory of all per link streams kept by the instance in between frames, like a node with sleeping enabled */
+		double FullBytesPerLink;
+		double CompactBytesPerLink;
+
+		/** Compact instances keep their final targets as well while they are waiting for the batch */
+		double BatchedCompactBytesPerLink;
+
+		float MaxRoundTripError;
+		float MaxDifference;
+		float AverageDifference;
+		double FullNanoSeconds;
+		double CompactNanoSeconds;
+
+		/** One expansion and release per link. Batched instances pay it twice per frame, once when evaluated and once when simulated. */
+		double RoundTripNanoSeconds;
+	};
+
+	/** Expands the compact instance with the targets of Full like a node does when it gathers them, and advances it like the full precision one */
+	static void SimulateLikeNode(FSyntheticScene& Scene, const FSoftBoneVectorStream& FinalTargetPositions, const FSoftBoneSleepParams& SleepParams)
+	{
+		Scene.ExpandState();
+
+		Scene.FinalTargetPositions.SetNumZeroed(FinalTargetPositions.Num());
+		Scene.FinalTargetPositions.CopyFrom(FinalTargetPositions);
+		FSoftBoneSolver::UpdateSleepStates(Scene.State, Scene.FinalTargetPositions, Scene.ReferenceTargetPositions, SleepParams, FrameDeltaTime);
+
+		Scene.RemainingTime += FrameDeltaTime;
+		Scene.Simulate();
+
+		Scene.ReleaseState();
+	}
+
+	/**
+	 * Simulates the same chains with full precision links and with links compressed in between frames, like a node with bCompactState.
+	 * Both keep reference targets for sleeping like nodes with bEnableSleep.
+	 * Differences are measured after every frame against the full precision run, costs are per link frame including the round trip.
+	 */
+	static FCompactStateComparison CompareCompactState(int32 NumChains, int32 NumLinks, int32 NumFrames, const FSoftBoneSolverParams& Params)
+	{
+		const int32 NumAllLinks = NumChains * NumLinks;
+		const FSoftBoneSleepParams SleepParams;
+
+		FSyntheticScene Full;
+		SetUpScene(Full, NumChains, NumLinks);
+		Full.ReferenceTargetPositions.SetNumZeroed(NumAllLinks);
+		Full.Params = Params;
+
+		FSyntheticScene Compact;
+		InitializeScene(Compact, NumChains, NumLinks);
+		Compact.FinalTargetPositions.CopyFrom(Full.FinalTargetPositions);
+		SetLinksToTargets(Compact);
+		Compact.ReferenceTargetPositions.SetNumZeroed(NumAllLinks);
+		Compact.Params = Params;
+		Compact.bCompactState = true;
+
+		// decompressed only for comparison, so the compact run is not rounded once more
+		FSoftBoneChainState Expanded;
+		FSoftBoneVectorStream ExpandedTargetPositions;
+
+		FCompactStateComparison Result;
+		FMemory::Memzero(Result);
+
+		for (int32 Frame = 0; Frame < NumFrames; Frame++)
+		{
+			ComputeTargetPositions(Full, 0, (Frame + 1) * FrameDeltaTime);
+
+			const double StartTime = FPlatformTime::Seconds();
+			FSoftBoneSolver::UpdateSleepStates(Full.State, Full.FinalTargetPositions, Full.ReferenceTargetPositions, SleepParams, FrameDeltaTime);
+			Full.RemainingTime += FrameDeltaTime;
+			Full.Simulate();
+			const double CompactStartTime = FPlatformTime::Seconds();
+			SimulateLikeNode(Compact, Full.FinalTargetPositions, SleepParams);
+			const double EndTime = FPlatformTime::Seconds();
+
+			Result.FullNanoSeconds += CompactStartTime - StartTime;
+			Result.CompactNanoSeconds += EndTime - CompactStartTime;
+
+			FSoftBoneSolver::DecompressState(Compact.CompactState, Expanded, ExpandedTargetPositions);
+
+			for (int32 Index = 0; Index < Full.State.Num(); Index++)
+			{
+				const float Difference = FVector::Dist(Full.State.Positions.Get(Index), Expanded.Positions.Get(Index));
+
+				Result.MaxDifference = FMath::Max(Result.MaxDifference, Difference);
+				Result.AverageDifference += Difference;
+			}
+		}
+
+		Result.FullBytesPerLink = (double)Full.GetAllocatedSize() / NumAllLinks;
+		Result.CompactBytesPerLink = (double)Compact.GetAllocatedSize() / NumAllLinks;
+
+		// released by an evaluation which handed the instance to the batch
+		{
+			const double StartTime = FPlatformTime::Seconds();
+
+			for (int32 Frame = 0; Frame < NumFrames; Frame++)
+			{
+				Compact.ExpandState();
+				Compact.FinalTargetPositions.SetNumZeroed(NumAllLinks);
+				Compact.FinalTargetPositions.CopyFrom(Full.FinalTargetPositions);
+				Compact.bPendingSimulation = true;
+				Compact.ReleaseState();
+			}
+
+			Result.RoundTripNanoSeconds = (FPlatformTime::Seconds() - StartTime) * 1.0e9 / ((double)NumAllLinks * NumFrames);
+			Result.BatchedCompactBytesPerLink = (double)Compact.GetAllocatedSize() / NumAllLinks;
+			Compact.bPendingSimulation = false;
+		}
+
+		// error of one round trip, the differences above add up over all frames
+		FSoftBoneCompactChainState RoundTrip;
+		FSoftBoneSolver::CompressState(Full.State, Full.TargetPositions, RoundTrip);
+		FSoftBoneSolver::DecompressState(RoundTrip, Expanded, ExpandedTargetPositions);
+
+		for (int32 Index = 0; Index < Full.State.Num(); Index++)
+		{
+			Result.MaxRoundTripError = FMath::Max(Result.MaxRoundTripError, FVector::Dist(Full.State.Positions.Get(Index), Expanded.Positions.Get(Index)));
+		}
+
+		const double NumLinkFrames = (double)NumAllLinks * NumFrames;
+
+		Result.AverageDifference /= NumLinkFrames;
+		Result.FullNanoSeconds *= 1.0e9 / NumLinkFrames;
+		Result.CompactNanoSeconds *= 1.0e9 / NumLinkFrames;
+
+		return Result;
+	}
+
+	struct FForceFieldCost
+	{
+		double NanoSecondsPerLinkStep;
+		double SampleNanoSecondsPerChain;
+		float AverageTipDeflection;
+	};
+
+	/**
+	 * Simulates chains in gusty wind with an explosion in the middle of the grid every second, sampled once per chain and frame like nodes do.
+	 * Without bForces the same chains are simulated without them. Link step costs include the sampling.
+	 * The deflection is the average distance of the tips to their targets over all frames, so the forces can be seen to act.
+	 */
+	static FForceFieldCost MeasureForceFieldCost(int32 NumChains, int32 NumLinks, int32 NumFrames, const FSoftBoneSolverParams& Params, bool bForces)
+	{
+		FSyntheticScene Scene;
+		SetUpScene(Scene, NumChains, NumLinks);
+
+		FSoftBoneForceField ForceField;
+
+		FSoftBoneWind Wind;
+		Wind.Direction = FVector(0.f, 1.f, 0.f);
+		Wind.Speed = 0.1f;
+		Wind.MaxGust = 0.1f;
+
+		FSoftBoneForceScales Scales;
+		Scales.Wind = 2000.f;
+		Scales.Radial = 1.f;
+
+		FSoftBoneSolverParams ForceParams = Params;
+		const FVector ExplosionOrigin(1600.f, FMath::DivideAndRoundUp(NumChains, 32) * 50.f, 0.f);
+
+		FSceneTiming Timing;
+		double SampleSeconds = 0.0;
+		double TipDeflection = 0.0;
+
+		for (int32 Frame = 0; Frame < NumFrames; Frame++)
+		{
+			ComputeTargetPositions(Scene, 0, (Frame + 1) * FrameDeltaTime);
+
+			if (bForces && Frame % 60 == 0)
+			{
+				ForceField.RadialForces.Add(FSoftBoneRadialForce(ExplosionOrigin, 1500.f, 20000.f, 0.2f));
+			}
+
+			const double StartTime = FPlatformTime::Seconds();
+
+			if (bForces)
+			{
+				Wind.GustTime = ForceField.Time;
+				ForceField.SampleChains(Scene.State, Scene.FinalTargetPositions, FTransform::Identity, Wind, Scales, Scene.ExternalAccelerations);
+				ForceParams.LinkAccelerations = &Scene.ExternalAccelerations;
+			}
+
+			SampleSeconds += FPlatformTime::Seconds() - StartTime;
+
+			SimulateSceneTimed(Scene, ForceParams, Timing);
+
+			ForceField.Advance(FrameDeltaTime);
+
+			for (int32 ChainIndex = 0; ChainIndex < NumChains; ChainIndex++)
+			{
+				const int32 TipIndex = Scene.State.Chains[ChainIndex].LinkOffset + NumLinks - 1;
+				TipDeflection += FVector::Dist(Scene.State.Positions.Get(TipIndex), Scene.FinalTargetPositions.Get(TipIndex));
+			}
+		}
+
+		// link steps pay for the sampling as well
+		Timing.Seconds += SampleSeconds;
+
+		FForceFieldCost Cost;
+		Cost.NanoSecondsPerLinkStep = Timing.GetNanoSecondsPerLinkStep(NumLinks);
+		Cost.SampleNanoSecondsPerChain = (SampleSeconds * 1.0e9) / ((double)NumFrames * NumChains);
+		Cost.AverageTipDeflection = (float)(TipDeflection / ((double)NumFrames * NumChains));
+
+		return Cost;
+	}
+
+	/** Results of SoftBone.Benchmark which have to stay within a tolerance, logged together after the measurements */
+	struct FBenchmarkChecks
+	{
+		struct FCheck
+		{
+			FString Name;
+			float Value;
+			float Tolerance;
+		};
+
+		TArray<FCheck> Checks;
+
+		/** Passes if Value is at most Tolerance, which fails NaNs as well */
+		void Add(const FString& Name, float Value, float Tolerance)
+		{
+			FCheck Check;
+			Check.Name = Name;
+			Check.Value = Value;
+			Check.Tolerance = Tolerance;
+			Checks.Add(Check);
+		}
+
+		/** Logs every check, failures as errors so a headless run can be checked by its log, and returns the number of failures */
+		int32 Report() const
+		{
+			int32 NumFailed = 0;
+
+			UE_LOG(LogSoftBoneTests, Display, TEXT("    Checks :"));
+
+			for (int32 Index = 0; Index < Checks.Num(); Index++)
+			{
+				const FCheck& Check = Checks[Index];
+				const FString Line = FString::Printf(TEXT("        %s : %f, tolerance %f"), *Check.Name, Check.Value, Check.Tolerance);
+
+				if (Check.Value <= Check.Tolerance)
+				{
+					UE_LOG(LogSoftBoneTests, Display, TEXT("%s"), *Line);
+				}
+				else
+				{
+					NumFailed++;
+					UE_LOG(LogSoftBoneTests, Error, TEXT("%s FAILED"), *Line);
+				}
+			}
+
+			return NumFailed;
+		}
+	};
+
+	/** Solver results which are supposed to be identical, like the flattened state and the reference */
+	static const float IdenticalTolerance = 1.0e-3f;
+
+	/** Quaternion components of the shortest arc against the axis-angle rotation */
+	static const float ReOrientationTolerance = 1.0e-4f;
+
+	/** Component space simulation against world space as a fraction of the chain length. Rounding far from the origin makes long chains drift apart a little. */
+	static const float ComponentSpaceTolerance = 0.1f;
+
+	/** Penetration left by the colliders */
+	static const float PenetrationTolerance = 0.01f;
+
+	/** Compact round trip error as a fraction of the chain length, a little over half a step of 16 bits */
+	static const float CompactRoundTripTolerance = 1.0e-4f;
+
+	/** Average error of the analytic integration in one step per frame as a multiple of the explicit one at 120Hz */
+	static const float AnalyticOneStepTolerance = 2.f;
+
+	/** Average error in cm which is never visible, so very short runs don't fail on a ratio of tiny errors */
+	static const float InvisibleAverageError = 0.5f;
+
+	/** Frames the integrators need to run before their average error isn't dominated by the chains starting to move */
+	static const int32 MinAccuracyFrames = 60;
+
+	/** Size and length of a SoftBone.Benchmark run, and the solver settings every feature starts from */
+	struct FBenchmarkConfig
+	{
+		int32 NumChains;
+		int32 NumLinks;
+		int32 NumFrames;
+		FSoftBoneSolverParams Params;
+
+		float GetChainLength() const
+		{
+			return NumLinks * BoneLength;
+		}
+	};
+
+	/** Integrations measured one after the other, in the order of ESoftBoneIntegration */
+	static const TCHAR* const IntegrationNames[] = { TEXT("Explicit"), TEXT("XPBD"), TEXT("Analytic") };
+
+	/**
+	 * Measures all chains in one flattened state, one sub step loop per chain and the array of structs reference.
+	 * Leaves the flattened state in Scene and returns its checksum, so results of different solver versions can be compared.
+	 */
+	static double BenchmarkSolver(const FBenchmarkConfig& Config, FBenchmarkChecks& Checks, FSyntheticScene& Scene)
+	{
+		const int32 NumChains = Config.NumChains;
+		const int32 NumLinks = Config.NumLinks;
+		const int32 NumFrames = Config.NumFrames;
+
+		SetUpScene(Scene, NumChains, NumLinks);
+
+		TArray<FReferenceChain> ReferenceChains;
+		ReferenceChains.AddDefaulted(NumChains);
+
+		for (int32 ChainIndex = 0; ChainIndex < NumChains; ChainIndex++)
+		{
+			ReferenceChains[ChainIndex].Initialize(Scene.State, Scene.State.Chains[ChainIndex]);
+		}
+
+		const FSceneTiming Timing = MeasureScene(Scene, NumFrames, Config.Params);
+
+		// one state and one sub step loop per chain
+		TArray<FSyntheticScene> ChainScenes;
+		ChainScenes.AddDefaulted(NumChains);
+		FSceneTiming PerChainTiming;
+
+		for (int32 ChainIndex = 0; ChainIndex < NumChains; ChainIndex++)
+		{
+			SetUpScene(ChainScenes[ChainIndex], 1, NumLinks, ChainIndex);
+			PerChainTiming.Seconds += MeasureScene(ChainScenes[ChainIndex], NumFrames, Config.Params, ChainIndex).Seconds;
+		}
+
+		// the reference moves along the targets of the flattened state
+		FSyntheticScene Targets;
+		InitializeScene(Targets, NumChains, NumLinks);
+		FSceneTiming ReferenceTiming;
+
+		for (int32 Frame = 0; Frame < NumFrames; Frame++)
+		{
+			ComputeTargetPositions(Targets, 0, (Frame + 1) * FrameDeltaTime);
+
+			const double StartTime = FPlatformTime::Seconds();
+
+			for (int32 ChainIndex = 0; ChainIndex < NumChains; ChainIndex++)
+			{
+				FReferenceChain& ReferenceChain = ReferenceChains[ChainIndex];
+				ReferenceChain.RemainingTime = ReferenceChain.Simulate(Targets.FinalTargetPositions, Targets.State.Chains[ChainIndex].LinkOffset, ReferenceChain.RemainingTime + FrameDeltaTime, Config.Params);
+			}
+
+			ReferenceTiming.Seconds += FPlatformTime::Seconds() - StartTime;
+		}
+
+		double Checksum = 0.0;
+		float MaxPerChainError = 0.f;
+		float MaxReferenceError = 0.f;
+
+		for (int32 ChainIndex = 0; ChainIndex < NumChains; ChainIndex++)
+		{
+			const int32 LinkOffset = Scene.State.Chains[ChainIndex].LinkOffset;
+
+			for (int32 Index = 0; Index < NumLinks; Index++)
+			{
+				const FVector Position = Scene.State.Positions.Get(LinkOffset + Index);
+
+				Checksum += (Position - Scene.FinalTargetPositions.Get(LinkOffset + Index)).Size();
+				MaxPerChainError = FMath::Max(MaxPerChainError, FVector::Dist(Position, ChainScenes[ChainIndex].State.Positions.Get(Index)));
+				MaxReferenceError = FMath::Max(MaxReferenceError, FVector::Dist(Position, ReferenceChains[ChainIndex].Positions[Index]));
+			}
+		}
+
+		// all runs take the same sub steps
+		PerChainTiming.NumChainSteps = Timing.NumChainSteps;
+		ReferenceTiming.NumChainSteps = Timing.NumChainSteps;
+
+		UE_LOG(LogSoftBoneTests, Display, TEXT("SoftBone benchmark : %d chains x %d links, %d frames, %lld sub steps"), NumChains, NumLinks, NumFrames, Timing.NumChainSteps);
+		UE_LOG(LogSoftBoneTests, Display, TEXT("    Solver : %.3f ms total, %.3f ms per frame, %.2f ns per link step"), Timing.Seconds * 1000.0, Timing.Seconds * 1000.0 / NumFrames, Timing.GetNanoSecondsPerLinkStep(NumLinks));
+		UE_LOG(LogSoftBoneTests, Display, TEXT("    One sub step loop per chain : %.2f ns per link step, flattened speed up x%.2f, max difference %f"), PerChainTiming.GetNanoSecondsPerLinkStep(NumLinks), (Timing.Seconds > 0.0) ? PerChainTiming.Seconds / Timing.Seconds : 0.0, MaxPerChainError);
+		UE_LOG(LogSoftBoneTests, Display, TEXT("    Reference (array of structs) : %.2f ns per link step, speed up x%.2f, max error %f"), ReferenceTiming.GetNanoSecondsPerLinkStep(NumLinks), (Timing.Seconds > 0.0) ? ReferenceTiming.Seconds / Timing.Seconds : 0.0, MaxReferenceError);
+
+		Checks.Add(TEXT("One sub step loop per chain, max difference"), MaxPerChainError, IdenticalTolerance);
+		Checks.Add(TEXT("Reference, max error"), MaxReferenceError, IdenticalTolerance);
+
+		return Checksum;
+	}
+
+	static void BenchmarkComponentSpace(const FBenchmarkConfig& Config, FBenchmarkChecks& Checks)
+	{
+		// the component moves away from the origin, so after a while world space is the less precise one of both
+		const int32 MaxComponentSpaceFrames = 600;
+		const float ComponentSpaceDifference = CompareComponentSpaceSimulation(Config.NumLinks, FMath::Min(Config.NumFrames, MaxComponentSpaceFrames), Config.Params);
+
+		UE_LOG(LogSoftBoneTests, Display, TEXT("    Component space simulation : max difference to world space %f"), ComponentSpaceDifference);
+		Checks.Add(TEXT("Component space simulation, max difference to world space"), ComponentSpaceDifference, Config.GetChainLength() * ComponentSpaceTolerance);
+	}
+
+	static void BenchmarkReOrientation(const FSyntheticScene& Scene, FBenchmarkChecks& Checks)
+	{
+		double AxisAngleNanoSeconds = 0.0;
+		double ShortestArcNanoSeconds = 0.0;
+		const float MaxReOrientationError = CompareReOrientation(Scene, 100, AxisAngleNanoSeconds, ShortestArcNanoSeconds);
+
+		UE_LOG(LogSoftBoneTests, Display, TEXT("    Re-orientation : axis-angle %.2f ns per link, shortest arc batch %.2f ns per link, speed up x%.2f, max quaternion difference %f"), AxisAngleNanoSeconds, ShortestArcNanoSeconds, (ShortestArcNanoSeconds > 0.0) ? AxisAngleNanoSeconds / ShortestArcNanoSeconds : 0.0, MaxReOrientationError);
+		Checks.Add(TEXT("Re-orientation, max quaternion difference of the shortest arc"), MaxReOrientationError, ReOrientationTolerance);
+	}
+
+	static void BenchmarkCollision(const FBenchmarkConfig& Config, FBenchmarkChecks& Checks)
+	{
+		TArray<FSoftBoneCollider> Colliders;
+		float MaxPenetration = 0.f;
+		const double NoCollisionNanoSeconds = MeasureCollisionCost(Config.NumChains, Config.NumLinks, Config.NumFrames, Config.Params, Colliders, MaxPenetration);
+
+		InitializeColliders(Colliders, Config.NumChains, 10000.f);
+		const double FarNanoSeconds = MeasureCollisionCost(Config.NumChains, Config.NumLinks, Config.NumFrames, Config.Params, Colliders, MaxPenetration);
+
+		InitializeColliders(Colliders, Config.NumChains, -15.f);
+		const double NearNanoSeconds = MeasureCollisionCost(Config.NumChains, Config.NumLinks, Config.NumFrames, Config.Params, Colliders, MaxPenetration);
+
+		UE_LOG(LogSoftBoneTests, Display, TEXT("    Collision : %d capsules, %.2f ns per link step touching, %.2f ns culled, %.2f ns without colliders, max penetration %f"), Colliders.Num(), NearNanoSeconds - NoCollisionNanoSeconds, FarNanoSeconds - NoCollisionNanoSeconds, NoCollisionNanoSeconds, MaxPenetration);
+		Checks.Add(TEXT("Collision, max penetration"), MaxPenetration, PenetrationTolerance);
+	}
+
+	/** Each combination of options runs its own specialized sub step, with colliders touching the chains */
+	static void BenchmarkSubStepVariants(const FBenchmarkConfig& Config)
+	{
+		TArray<FSoftBoneCollider> Colliders;
+		InitializeColliders(Colliders, Config.NumChains, -15.f);
+
+		const TArray<FSoftBoneCollider> NoColliders;
+		float MaxPenetration = 0.f;
+
+		UE_LOG(LogSoftBoneTests, Display, TEXT("    Sub step variants (ns per link step) :"));
+
+		for (int32 Integration = 0; Integration < ARRAY_COUNT(IntegrationNames); Integration++)
+		{
+			double VariantNanoSeconds[2][2];
+
+			for (int32 LengthConstraint = 0; LengthConstraint < 2; LengthConstraint++)
+			{
+				for (int32 Collision = 0; Collision < 2; Collision++)
+				{
+					FSoftBoneSolverParams VariantParams = Config.Params;
+					VariantParams.Integration = (ESoftBoneIntegration::Type)Integration;
+					VariantParams.bBoneLengthConstraint = (LengthConstraint != 0);
+
+					VariantNanoSeconds[LengthConstraint][Collision] = MeasureCollisionCost(Config.NumChains, Config.NumLinks, Config.NumFrames, VariantParams, (Collision != 0) ? Colliders : NoColliders, MaxPenetration);
+				}
+			}
+
+			UE_LOG(LogSoftBoneTests, Display, TEXT("        %s : %.2f springs only, %.2f with length constraint, %.2f with colliders, %.2f with both"),
+				IntegrationNames[Integration], VariantNanoSeconds[0][0], VariantNanoSeconds[1][0], VariantNanoSeconds[0][1], VariantNanoSeconds[1][1]);
+		}
+	}
+
+	/** Time step independence at 30Hz of the explicit solver and XPBD */
+	static void BenchmarkTimeSteps(const FBenchmarkConfig& Config, FBenchmarkChecks& Checks)
+	{
+		const float LowTimeStep = 1.f / 30.f;
+		const FTimeStepComparison Explicit = CompareTimeSteps(Config.NumChains, Config.NumLinks, Config.NumFrames, Config.Params, LowTimeStep);
+
+		FSoftBoneSolverParams XPBDParams = Config.Params;
+		XPBDParams.Integration = ESoftBoneIntegration::XPBD;
+		const FTimeStepComparison XPBD = CompareTimeSteps(Config.NumChains, Config.NumLinks, Config.NumFrames, XPBDParams, LowTimeStep);
+
+		UE_LOG(LogSoftBoneTests, Display, TEXT("    Explicit : max difference 30Hz to 120Hz %f, %.2f ns per link frame at 30Hz, %.2f ns at 120Hz"), Explicit.MaxDifference, Explicit.LowRateNanoSeconds, Explicit.ReferenceRateNanoSeconds);
+		UE_LOG(LogSoftBoneTests, Display, TEXT("    XPBD (%d iterations, tolerance %.3f) : max difference 30Hz to 120Hz %f, %.2f iterations per step at 30Hz, %.2f ns per link frame at 30Hz, %.2f ns at 120Hz, x%.2f cheaper than explicit 120Hz"),
+			XPBDParams.NumIterations, XPBDParams.ConvergenceTolerance, XPBD.MaxDifference, XPBD.AverageIterations, XPBD.LowRateNanoSeconds, XPBD.ReferenceRateNanoSeconds, (XPBD.LowRateNanoSeconds > 0.0) ? Explicit.ReferenceRateNanoSeconds / XPBD.LowRateNanoSeconds : 0.0);
+
+		// the point of XPBD is to depend less on the time step than the explicit solver
+		Checks.Add(TEXT("XPBD, max difference 30Hz to 120Hz against explicit"), XPBD.MaxDifference, Explicit.MaxDifference);
+		Checks.Add(TEXT("XPBD, iterations per step at 30Hz"), XPBD.AverageIterations, (float)XPBDParams.NumIterations);
+	}
+
+	/** Deferred instances without fixed steps catch up in steps of one frame */
+	static void BenchmarkDeferredCatchUp(const FBenchmarkConfig& Config, FBenchmarkChecks& Checks)
+	{
+		const int32 NumDeferredFrames = 8;
+		FSoftBoneSolverParams CatchUpParams = Config.Params;
+		CatchUpParams.MaxSubSteps = NumDeferredFrames;
+		CatchUpParams.MaxStepTime = FrameDeltaTime;
+		const float CatchUpDifference = CompareDeferredCatchUp(Config.NumChains, Config.NumLinks, Config.NumFrames, CatchUpParams, NumDeferredFrames);
+
+		CatchUpParams.MaxStepTime = 0.f;
+		const float OneStepCatchUpDifference = CompareDeferredCatchUp(Config.NumChains, Config.NumLinks, Config.NumFrames, CatchUpParams, NumDeferredFrames);
+
+		UE_LOG(LogSoftBoneTests, Display, TEXT("    Deferred catch up of %d frames without fixed steps : max difference to every frame %f in steps of one frame, %f in one step"), NumDeferredFrames, CatchUpDifference, OneStepCatchUpDifference);
+		Checks.Add(TEXT("Deferred catch up in steps of one frame, max difference to every frame against one step"), CatchUpDifference, OneStepCatchUpDifference);
+	}
+
+	/** Accuracy against the same springs at a high rate */
+	static void BenchmarkIntegrators(const FBenchmarkConfig& Config, FBenchmarkChecks& Checks)
+	{
+		const float ReferenceHertz = 960.f;
+		FIntegratorCase IntegratorCases[] =
+		{
+			{ TEXT("Explicit 120Hz"), ESoftBoneIntegration::Explicit, FixedTimeStep, true },
+			{ TEXT("Explicit one step per frame"), ESoftBoneIntegration::Explicit, FixedTimeStep, false },
+			{ TEXT("Analytic 120Hz"), ESoftBoneIntegration::Analytic, FixedTimeStep, true },
+			{ TEXT("Analytic 30Hz"), ESoftBoneIntegration::Analytic, 1.f / 30.f, true },
+			{ TEXT("Analytic one step per frame"), ESoftBoneIntegration::Analytic, FixedTimeStep, false },
+		};
+
+		CompareIntegrators(Config.NumChains, Config.NumLinks, Config.NumFrames, Config.Params, ReferenceHertz, IntegratorCases, ARRAY_COUNT(IntegratorCases));
+
+		UE_LOG(LogSoftBoneTests, Display, TEXT("    Accuracy against analytic %.0fHz :"), ReferenceHertz);
+
+		for (int32 CaseIndex = 0; CaseIndex < ARRAY_COUNT(IntegratorCases); CaseIndex++)
+		{
+			const FIntegratorCase& Case = IntegratorCases[CaseIndex];
+			UE_LOG(LogSoftBoneTests, Display, TEXT("        %s : average error %f, max error %f, %.2f ns per link frame"), Case.Name, Case.AverageError, Case.MaxError, Case.NanoSecondsPerLinkFrame);
+		}
+
+		// one analytic step per frame has to stay close to the fixed step path, and be better than one explicit step per frame
+		const FIntegratorCase& Explicit120Hz = IntegratorCases[0];
+		const FIntegratorCase& ExplicitOneStep = IntegratorCases[1];
+		const FIntegratorCase& AnalyticOneStep = IntegratorCases[4];
+
+		if (Config.NumFrames >= MinAccuracyFrames)
+		{
+			Checks.Add(TEXT("Analytic one step per frame, average error against explicit 120Hz"), AnalyticOneStep.AverageError, FMath::Max(Explicit120Hz.AverageError * AnalyticOneStepTolerance, InvisibleAverageError));
+			Checks.Add(TEXT("Analytic one step per frame, average error against explicit one step per frame"), AnalyticOneStep.AverageError, ExplicitOneStep.AverageError);
+		}
+	}
+
+	static void BenchmarkCompactState(const FBenchmarkConfig& Config, FBenchmarkChecks& Checks)
+	{
+		UE_LOG(LogSoftBoneTests, Display, TEXT("    Compact state (16 bit links relative to chain roots) :"));
+
+		for (int32 Integration = 0; Integration < ARRAY_COUNT(IntegrationNames); Integration++)
+		{
+			FSoftBoneSolverParams CompactParams = Config.Params;
+			CompactParams.Integration = (ESoftBoneIntegration::Type)Integration;
+
+			const FCompactStateComparison Compact = CompareCompactState(Config.NumChains, Config.NumLinks, Config.NumFrames, CompactParams);
+
+			UE_LOG(LogSoftBoneTests, Display, TEXT("        %s : %.1f bytes per link, %.1f while batched, full precision %.1f, max round trip error %f, after %d frames max difference %f, average difference %f, %.2f ns per link frame, full precision %.2f, %.2f ns per link round trip"),
+				IntegrationNames[Integration], Compact.CompactBytesPerLink, Compact.BatchedCompactBytesPerLink, Compact.FullBytesPerLink, Compact.MaxRoundTripError, Config.NumFrames, Compact.MaxDifference, Compact.AverageDifference,
+				Compact.CompactNanoSeconds, Compact.FullNanoSeconds, Compact.RoundTripNanoSeconds);
+
+			Checks.Add(FString::Printf(TEXT("Compact state %s, max round trip error"), IntegrationNames[Integration]), Compact.MaxRoundTripError, Config.GetChainLength() * CompactRoundTripTolerance);
+			Checks.Add(FString::Printf(TEXT("Compact state %s, bytes per link while batched against full precision"), IntegrationNames[Integration]), Compact.BatchedCompactBytesPerLink, Compact.FullBytesPerLink);
+		}
+
+		// evaluation buffers of nodes are shared by the evaluating thread, only the bones of sleeping chains are kept next to the links
+		UE_LOG(LogSoftBoneTests, Display, TEXT("        Nodes add %d bytes per bone for sleeping chains in full precision, and none in the compact state"), (int32)(sizeof(FVector) + sizeof(FQuat)));
+	}
+
+	static void BenchmarkExternalForces(const FBenchmarkConfig& Config)
+	{
+		UE_LOG(LogSoftBoneTests, Display, TEXT("    External forces (wind and explosions sampled once per chain) :"));
+
+		for (int32 Integration = 0; Integration < ARRAY_COUNT(IntegrationNames); Integration++)
+		{
+			FSoftBoneSolverParams ForceParams = Config.Params;
+			ForceParams.Integration = (ESoftBoneIntegration::Type)Integration;
+
+			const FForceFieldCost Without = MeasureForceFieldCost(Config.NumChains, Config.NumLinks, Config.NumFrames, ForceParams, false);
+			const FForceFieldCost With = MeasureForceFieldCost(Config.NumChains, Config.NumLinks, Config.NumFrames, ForceParams, true);
+
+			UE_LOG(LogSoftBoneTests, Display, TEXT("        %s : %.2f ns per link step with forces, %.2f without, sampling %.2f ns per chain frame, average tip deflection %f with forces, %f without"),
+				IntegrationNames[Integration], With.NanoSecondsPerLinkStep, Without.NanoSecondsPerLinkStep, With.SampleNanoSecondsPerChain, With.AverageTipDeflection, Without.AverageTipDeflection);
+		}
+	}
+
+	int32 Run(const TArray<FString>& Args)
+	{
+		FBenchmarkConfig Config;
+		Config.NumChains = (Args.Num() > 0) ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 256;
+		Config.NumLinks = (Args.Num() > 1) ? FMath::Max(FCString::Atoi(*Args[1]), 2) : 16;
+		Config.NumFrames = (Args.Num() > 2) ? FMath::Max(FCString::Atoi(*Args[2]), 1) : 600;
+		Config.Params.ExternalAcceleration = FVector(0.f, 0.f, -980.f * 0.25f);
+		Config.Params.DampingRatio = 0.1f;
+		Config.Params.bBoneLengthConstraint = true;
+
+		FBenchmarkChecks Checks;
+		FSyntheticScene Scene;
+
+		const double Checksum = BenchmarkSolver(Config, Checks, Scene);
+		BenchmarkComponentSpace(Config, Checks);
+		BenchmarkReOrientation(Scene, Checks);
+		BenchmarkCollision(Config, Checks);
+		BenchmarkSubStepVariants(Config);
+		BenchmarkTimeSteps(Config, Checks);
+		BenchmarkDeferredCatchUp(Config, Checks);
+		BenchmarkIntegrators(Config, Checks);
+		BenchmarkCompactState(Config, Checks);
+		BenchmarkExternalForces(Config);
+
+		UE_LOG(LogSoftBoneTests, Display, TEXT("    Checksum : %.6f"), Checksum);
+
+		const int32 NumFailed = Checks.Report();
+
+		if (NumFailed > 0)
+		{
+			UE_LOG(LogSoftBoneTests, Error, TEXT("SoftBone benchmark : %d of %d checks FAILED"), NumFailed, Checks.Checks.Num());
+		}
+		else
+		{
+			UE_LOG(LogSoftBoneTests, Display, TEXT("SoftBone benchmark : all %d checks passed"), Checks.Checks.Num());
+		}
+
+		return NumFailed;
+	}
+
+	static void RunCommand(const TArray<FString>& Args)
+	{
+		Run(Args);
+	}
+
+	static void InitializeInstances(TArray<FSyntheticScene>& Instances, int32 NumChains, int32 NumLinks, const FSoftBoneSolverParams& Params)
+	{
+		for (int32 InstanceIndex = 0; InstanceIndex < Instances.Num(); InstanceIndex++)
+		{
+			FSyntheticScene& Instance = Instances[InstanceIndex];
+
+			SetUpScene(Instance, NumChains, NumLinks, InstanceIndex * NumChains);
+
+			Instance.Params = Params;
+			Instance.FixedTimeStep = FixedTimeStep;
+			Instance.bFixedTimeStep = true;
+		}
+	}
+
+	/** Gathers targets of all instances for the frame, like nodes do during animation evaluation */
+	static void GatherTargets(TArray<FSyntheticScene>& Instances, int32 NumChains, int32 Frame)
+	{
+		const float Time = (Frame + 1) * FrameDeltaTime;
+
+		for (int32 InstanceIndex = 0; InstanceIndex < Instances.Num(); InstanceIndex++)
+		{
+			FSyntheticScene& Instance = Instances[InstanceIndex];
+
+			ComputeTargetPositions(Instance, InstanceIndex * NumChains, Time);
+			Instance.RemainingTime += FrameDeltaTime;
+			Instance.bPendingSimulation = true;
+		}
+	}
+
+	static double ComputeChecksum(const TArray<FSyntheticScene>& Instances)
+	{
+		double Checksum = 0.0;
+
+		for (int32 InstanceIndex = 0; InstanceIndex < Instances.Num(); InstanceIndex++)
+		{
+			const FSyntheticScene& Instance = Instances[InstanceIndex];
+
+			for (int32 Index = 0; Index < Instance.State.Num(); Index++)
+			{
+				Checksum += (Instance.State.Positions.Get(Index) - Instance.FinalTargetPositions.Get(Index)).Size();
+			}
+		}
+
+		return Checksum;
+	}
+
+	static void RunBatch(const TArray<FString>& Args)
+	{
+		const int32 NumInstances = (Args.Num() > 0) ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 1024;
+		const int32 NumChains = (Args.Num() > 1) ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 4;
+		const int32 NumLinks = (Args.Num() > 2) ? FMath::Max(FCString::Atoi(*Args[2]), 2) : 8;
+		const int32 NumFrames = (Args.Num() > 3) ? FMath::Max(FCString::Atoi(*Args[3]), 1) : 300;
+
+		FSoftBoneSolverParams Params;
+		Params.ExternalAcceleration = FVector(0.f, 0.f, -980.f * 0.25f);
+
+		TArray<FSyntheticScene> Instances;
+		Instances.AddDefaulted(NumInstances);
+
+		TArray<FSoftBoneSimulationInstance*> InstancePointers;
+		for (int32 InstanceIndex = 0; InstanceIndex < NumInstances; InstanceIndex++)
+		{
+			InstancePointers.Add(&Instances[InstanceIndex]);
+		}
+
+		const int32 MaxTasks = FPlatformMisc::NumberOfCoresIncludingHyperthreads();
+		const double NumLinkSteps = (double)NumInstances * NumChains * NumLinks * FMath::RoundToInt(NumFrames * FrameDeltaTime / FixedTimeStep);
+		const double NumInstanceFrames = (double)NumInstances * NumFrames;
+
+		UE_LOG(LogSoftBoneTests, Display, TEXT("SoftBone batch benchmark, task count sweep : %d instances x %d chains x %d links, %d frames, %d hardware threads"), NumInstances, NumChains, NumLinks, NumFrames, MaxTasks);
+
+		double SingleTaskSeconds = 0.0;
+		double SingleTaskChecksum = 0.0;
+
+		// number of tasks is doubled up to the number of hardware threads, and the last run is done by the manager with one task per instance
+		for (int32 NumTasks = 1; NumTasks <= MaxTasks * 2; NumTasks *= 2)
+		{
+			const bool bUseManager = (NumTasks > MaxTasks);
+
+			InitializeInstances(Instances, NumChains, NumLinks, Params);
+
+			FSoftBoneSimulationManager Manager;
+			if (bUseManager)
+			{
+				for (int32 InstanceIndex = 0; InstanceIndex < NumInstances; InstanceIndex++)
+				{
+					Manager.Register(&Instances[InstanceIndex]);
+				}
+			}
+
+			double Seconds = 0.0;
+
+			for (int32 Frame = 0; Frame < NumFrames; Frame++)
+			{
+				GatherTargets(Instances, NumChains, Frame);
+
+				const double StartTime = FPlatformTime::Seconds();
+
+				if (bUseManager)
+				{
+					Manager.SimulatePendingInstances();
+				}
+				else
+				{
+					FSoftBoneSimulationManager::SimulateInstances(InstancePointers.GetData(), NumInstances, NumTasks);
+				}
+
+				Seconds += FPlatformTime::Seconds() - StartTime;
+			}
+
+			const double Checksum = ComputeChecksum(Instances);
+
+			if (NumTasks == 1)
+			{
+				SingleTaskSeconds = Seconds;
+				SingleTaskChecksum = Checksum;
+			}
+
+			const double MillisecondsPerFrame = Seconds * 1000.0 / NumFrames;
+			const double MillionLinkStepsPerSecond = (Seconds > 0.0) ? NumLinkSteps / Seconds * 1.0e-6 : 0.0;
+			const double InstancesPerSecond = (Seconds > 0.0) ? NumInstanceFrames / Seconds : 0.0;
+			const double Scaling = (Seconds > 0.0) ? SingleTaskSeconds / Seconds : 0.0;
+
+			if (bUseManager)
+			{
+				UE_LOG(LogSoftBoneTests, Display, TEXT("    Manager, one task per instance : %.3f ms per frame, %.0f instances per second, %.1f M link steps per second, scaling x%.2f, checksum difference %f"), MillisecondsPerFrame, InstancesPerSecond, MillionLinkStepsPerSecond, Scaling, FMath::Abs(Checksum - SingleTaskChecksum));
+				break;
+			}
+
+			UE_LOG(LogSoftBoneTests, Display, TEXT("    %2d tasks : %.3f ms per frame, %.0f instances per second, %.1f M link steps per second, scaling x%.2f, checksum difference %f"), NumTasks, MillisecondsPerFrame, InstancesPerSecond, MillionLinkStepsPerSecond, Scaling, FMath::Abs(Checksum - SingleTaskChecksum));
+
+			// make sure the number of hardware threads is measured even if it isn't a power of two
+			if (NumTasks < MaxTasks && NumTasks * 2 > MaxTasks)
+			{
+				NumTasks = MaxTasks / 2;
+			}
+		}
+	}
+}
+
+static FAutoConsoleCommand SoftBoneBenchmarkCommand(
+	TEXT("SoftBone.Benchmark"),
+	TEXT("Runs the SoftBone solver on synthetic chains and prints the cost per link. Args : [NumChains] [NumLinksPerChain] [NumFrames]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&SoftBoneBenchmark::RunCommand)
+	);
+
+static FAutoConsoleCommand SoftBoneBatchBenchmarkCommand(
+	TEXT("SoftBone.BatchBenchmark"),
+	TEXT("Simulates many SoftBone instances in batches split into an increasing number of tasks and prints the throughput. Args : [NumInstances] [NumChainsPerInstance] [NumLinksPerChain] [NumFrames]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&SoftBoneBenchmark::RunBatch)
+	);
+
+#endif // #if !UE_BUILD_SHIPPING
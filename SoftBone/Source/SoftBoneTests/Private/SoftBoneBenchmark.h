@@ -0,0 +1,13 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#if !UE_BUILD_SHIPPING
+
+namespace SoftBoneBenchmark
+{
+	/** Runs SoftBone.Benchmark with [NumChains] [NumLinksPerChain] [NumFrames] and returns the number of failed checks */
+	int32 Run(const TArray<FString>& Args);
+}
+
+#endif // #if !UE_BUILD_SHIPPING
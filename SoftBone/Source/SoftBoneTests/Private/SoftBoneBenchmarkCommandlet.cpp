@@ -0,0 +1,28 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "SoftBoneTestsPrivatePCH.h"
+#include "SoftBoneBenchmarkCommandlet.h"
+#include "SoftBoneBenchmark.h"
+
+int32 USoftBoneBenchmarkCommandlet::Main(const FString& Params)
+{
+#if !UE_BUILD_SHIPPING
+	int32 NumChains = 256;
+	int32 NumLinks = 16;
+	int32 NumFrames = 600;
+
+	FParse::Value(*Params, TEXT("NumChains="), NumChains);
+	FParse::Value(*Params, TEXT("NumLinks="), NumLinks);
+	FParse::Value(*Params, TEXT("NumFrames="), NumFrames);
+
+	TArray<FString> Args;
+	Args.Add(FString::FromInt(NumChains));
+	Args.Add(FString::FromInt(NumLinks));
+	Args.Add(FString::FromInt(NumFrames));
+
+	return SoftBoneBenchmark::Run(Args);
+#else
+	UE_LOG(LogSoftBoneTests, Error, TEXT("SoftBone benchmark isn't compiled in shipping builds"));
+	return 1;
+#endif // #if !UE_BUILD_SHIPPING
+}
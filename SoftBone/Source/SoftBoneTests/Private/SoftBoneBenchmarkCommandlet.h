@@ -0,0 +1,19 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#pragma once
+
+#include "Commandlets/Commandlet.h"
+#include "SoftBoneBenchmarkCommandlet.generated.h"
+
+/**
+ * Runs the solver checks and microbenchmarks of SoftBone.Benchmark headless. The exit code is the number of failed checks.
+ * e.g. UE4Editor-Cmd <Project> -run=SoftBoneBenchmark -NumChains=256 -NumLinks=16 -NumFrames=600
+ */
+UCLASS()
+class USoftBoneBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,473 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "SoftBoneTestsPrivatePCH.h"
+#include "AutomationTest.h"
+#include "AnimNode_SoftBone.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+/////////////////////////////////////////////////////
+// SoftBone perf regression test
+//
+// Evaluates a SoftBone node on a transient mesh with 1, 8 and 32 chains of 4 to 32 bones, the way an anim instance would,
+// and compares it with baselines saved by an earlier run on the same machine.
+// The component circles around while the view distance walks through all LOD tiers, and the mesh switches to a LOD
+// without the tip bones and back, so target gathering, template building, re-orientation, LOD and restoring links are all measured.
+// Each configuration runs with full precision and with compact links.
+//
+// Slower time per link and frame, a different result, or any buffer growing outside of bone changes are errors.
+// Missing baselines are saved with a warning, -SoftBoneUpdateBaselines saves them again.
+// (e.g. UE4Editor-Cmd <Project> -nullrhi -ExecCmds="Automation RunTests SoftBone.PerfRegression, Quit")
+
+static TAutoConsoleVariable<float> CVarSoftBonePerfRegressionThreshold(
+	TEXT("SoftBone.PerfRegressionThreshold"),
+	0.2f,
+	TEXT("Fraction by which the SoftBone.PerfRegression tests may be slower per link and frame than their baselines before they fail."));
+
+/** Drives the node on a transient skeleton without an anim instance */
+class FSoftBoneNodeTestDriver
+{
+public:
+	/** Bounds of the component, large enough that only distance picks the LOD tier */
+	static const float BoundsRadius;
+
+	static void InitializeBoneReferences(FAnimNode_SoftBone& Node, const FBoneContainer& RequiredBones)
+	{
+		Node.InitializeBoneReferences(RequiredBones);
+	}
+
+	/** Update of the node with what the manager would have gathered from the component and the views of the world */
+	static void Update(FAnimNode_SoftBone& Node, float DeltaTime, const FTransform& ComponentToWorld, float ViewDistance)
+	{
+		Node.Simulation.GameThreadData.ViewDistance = ViewDistance;
+		Node.Simulation.GameThreadData.BoundsRadius = BoundsRadius;
+		Node.UpdateSimulationTime(DeltaTime, ComponentToWorld);
+	}
+
+	static ESoftBoneLODTier::Type GetLODTier(const FAnimNode_SoftBone& Node)
+	{
+		return Node.LODTier;
+	}
+
+	static int32 GetNumLinks(const FAnimNode_SoftBone& Node)
+	{
+		return Node.ChainTemplate.IsValid() ? Node.ChainTemplate->NumLinks : 0;
+	}
+};
+
+const float FSoftBoneNodeTestDriver::BoundsRadius = 1000.f;
+
+namespace SoftBonePerfRegression
+{
+	/** 10 seconds of scripted motion at 60 fps */
+	static const int32 NumFrames = 600;
+	static const float FrameDeltaTime = 1.f / 60.f;
+
+	/** Time is the best of a few runs, so it's less noisy than an average */
+	static const int32 NumRuns = 3;
+
+	static const float BoneLength = 10.f;
+	static const float ChainSpacing = 20.f;
+
+	/** Frames at which the mesh switches to the LOD without tip bones and back */
+	static const int32 LODSwitchFrame = NumFrames * 6 / 10;
+	static const int32 LODRestoreFrame = NumFrames * 8 / 10;
+
+	/** Result of one configuration, one line of the baseline file */
+	struct FPerfResult
+	{
+		int32 NumChains;
+		int32 NumLinks;
+		bool bCompactState;
+		double NanoSecondsPerLinkFrame;
+		double Checksum;
+
+		FString ToString() const
+		{
+			return FString::Printf(TEXT("%d %d %d %f %f"), NumChains, NumLinks, bCompactState ? 1 : 0, NanoSecondsPerLinkFrame, Checksum);
+		}
+
+		bool InitFromString(const FString& Line)
+		{
+			TArray<FString> Tokens;
+
+			if (Line.ParseIntoArray(Tokens, TEXT(" "), true) != 5)
+			{
+				return false;
+			}
+
+			NumChains = FCString::Atoi(*Tokens[0]);
+			NumLinks = FCString::Atoi(*Tokens[1]);
+			bCompactState = (FCString::Atoi(*Tokens[2]) != 0);
+			NanoSecondsPerLinkFrame = FCString::Atod(*Tokens[3]);
+			Checksum = FCString::Atod(*Tokens[4]);
+			return true;
+		}
+
+		bool IsSameConfiguration(const FPerfResult& Other) const
+		{
+			return NumChains == Other.NumChains && NumLinks == Other.NumLinks && bCompactState == Other.bCompactState;
+		}
+	};
+
+	static FString GetBaselinePath()
+	{
+		return FPaths::GameSavedDir() / TEXT("SoftBone") / TEXT("PerfBaselines.txt");
+	}
+
+	static void LoadBaselines(TArray<FPerfResult>& OutBaselines)
+	{
+		FString BaselineText;
+
+		if (FFileHelper::LoadFileToString(BaselineText, *GetBaselinePath()))
+		{
+			TArray<FString> Lines;
+			BaselineText.ParseIntoArrayLines(Lines);
+
+			for (int32 LineIndex = 0; LineIndex < Lines.Num(); LineIndex++)
+			{
+				FPerfResult Baseline;
+
+				if (Baseline.InitFromString(Lines[LineIndex]))
+				{
+					OutBaselines.Add(Baseline);
+				}
+			}
+		}
+	}
+
+	static bool SaveBaselines(const TArray<FPerfResult>& Baselines)
+	{
+		FString BaselineText;
+
+		for (int32 Index = 0; Index < Baselines.Num(); Index++)
+		{
+			BaselineText += Baselines[Index].ToString() + LINE_TERMINATOR;
+		}
+
+		return FFileHelper::SaveStringToFile(BaselineText, *GetBaselinePath());
+	}
+
+	static FName GetBoneName(int32 ChainIndex, int32 LinkIndex)
+	{
+		return FName(*FString::Printf(TEXT("Chain%d_%d"), ChainIndex, LinkIndex));
+	}
+
+	/** Mesh index of a bone, bones of each chain follow the root one chain after another */
+	static int32 GetBoneIndex(int32 NumLinks, int32 ChainIndex, int32 LinkIndex)
+	{
+		return 1 + ChainIndex * NumLinks + LinkIndex;
+	}
+
+	/** Transient mesh with NumChains chains of NumLinks bones under one root, and a skeleton merged from it. Kept from garbage collection until DestroyTestMesh. */
+	static USkeletalMesh* CreateTestMesh(int32 NumChains, int32 NumLinks)
+	{
+		USkeletalMesh* Mesh = NewObject<USkeletalMesh>(GetTransientPackage());
+		Mesh->AddToRoot();
+
+		Mesh->RefSkeleton.Add(FMeshBoneInfo(TEXT("Root"), TEXT("Root"), INDEX_NONE), FTransform::Identity);
+
+		for (int32 ChainIndex = 0; ChainIndex < NumChains; ChainIndex++)
+		{
+			for (int32 LinkIndex = 0; LinkIndex < NumLinks; LinkIndex++)
+			{
+				// chains start in a row above the root and stick out sideways, so they swing under gravity and the motion of the component
+				const FName BoneName = GetBoneName(ChainIndex, LinkIndex);
+				const int32 ParentIndex = (LinkIndex == 0) ? 0 : GetBoneIndex(NumLinks, ChainIndex, LinkIndex - 1);
+				const FVector Offset = (LinkIndex == 0) ? FVector(0.f, (ChainIndex - (NumChains - 1) * 0.5f) * ChainSpacing, 100.f) : FVector(BoneLength, 0.f, 0.f);
+
+				Mesh->RefSkeleton.Add(FMeshBoneInfo(BoneName, BoneName.ToString(), ParentIndex), FTransform(Offset));
+			}
+		}
+
+		USkeleton* Skeleton = NewObject<USkeleton>(GetTransientPackage());
+		Skeleton->AddToRoot();
+
+		Mesh->Skeleton = Skeleton;
+		Skeleton->MergeAllBonesToBoneTree(Mesh);
+
+		return Mesh;
+	}
+
+	static void DestroyTestMesh(USkeletalMesh* Mesh)
+	{
+		Mesh->Skeleton->RemoveFromRoot();
+		Mesh->RemoveFromRoot();
+	}
+
+	/** All bones, or all but the tip of each chain like a lower mesh LOD */
+	static void GetRequiredBones(int32 NumChains, int32 NumLinks, bool bWithoutTips, TArray<FBoneIndexType>& OutRequiredBones)
+	{
+		OutRequiredBones.Add(0);
+
+		for (int32 ChainIndex = 0; ChainIndex < NumChains; ChainIndex++)
+		{
+			const int32 NumRequiredLinks = bWithoutTips ? NumLinks - 1 : NumLinks;
+
+			for (int32 LinkIndex = 0; LinkIndex < NumRequiredLinks; LinkIndex++)
+			{
+				OutRequiredBones.Add(GetBoneIndex(NumLinks, ChainIndex, LinkIndex));
+			}
+		}
+	}
+
+	/** The component circles around the origin while turning and bobbing, so chains swing in world space */
+	static FTransform GetComponentToWorld(int32 Frame)
+	{
+		const float Time = Frame * FrameDeltaTime;
+		const float Angle = Time * PI;
+
+		return FTransform(FRotator(0.f, FMath::RadiansToDegrees(Angle), 0.f), FVector(FMath::Cos(Angle) * 200.f, FMath::Sin(Angle) * 200.f, FMath::Sin(Time * 5.f) * 20.f));
+	}
+
+	/** Walks through the LOD tiers of the node defaults : full, reduced rate, single step, frozen and back to full */
+	static float GetViewDistance(int32 Frame)
+	{
+		const float Fraction = (float)Frame / NumFrames;
+
+		if (Fraction < 0.2f)
+		{
+			return 0.f;
+		}
+		else if (Fraction < 0.3f)
+		{
+			return 3000.f;
+		}
+		else if (Fraction < 0.4f)
+		{
+			return 5000.f;
+		}
+		else if (Fraction < 0.5f)
+		{
+			return 10000.f;
+		}
+
+		return 0.f;
+	}
+
+	/** Evaluates one configuration NumRuns times. Errors about the node itself are added to Test. */
+	static FPerfResult MeasureConfiguration(FAutomationTestBase& Test, USkeletalMesh& Mesh, int32 NumChains, int32 NumLinks, bool bCompactState)
+	{
+		TArray<FBoneIndexType> RequiredBoneIndices;
+		GetRequiredBones(NumChains, NumLinks, false, RequiredBoneIndices);
+		const FBoneContainer FullBones(RequiredBoneIndices, Mesh);
+
+		RequiredBoneIndices.Reset();
+		GetRequiredBones(NumChains, NumLinks, true, RequiredBoneIndices);
+		const FBoneContainer LODBones(RequiredBoneIndices, Mesh);
+
+		const TCHAR* StateName = bCompactState ? TEXT("compact") : TEXT("full precision");
+
+		FPerfResult Result;
+		Result.NumChains = NumChains;
+		Result.NumLinks = NumLinks;
+		Result.bCompactState = bCompactState;
+		Result.NanoSecondsPerLinkFrame = 0.0;
+		Result.Checksum = 0.0;
+
+		for (int32 Run = 0; Run < NumRuns; Run++)
+		{
+			FAnimNode_SoftBone Node;
+			Node.RootBone.BoneName = GetBoneName(0, 0);
+
+			for (int32 ChainIndex = 1; ChainIndex < NumChains; ChainIndex++)
+			{
+				FBonePair& Pair = Node.AdditionalChains[Node.AdditionalChains.AddDefaulted()];
+				Pair.RootBone.BoneName = GetBoneName(ChainIndex, 0);
+			}
+
+			Node.bCompactState = bCompactState;
+			Node.bEnableLOD = true;
+
+			const FBoneContainer* RequiredBones = &FullBones;
+			FSoftBoneNodeTestDriver::InitializeBoneReferences(Node, *RequiredBones);
+
+			FCSPose<FCompactPose> MeshBases;
+			TArray<FBoneTransform> BoneTransforms;
+
+			double Seconds = 0.0;
+			int64 NumLinkFrames = 0;
+			double Checksum = 0.0;
+			uint32 UsedLODTiers = 0;
+
+			// buffers are sized when the chains are initialized for the required bones, no other frame is supposed to grow them
+			SIZE_T AllocatedSize = 0;
+			bool bBonesChanged = true;
+			int32 NumGrowingFrames = 0;
+
+			for (int32 Frame = 0; Frame < NumFrames; Frame++)
+			{
+				if (Frame == LODSwitchFrame || Frame == LODRestoreFrame)
+				{
+					// links which still exist continue from their simulated state, the tips are initialized again when they come back
+					RequiredBones = (Frame == LODSwitchFrame) ? &LODBones : &FullBones;
+					FSoftBoneNodeTestDriver::InitializeBoneReferences(Node, *RequiredBones);
+					bBonesChanged = true;
+				}
+
+				FSoftBoneNodeTestDriver::Update(Node, FrameDeltaTime, GetComponentToWorld(Frame + 1), GetViewDistance(Frame));
+				UsedLODTiers |= 1 << FSoftBoneNodeTestDriver::GetLODTier(Node);
+
+				// the animated pose is the reference pose, all motion comes from the component
+				MeshBases.InitPose(RequiredBones);
+				BoneTransforms.Reset();
+
+				const double StartTime = FPlatformTime::Seconds();
+
+				Node.EvaluateBoneTransforms(nullptr, MeshBases, BoneTransforms);
+
+				Seconds += FPlatformTime::Seconds() - StartTime;
+				NumLinkFrames += FSoftBoneNodeTestDriver::GetNumLinks(Node);
+
+				for (int32 Index = 0; Index < BoneTransforms.Num(); Index++)
+				{
+					const FTransform& Animated = MeshBases.GetComponentSpaceTransform(BoneTransforms[Index].BoneIndex);
+					const FTransform& Simulated = BoneTransforms[Index].Transform;
+
+					Checksum += (Simulated.GetLocation() - Animated.GetLocation()).Size() + Simulated.GetRotation().AngularDistance(Animated.GetRotation());
+				}
+
+				const SIZE_T FrameAllocatedSize = Node.GetAllocatedSize() + FAnimNode_SoftBone::GetThreadScratchSize();
+
+				if (!bBonesChanged && FrameAllocatedSize != AllocatedSize)
+				{
+					NumGrowingFrames++;
+				}
+
+				AllocatedSize = FrameAllocatedSize;
+				bBonesChanged = false;
+			}
+
+			if (NumGrowingFrames > 0)
+			{
+				Test.AddError(FString::Printf(TEXT("%d chains x %d links, %s : buffers changed size in %d frames without any change of bones"), NumChains, NumLinks, StateName, NumGrowingFrames));
+			}
+
+			if (UsedLODTiers != (1 << ESoftBoneLODTier::SLT_Full) + (1 << ESoftBoneLODTier::SLT_ReducedRate) + (1 << ESoftBoneLODTier::SLT_SingleStep) + (1 << ESoftBoneLODTier::SLT_Frozen))
+			{
+				Test.AddError(FString::Printf(TEXT("%d chains x %d links, %s : the script didn't go through all LOD tiers"), NumChains, NumLinks, StateName));
+			}
+
+			// runs share the chain template and nothing else, so they have to end up with the same bones
+			if (Run > 0 && Checksum != Result.Checksum)
+			{
+				Test.AddError(FString::Printf(TEXT("%d chains x %d links, %s : checksum %.4f differs from %.4f of the first run"), NumChains, NumLinks, StateName, Checksum, Result.Checksum));
+			}
+
+			const double NanoSeconds = (NumLinkFrames > 0) ? (Seconds * 1.0e9) / NumLinkFrames : 0.0;
+
+			Result.NanoSecondsPerLinkFrame = (Run == 0) ? NanoSeconds : FMath::Min(Result.NanoSecondsPerLinkFrame, NanoSeconds);
+			Result.Checksum = Checksum;
+		}
+
+		return Result;
+	}
+}
+
+IMPLEMENT_COMPLEX_AUTOMATION_TEST(FSoftBonePerfRegressionTest, "SoftBone.PerfRegression", EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+void FSoftBonePerfRegressionTest::GetTests(TArray<FString>& OutBeautifiedNames, TArray<FString>& OutTestCommands) const
+{
+	static const int32 ChainCounts[] = { 1, 8, 32 };
+	static const int32 LinkCounts[] = { 4, 8, 16, 32 };
+
+	for (int32 ChainCountIndex = 0; ChainCountIndex < ARRAY_COUNT(ChainCounts); ChainCountIndex++)
+	{
+		for (int32 LinkCountIndex = 0; LinkCountIndex < ARRAY_COUNT(LinkCounts); LinkCountIndex++)
+		{
+			OutBeautifiedNames.Add(FString::Printf(TEXT("%d Chains x %d Links"), ChainCounts[ChainCountIndex], LinkCounts[LinkCountIndex]));
+			OutTestCommands.Add(FString::Printf(TEXT("%d %d"), ChainCounts[ChainCountIndex], LinkCounts[LinkCountIndex]));
+		}
+	}
+}
+
+bool FSoftBonePerfRegressionTest::RunTest(const FString& Parameters)
+{
+	using namespace SoftBonePerfRegression;
+
+	TArray<FString> Tokens;
+
+	if (Parameters.ParseIntoArray(Tokens, TEXT(" "), true) != 2)
+	{
+		AddError(FString::Printf(TEXT("Expected [NumChains] [NumLinks], got '%s'"), *Parameters));
+		return false;
+	}
+
+	const int32 NumChains = FMath::Max(FCString::Atoi(*Tokens[0]), 1);
+	const int32 NumLinks = FMath::Max(FCString::Atoi(*Tokens[1]), 2);
+	const float Threshold = CVarSoftBonePerfRegressionThreshold.GetValueOnGameThread();
+	const bool bUpdateBaselines = FParse::Param(FCommandLine::Get(), TEXT("SoftBoneUpdateBaselines"));
+
+	TArray<FPerfResult> Baselines;
+	LoadBaselines(Baselines);
+
+	bool bSaveBaselines = false;
+
+	USkeletalMesh* Mesh = CreateTestMesh(NumChains, NumLinks);
+
+	for (int32 StateIndex = 0; StateIndex < 2; StateIndex++)
+	{
+		const FPerfResult Result = MeasureConfiguration(*this, *Mesh, NumChains, NumLinks, StateIndex == 1);
+
+		int32 BaselineIndex = INDEX_NONE;
+
+		for (int32 Index = 0; Index < Baselines.Num(); Index++)
+		{
+			if (Baselines[Index].IsSameConfiguration(Result))
+			{
+				BaselineIndex = Index;
+				break;
+			}
+		}
+
+		const FString Line = FString::Printf(TEXT("%d chains x %d links, %s : %.2f ns per link and frame, checksum %.4f"),
+			NumChains, NumLinks, Result.bCompactState ? TEXT("compact") : TEXT("full precision"), Result.NanoSecondsPerLinkFrame, Result.Checksum);
+
+		if (BaselineIndex == INDEX_NONE || bUpdateBaselines)
+		{
+			AddWarning(FString::Printf(TEXT("%s, saved as baseline"), *Line));
+
+			if (BaselineIndex == INDEX_NONE)
+			{
+				Baselines.Add(Result);
+			}
+			else
+			{
+				Baselines[BaselineIndex] = Result;
+			}
+
+			bSaveBaselines = true;
+			continue;
+		}
+
+		const FPerfResult& Baseline = Baselines[BaselineIndex];
+		const bool bSlower = (Result.NanoSecondsPerLinkFrame > Baseline.NanoSecondsPerLinkFrame * (1.f + Threshold));
+		const bool bDifferent = (FMath::Abs(Result.Checksum - Baseline.Checksum) > FMath::Max(FMath::Abs(Baseline.Checksum), 1.0) * 1.0e-4);
+
+		if (bSlower)
+		{
+			AddError(FString::Printf(TEXT("%s, slower than %.2f ns of the baseline by more than %.0f%%"), *Line, Baseline.NanoSecondsPerLinkFrame, Threshold * 100.f));
+		}
+
+		if (bDifferent)
+		{
+			AddError(FString::Printf(TEXT("%s, differs from checksum %.4f of the baseline"), *Line, Baseline.Checksum));
+		}
+
+		if (!bSlower && !bDifferent)
+		{
+			AddLogItem(FString::Printf(TEXT("%s, baseline %.2f ns"), *Line, Baseline.NanoSecondsPerLinkFrame));
+		}
+	}
+
+	DestroyTestMesh(Mesh);
+
+	if (bSaveBaselines && !SaveBaselines(Baselines))
+	{
+		AddError(FString::Printf(TEXT("Failed to save baselines to %s"), *GetBaselinePath()));
+	}
+
+	return true;
+}
+
+#endif // #if WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,7 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "SoftBoneTestsPrivatePCH.h"
+
+DEFINE_LOG_CATEGORY(LogSoftBoneTests);
+
+IMPLEMENT_MODULE(FDefaultModuleImpl, SoftBoneTests)
@@ -0,0 +1,7 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+#include "Engine.h"
+#include "ModuleManager.h"
+#include "SoftBoneSolver.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogSoftBoneTests, Log, All);
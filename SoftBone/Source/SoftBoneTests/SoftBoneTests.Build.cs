@@ -0,0 +1,23 @@
+// Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
+
+namespace UnrealBuildTool.Rules
+{
+	public class SoftBoneTests : ModuleRules
+	{
+        public SoftBoneTests(TargetInfo Target)
+		{
+            PrivateIncludePaths.Add("SoftBoneTests/Private");
+
+            PrivateDependencyModuleNames.AddRange(
+                new string[] { 
+				"Core", 
+				"CoreUObject", 
+				"Engine", 
+				"AnimGraphRuntime",
+				"SoftBoneSolver",
+				"SoftBone",
+			    }
+            );
+		}
+	}
+}